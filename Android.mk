@@ -7,24 +7,36 @@ LOCAL_MODULE := pomelo_static
 LOCAL_MODULE_FILENAME := libpomelo
 
 LOCAL_SRC_FILES := \
+src/alloc.c \
+src/arena.c \
 src/client.c \
+src/completion.c \
 src/message.c \
 src/package.c \
 src/pkg-handshake.c \
 src/transport.c \
 src/common.c \
+src/frame.c \
+src/group.c \
 src/msg-json.c \
 src/pb-decode.c \
 src/pkg-heartbeat.c \
+src/pool.c \
+src/route.c \
 src/jansson-memory.c \
 src/listener.c \
 src/msg-pb.c \
 src/pb-encode.c \
 src/protocol.c \
+src/req-table.c \
 src/map.c \
+src/mpsc-queue.c \
 src/network.c \
+src/pb-schema.c \
+src/pb-typed.c \
 src/pb-util.c \
 src/thread.c \
+src/timing-wheel.c \
 
 
 
@@ -0,0 +1,37 @@
+#ifndef PC_ALLOC_H
+#define PC_ALLOC_H
+
+#include "pomelo.h"
+
+/**
+ * Allocation functions used by libpomelo instead of malloc and free, they
+ * are served by the allocator of pc_set_allocator.
+ */
+
+void *pc__malloc(size_t size, pc_alloc_tag tag);
+
+void *pc__calloc(size_t count, size_t size, pc_alloc_tag tag);
+
+/**
+ * Resize an allocation.
+ *
+ * @param  ptr      allocation or NULL.
+ * @param  old_size size of the allocation, 0 if unknown.
+ * @param  size     new size.
+ * @param  tag      tag of the allocation.
+ * @return          the allocation or NULL for error, ptr is kept for error.
+ */
+void *pc__realloc(void *ptr, size_t old_size, size_t size, pc_alloc_tag tag);
+
+/**
+ * Release an allocation, nothing to do for NULL.
+ *
+ * @param ptr  allocation.
+ * @param size size of the allocation, 0 if unknown.
+ * @param tag  tag of the allocation.
+ */
+void pc__free(void *ptr, size_t size, pc_alloc_tag tag);
+
+char *pc__strdup(const char *str, pc_alloc_tag tag);
+
+#endif /* PC_ALLOC_H */
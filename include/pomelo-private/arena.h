@@ -0,0 +1,123 @@
+#ifndef PC_ARENA_H
+#define PC_ARENA_H
+
+#include <stddef.h>
+#include "pomelo.h"
+
+/**
+ * Bump arena for the allocations made while decoding one message. Memory is
+ * carved from chunks and released all at once by reset, free of a single
+ * block is a no-op.
+ *
+ * While an arena is the current one of a thread, the json allocations of
+ * that thread are served by it, see pc__arena_enter.
+ */
+
+#define PC_ARENA_CHUNK_SIZE 4096
+#define PC_ARENA_ALIGN (2 * sizeof(void *))
+
+#ifdef _WIN32
+#define PC_TLS __declspec(thread)
+#else
+#define PC_TLS __thread
+#endif
+
+typedef struct pc_arena_chunk_s pc_arena_chunk_t;
+
+struct pc_arena_chunk_s {
+  pc_arena_chunk_t *next;
+  char *end;
+};
+
+struct pc_arena_s {
+  /*! References of the message being dispatched and retains by user. */
+  volatile long refs;
+  /*! Chunk in use is the head of chunk list. */
+  pc_arena_chunk_t *chunks;
+  char *pos;
+  size_t chunk_size;
+  /*! Json allocations go to arena, only between enter and leave. */
+  int alloc;
+};
+
+/**
+ * Create an empty arena with one reference.
+ *
+ * @param  chunk_size size of the chunks, 0 for PC_ARENA_CHUNK_SIZE.
+ * @return            arena or NULL for error.
+ */
+pc_arena_t *pc_arena_new(size_t chunk_size);
+
+/**
+ * Allocate from arena, the blocks larger than a chunk get their own chunk.
+ *
+ * @param  arena arena instance.
+ * @param  size  bytes to allocate.
+ * @return       memory aligned to PC_ARENA_ALIGN or NULL for error.
+ */
+void *pc_arena_alloc(pc_arena_t *arena, size_t size);
+
+/**
+ * Check whether the memory is allocated from arena.
+ *
+ * @param  arena arena instance.
+ * @param  ptr   memory to check.
+ * @return       1 or 0
+ */
+int pc_arena_contains(const pc_arena_t *arena, const void *ptr);
+
+/**
+ * Release all the allocations and keep the first chunk for reuse.
+ *
+ * @param arena arena instance.
+ */
+void pc_arena_reset(pc_arena_t *arena);
+
+/**
+ * Destroy the arena and all its chunks.
+ *
+ * @param arena arena instance.
+ */
+void pc_arena_destroy(pc_arena_t *arena);
+
+/**
+ * Route the json allocations through the arena hooks, which fall back to
+ * the allocator of pc_json_set_alloc_funcs out of an arena.
+ */
+void pc__arena_install_hooks();
+
+/**
+ * Make the arena current in the calling thread, and serve the json
+ * allocations of the thread from it. The hooks must have been installed.
+ *
+ * @param arena arena instance.
+ */
+void pc__arena_enter(pc_arena_t *arena);
+
+/**
+ * Stop serving json allocations from the current arena, it stays current
+ * so that the frees of its blocks are still recognized.
+ */
+void pc__arena_stop_alloc();
+
+/**
+ * Clear the current arena of the calling thread.
+ */
+void pc__arena_leave();
+
+/**
+ * Get the current arena of the calling thread.
+ *
+ * @return arena or NULL.
+ */
+pc_arena_t *pc__arena_current();
+
+/**
+ * Drop a reference of arena.
+ *
+ * @param  arena arena instance.
+ * @return       references left.
+ */
+long pc__arena_unref(pc_arena_t *arena);
+
+#endif /* PC_ARENA_H */
@@ -0,0 +1,56 @@
+#ifndef PC_ATOMIC_H
+#define PC_ATOMIC_H
+
+/**
+ * Minimal atomic primitives used by the lock-free structures of libpomelo.
+ * All the operations imply a full memory barrier, except the loads and
+ * stores of int which only order the memory accesses around them.
+ */
+
+#ifdef _WIN32
+#include <windows.h>
+
+#define pc__atomic_xchg_ptr(ptr, val)                                         \
+  InterlockedExchangePointer((PVOID volatile *)(ptr), (PVOID)(val))
+
+#define pc__atomic_load_ptr(ptr)                                              \
+  InterlockedCompareExchangePointer((PVOID volatile *)(ptr), NULL, NULL)
+
+#define pc__atomic_store_ptr(ptr, val)                                        \
+  ((void)InterlockedExchangePointer((PVOID volatile *)(ptr), (PVOID)(val)))
+
+/* Add to a long and return the new value. */
+#define pc__atomic_add_long(ptr, val)                                         \
+  (InterlockedExchangeAdd((LONG volatile *)(ptr), (LONG)(val)) + (val))
+
+#define pc__atomic_load_int(ptr)                                              \
+  InterlockedCompareExchange((LONG volatile *)(ptr), 0, 0)
+
+#define pc__atomic_store_int(ptr, val)                                        \
+  ((void)InterlockedExchange((LONG volatile *)(ptr), (LONG)(val)))
+
+#else
+
+#define pc__atomic_xchg_ptr(ptr, val)                                         \
+  (__sync_synchronize(), __sync_lock_test_and_set((ptr), (val)))
+
+#define pc__atomic_load_ptr(ptr)                                              \
+  __sync_val_compare_and_swap((ptr), NULL, NULL)
+
+#define pc__atomic_store_ptr(ptr, val)                                        \
+  ((void)pc__atomic_xchg_ptr((ptr), (val)))
+
+#define pc__atomic_add_long(ptr, val)                                         \
+  __sync_add_and_fetch((ptr), (val))
+
+/* Load with acquire order, reads after it see the writes before the store. */
+#define pc__atomic_load_int(ptr)                                              \
+  __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+
+/* Store with release order, the writes before it are seen by the load. */
+#define pc__atomic_store_int(ptr, val)                                        \
+  __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+
+#endif
+
+#endif /* PC_ATOMIC_H */
@@ -4,6 +4,7 @@
 #include "uv.h"
 
 #define MIN(X, Y) ((X) < (Y) ? (X) : (Y))
+#define MAX(X, Y) ((X) > (Y) ? (X) : (Y))
 
 /**
  * uv handle close callback.
@@ -0,0 +1,65 @@
+#ifndef PC_COMPLETION_H
+#define PC_COMPLETION_H
+
+#include "pomelo.h"
+
+/**
+ * Completion queue of client, see pc_client_set_completion_queue.
+ *
+ * The requests, notifies and messages are linked through the node embedded
+ * in them, only the events are allocated. The queue is lock-free, the loop
+ * thread pushes and the polling thread pops.
+ */
+
+typedef enum {
+  PC__COMPLETION_REQUEST = 1,
+  PC__COMPLETION_NOTIFY,
+  PC__COMPLETION_MSG,
+  PC__COMPLETION_EVENT
+} pc__completion_type;
+
+typedef struct {
+  pc_completion_t completion;
+  const char *event;
+  void *data;
+} pc__completion_event_t;
+
+/**
+ * Create the fd and turn on the completion queue mode of client.
+ *
+ * @param  client client instance.
+ * @return        0 or -1
+ */
+int pc__completion_open(pc_client_t *client);
+
+/**
+ * Fire the completions left and turn off the completion queue mode.
+ *
+ * @param client client instance.
+ */
+void pc__completion_close(pc_client_t *client);
+
+/**
+ * Queue a completion and signal the fd if the queue was empty.
+ *
+ * @param client     client instance.
+ * @param completion completion embedded in the object done.
+ * @param type       pc__completion_type
+ * @param status     status passed to the callback.
+ */
+void pc__completion_push(pc_client_t *client, pc_completion_t *completion,
+                         int type, int status);
+
+/**
+ * Callback set for the requests in completion queue mode, which queues the
+ * request for the callback of user.
+ */
+void pc__request_complete_cb(pc_request_t *req, int status, json_t *resp);
+
+/**
+ * Callback set for the notifies in completion queue mode, which queues the
+ * notify for the callback of user.
+ */
+void pc__notify_complete_cb(pc_notify_t *req, int status);
+
+#endif /* PC_COMPLETION_H */
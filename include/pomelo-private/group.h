@@ -0,0 +1,66 @@
+#ifndef PC_GROUP_H
+#define PC_GROUP_H
+
+#include "pomelo.h"
+
+typedef struct pc__group_loop_s pc__group_loop_t;
+typedef struct pc__group_task_s pc__group_task_t;
+
+/**
+ * Task posted from other threads and executed in the thread of a group loop.
+ */
+typedef void (*pc__group_task_run)(pc__group_task_t *task);
+
+struct pc__group_task_s {
+  pc__group_task_run run;
+  pc__group_loop_t *loop;
+  pc_client_t *client;
+  pc_group_cb cb;
+  void *data;
+  struct sockaddr_in addr;
+  /*! Semaphore to post when a synchronous task is done. */
+  uv_sem_t *done;
+  ngx_queue_t queue;
+};
+
+/**
+ * A loop of client group which is driven by its own thread.
+ */
+struct pc__group_loop_s {
+  pc_client_group_t *group;
+  int index;
+  uv_loop_t *uv_loop;
+  uv_thread_t thread;
+  /*! uv_thread_self of the loop thread, set once the thread started. */
+  volatile unsigned long thread_id;
+  /*! Wake up the loop thread to run the pending tasks. */
+  uv_async_t async;
+  uv_mutex_t mutex;
+  ngx_queue_t tasks;
+  /*! Clients running on the loop, only accessed in the loop thread. */
+  ngx_queue_t clients;
+  /*! Number of clients assigned to the loop, guarded by group mutex. */
+  int nclients;
+  int closing;
+};
+
+/**
+ * Client group structure.
+ */
+struct pc_client_group_s {
+  pc_group_policy policy;
+  int nloops;
+  pc__group_loop_t *loops;
+  /*! Next loop for round robin policy. */
+  int next;
+  uv_mutex_t mutex;
+};
+
+/**
+ * Detach a client from its group loop when the client is released.
+ *
+ * @param client client instance.
+ */
+void pc__group_client_released(pc_client_t *client);
+
+#endif /* PC_GROUP_H */
@@ -139,6 +139,169 @@ void pc__default_msg_parse_done_cb(pc_client_t *client, pc_msg_t *msg);
 pc_buf_t pc__default_msg_encode_cb(pc_client_t *client, uint32_t reqId,
     const char *route, json_t *msg);
 
+/**
+ * Encode a request or notify into a whole data package in one buffer, it is
+ * the fast path of default message encode.
+ *
+ * @param  client client instance.
+ * @param  reqId  request id, positive for request or 0 for notify.
+ * @param  route  route with the code and definitions filled.
+ * @param  msg    message object.
+ * @param  size   output of the capacity of package buffer.
+ * @return        package in bytes or buf.len = -1 for error.
+ */
+pc_buf_t pc__default_frame_encode(pc_client_t *client, uint32_t reqId,
+    const pc_route_t *route, json_t *msg, size_t *size);
+
+/**
+ * Encode a request or notify with a generated struct into a whole data
+ * package, the typed counterpart of pc__default_frame_encode.
+ *
+ * @param  client client instance.
+ * @param  reqId  request id, positive for request or 0 for notify.
+ * @param  route  route with the code and definitions filled.
+ * @param  codec  codec of the struct.
+ * @param  msg    struct to encode.
+ * @param  size   output of the capacity of package buffer.
+ * @return        package in bytes or buf.len = -1 for error.
+ */
+pc_buf_t pc__typed_frame_encode(pc_client_t *client, uint32_t reqId,
+    const pc_route_t *route, const pc_typed_codec_t *codec, const void *msg,
+    size_t *size);
+
+/**
+ * Encode a request or notify with the body encoded by application into a
+ * whole data package.
+ *
+ * @param  client client instance.
+ * @param  reqId  request id, positive for request or 0 for notify.
+ * @param  route  route with the code filled.
+ * @param  body   encoded body.
+ * @param  size   output of the capacity of package buffer.
+ * @return        package in bytes or buf.len = -1 for error.
+ */
+pc_buf_t pc__body_frame_encode(pc_client_t *client, uint32_t reqId,
+    const pc_route_t *route, pc_buf_t body, size_t *size);
+
+/**
+ * Create the route handle map of client.
+ *
+ * @param  client client instance.
+ * @return        0 or -1
+ */
+int pc__routes_init(pc_client_t *client);
+
+/**
+ * Destroy the route handle map of client and all the handles.
+ *
+ * @param client client instance.
+ */
+void pc__routes_clear(pc_client_t *client);
+
+/**
+ * Mark the cache of all route handles stale, called whenever the route
+ * dictionary or the protos of client changed.
+ *
+ * @param client client instance.
+ */
+void pc__routes_invalidate(pc_client_t *client);
+
+/**
+ * Take the route dictionary of handshake, and index its routes by code.
+ *
+ * @param  client client instance.
+ * @param  dict   route dictionary, route string to code.
+ * @return        0 or -1
+ */
+int pc__routes_set_dict(pc_client_t *client, json_t *dict);
+
+/**
+ * Release the route dictionary of client.
+ *
+ * @param client client instance.
+ */
+void pc__routes_clear_dict(pc_client_t *client);
+
+/**
+ * Refill the cache of route handle if it is stale, in loop thread only.
+ *
+ * @param client client instance.
+ * @param route  route handle of client.
+ */
+void pc__route_update(pc_client_t *client, pc_route_t *route);
+
+/**
+ * Fill the encode part of a temporary handle for a route string, in loop
+ * thread only.
+ *
+ * @param client client instance.
+ * @param route  route string, referenced by the handle.
+ * @param out    handle to fill.
+ */
+void pc__route_lookup(pc_client_t *client, const char *route,
+                      pc_route_t *out);
+
+/* Typed messages up to this size are decoded on stack. */
+#define PC__TYPED_STACK_WORDS 32
+
+/**
+ * Get a zeroed struct to decode a typed message into, the stack buffer is
+ * used if it is big enough. Free the result if it is not the stack buffer.
+ *
+ * @param  codec codec of the struct.
+ * @param  stack stack buffer.
+ * @param  size  size of stack buffer.
+ * @return       struct or NULL for error.
+ */
+void *pc__typed_alloc(const pc_typed_codec_t *codec, void *stack, size_t size);
+
+/**
+ * Check whether the message pushed on the event should be decoded as json,
+ * which is true only if the event has an untyped listener.
+ *
+ * @param  client client instance.
+ * @param  event  event name.
+ * @return        1 or 0
+ */
+int pc__event_need_json(pc_client_t *client, const char *event);
+
+/**
+ * Check whether the message pushed on the event should keep its body, which
+ * is true only if the event has a typed or raw listener.
+ *
+ * @param  client client instance.
+ * @param  event  event name.
+ * @return        1 or 0
+ */
+int pc__event_need_body(pc_client_t *client, const char *event);
+
+/**
+ * Emit an event of client, which is queued in completion queue mode.
+ *
+ * @param client client instance.
+ * @param event  event name, must be a constant.
+ * @param data   attach data of the event.
+ */
+void pc__emit_event(pc_client_t *client, const char *event, void *data);
+
+/**
+ * Fire the callbacks of a message parsed by the default parser, the request
+ * of response is out of table and its deadline stopped already.
+ *
+ * @param client client instance.
+ * @param msg    message parsed.
+ */
+void pc__msg_deliver(pc_client_t *client, pc_msg_t *msg);
+
+/**
+ * Fire the raw listeners of the message pushed, and decode it for each
+ * typed listener of the event and fire them.
+ *
+ * @param client client instance.
+ * @param msg    message pushed with the body kept.
+ */
+void pc__emit_msg_event(pc_client_t *client, pc_msg_t *msg);
+
 /**
  * Callback for default message encode done event.
  *
@@ -158,6 +321,84 @@ void pc__default_msg_encode_done_cb(pc_client_t * client, pc_buf_t buf);
 void pc__pkg_cb(pc_pkg_type type, const char *data, size_t len,
                        void *attach);
 
+/**
+ * Callback for a uv handle of the client has been closed. The client on a
+ * shared loop would be finished after its last handle closed.
+ *
+ * @param client client instance.
+ */
+void pc__client_handle_closed(pc_client_t *client);
+
+/**
+ * Finish the closed client on a shared loop, once none of its handles and
+ * threadpool decodes is pending.
+ *
+ * @param client client instance.
+ */
+void pc__client_check_closed(pc_client_t *client);
+
+/**
+ * Callback for the write async of client, in which all the requests and
+ * notifies submitted from other threads are sent in one batch.
+ *
+ * @param handle write async handle of client.
+ * @param status 0 or -1
+ */
+void pc__async_write_cb(uv_async_t *handle, int status);
+
+/**
+ * Drain the pending requests and notifies of client, used internal only.
+ * They would be sent for status 0 or failed for status -1.
+ *
+ * @param client client instance.
+ * @param status 0 or -1
+ */
+void pc__client_flush_writes(pc_client_t *client, int status);
+
+/**
+ * Stop the deadline of a request which is completed, used internal only.
+ *
+ * @param client client instance.
+ * @param req    request instance.
+ */
+void pc__request_timer_stop(pc_client_t *client, pc_request_t *req);
+
+/**
+ * Callback for the request timer of client, in which the requests passed
+ * their deadlines are failed.
+ *
+ * @param handle request timer of client.
+ * @param status 0 or -1
+ */
+void pc__request_timer_cb(uv_timer_t *handle, int status);
+
+/**
+ * Compile the protobuf definitions of client into schemas, and release the
+ * previous ones. Should be invoked whenever server_protos or client_protos
+ * changed.
+ *
+ * @param client client instance.
+ */
+void pc__client_compile_protos(pc_client_t *client);
+
+/**
+ * Get an arena with one reference for decoding a message, the one cached in
+ * client is reused if any. Must be invoked in loop thread.
+ *
+ * @param  client client instance.
+ * @return        arena or NULL for error.
+ */
+pc_arena_t *pc__client_take_arena(pc_client_t *client);
+
+/**
+ * Drop the reference of a message arena. The arena is reset and cached in
+ * client for the next message, unless it is still retained by user.
+ *
+ * @param client client instance.
+ * @param arena  arena from pc__client_take_arena.
+ */
+void pc__client_put_arena(pc_client_t *client, pc_arena_t *arena);
+
 /**
  * Clear the client instance.
  *
@@ -7,4 +7,20 @@
 void* pc_jsonp_malloc(size_t size);
 void pc_jsonp_free(void *ptr);
 
+/**
+ * Install the memory hooks of jansson, which should fall back to
+ * pc_jsonp_malloc and pc_jsonp_free. The functions set by
+ * pc_json_set_alloc_funcs are only used by the hooks afterward.
+ *
+ * @param malloc_fn malloc hook.
+ * @param free_fn   free hook.
+ */
+void pc__jsonp_set_hooks(json_malloc_t malloc_fn, json_free_t free_fn);
+
+/**
+ * Let jansson allocate by pc_jsonp_malloc and pc_jsonp_free, which are
+ * served by the allocator of pc_set_allocator by default.
+ */
+void pc__jsonp_use_allocator();
+
 #endif
\ No newline at end of file
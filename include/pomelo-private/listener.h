@@ -5,13 +5,33 @@
 
 struct pc_listener_s {
   pc_event_cb cb;
-  ngx_queue_t queue;
+  /*! Typed listener decodes the message with codec instead of json. */
+  const pc_typed_codec_t *codec;
+  pc_typed_event_cb typed_cb;
+  /*! Raw listener gets the message undecoded. */
+  pc_raw_event_cb raw_cb;
 };
 
 /**
- * Create new listener instance.
+ * Listeners of an event, in the order they were added.
  */
-pc_listener_t *pc_listener_new();
+typedef struct {
+  size_t count;
+  pc_listener_t items[1];
+} pc_listener_list_t;
+
+/**
+ * Listener table of client, which is never modified once published. Adding
+ * or removing a listener builds a new table and swaps it in, the old one is
+ * destroyed when the last dispatch using it drops its reference.
+ */
+struct pc_listener_table_s {
+  volatile long refs;
+  /*! Event to pc_listener_list_t, no empty lists. */
+  pc_map_t *lists;
+  /*! Next table swapped out and waiting to be released by client. */
+  pc_listener_table_t *retired_next;
+};
 
 /**
  * Init listener.
@@ -22,10 +42,44 @@ pc_listener_t *pc_listener_new();
 int pc_listener_init(pc_listener_t *listener);
 
 /**
- * Destroy listener instance.
+ * Create an empty listener table with one reference.
+ *
+ * @return table or NULL for error.
+ */
+pc_listener_table_t *pc_listener_table_new();
+
+/**
+ * Copy the listener table with a listener added to or removed from the
+ * event, the table copied is not modified.
+ *
+ * @param  table    table to copy.
+ * @param  event    event name.
+ * @param  listener listener to add, or the one to remove which matches the
+ *                  callbacks of a listener of the event.
+ * @param  add      1 to add and 0 to remove.
+ * @return          new table with one reference, or NULL for error or no
+ *                  listener to remove.
+ */
+pc_listener_table_t *pc_listener_table_update(pc_listener_table_t *table,
+                                              const char *event,
+                                              const pc_listener_t *listener,
+                                              int add);
+
+/**
+ * Get the listeners of an event.
+ *
+ * @param  table listener table.
+ * @param  event event name.
+ * @return       listeners or NULL for none.
+ */
+pc_listener_list_t *pc_listener_table_get(pc_listener_table_t *table,
+                                          const char *event);
+
+/**
+ * Drop a reference of the listener table, and destroy it with the last one.
  *
- * @param listener listener instance
+ * @param table listener table.
  */
-void pc_listener_destroy(pc_listener_t *listener);
+void pc_listener_table_release(pc_listener_table_t *table);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,52 @@
+#ifndef PC_MPSC_QUEUE_H
+#define PC_MPSC_QUEUE_H
+
+/**
+ * Intrusive lock-free queue with multiple producers and a single consumer.
+ *
+ * Any thread can push nodes without locking, while only one thread (the loop
+ * thread of the owner) is allowed to pop them out.
+ */
+
+typedef struct pc_mpsc_node_s pc_mpsc_node_t;
+typedef struct pc_mpsc_queue_s pc_mpsc_queue_t;
+
+struct pc_mpsc_node_s {
+  pc_mpsc_node_t *volatile next;
+};
+
+struct pc_mpsc_queue_s {
+  /*! The last pushed node, swapped by producers. */
+  pc_mpsc_node_t *volatile head;
+  /*! The next node to pop, only touched by the consumer. */
+  pc_mpsc_node_t *tail;
+  pc_mpsc_node_t stub;
+};
+
+/**
+ * Initiate an empty queue.
+ *
+ * @param queue queue instance.
+ */
+void pc_mpsc_queue_init(pc_mpsc_queue_t *queue);
+
+/**
+ * Push a node to the queue, safe to be invoked in any thread.
+ *
+ * @param queue queue instance.
+ * @param node  node to push, must not be in any queue.
+ */
+void pc_mpsc_queue_push(pc_mpsc_queue_t *queue, pc_mpsc_node_t *node);
+
+/**
+ * Pop a node from the queue, must be invoked in the consumer thread only.
+ *
+ * NULL may be returned while a producer is in the middle of a push, in which
+ * case the producer would notify the consumer again after the push finished.
+ *
+ * @param  queue queue instance.
+ * @return       the oldest node in queue or NULL if none available.
+ */
+pc_mpsc_node_t *pc_mpsc_queue_pop(pc_mpsc_queue_t *queue);
+
+#endif /* PC_MPSC_QUEUE_H */
@@ -0,0 +1,69 @@
+#ifndef PC_POOL_H
+#define PC_POOL_H
+
+#include <stddef.h>
+#include "pomelo.h"
+
+/**
+ * Free list of the objects of the same size. Released objects are kept for
+ * reuse up to a limit, the rest go back to the allocator.
+ *
+ * The pool is referenced by its owner and by every object taken out of it,
+ * so objects may still be put back after the owner released the pool.
+ */
+
+#define PC_POOL_MAX_ITEMS 256
+
+typedef struct pc_pool_item_s pc_pool_item_t;
+
+struct pc_pool_item_s {
+  pc_pool_item_t *next;
+};
+
+struct pc_pool_s {
+  uv_mutex_t mutex;
+  /*! Free objects, linked through their first bytes. */
+  pc_pool_item_t *items;
+  size_t count;
+  size_t max;
+  size_t size;
+  pc_alloc_tag tag;
+  /*! References of owner and the objects in use. */
+  size_t refs;
+};
+
+/**
+ * Create a pool with one reference of the owner.
+ *
+ * @param  size size of object, no less than a pointer.
+ * @param  max  free objects to keep, 0 for PC_POOL_MAX_ITEMS.
+ * @param  tag  allocation tag of the objects.
+ * @return      pool or NULL for error.
+ */
+pc_pool_t *pc_pool_new(size_t size, size_t max, pc_alloc_tag tag);
+
+/**
+ * Take an object out of the pool, the content is undefined.
+ *
+ * @param  pool pool instance.
+ * @return      object or NULL for error.
+ */
+void *pc_pool_get(pc_pool_t *pool);
+
+/**
+ * Put an object back to the pool it is taken from.
+ *
+ * @param pool pool instance.
+ * @param item object of pc_pool_get.
+ */
+void pc_pool_put(pc_pool_t *pool, void *item);
+
+/**
+ * Drop the reference of owner and release the free objects, the pool is
+ * destroyed once the last object in use is put back.
+ *
+ * @param pool pool instance.
+ */
+void pc_pool_release(pc_pool_t *pool);
+
+#endif /* PC_POOL_H */
@@ -0,0 +1,98 @@
+#ifndef PC_REQ_TABLE_H
+#define PC_REQ_TABLE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/**
+ * Table of in-flight requests keyed by request id. It is an open addressing
+ * hash table with linear probing. The request ids are sequential, so the id
+ * masked by capacity is used as hash and the table behaves like a ring.
+ */
+
+#define PC__REQ_TABLE_DEFAULT_CAPACITY 64
+
+struct pc_request_s;
+
+typedef struct pc_req_table_s pc_req_table_t;
+
+/**
+ * Request release callback which would be fired when the table clearing.
+ *
+ * @param table pointer to the table instance.
+ * @param req   the request.
+ */
+typedef void (*pc_req_table_release)(pc_req_table_t *table,
+                                     struct pc_request_s *req);
+
+typedef struct {
+  uint32_t id;
+  struct pc_request_s *req;
+} pc__req_slot_t;
+
+struct pc_req_table_s {
+  /*! Capacity of slots, always power of 2. */
+  uint32_t capacity;
+  /*! Number of requests in table. */
+  uint32_t count;
+  /*! Array of slots, empty slot has NULL req. */
+  pc__req_slot_t *slots;
+  /*! Request release callback for the table clearing. */
+  pc_req_table_release release_req;
+};
+
+/**
+ * Create a new request table.
+ *
+ * @param  capacity    initial capacity, rounded up to power of 2.
+ * @param  release_req request release callback for the table clearing.
+ * @return             new table instance or NULL for error.
+ */
+pc_req_table_t *pc_req_table_new(uint32_t capacity,
+                                 pc_req_table_release release_req);
+
+/**
+ * Clear and release the table.
+ *
+ * @param table table instance.
+ */
+void pc_req_table_destroy(pc_req_table_t *table);
+
+/**
+ * Put a request into table, the table grows if it is half full.
+ *
+ * @param  table table instance.
+ * @param  id    request id.
+ * @param  req   request.
+ * @return       0 for ok or -1 for error.
+ */
+int pc_req_table_set(pc_req_table_t *table, uint32_t id,
+                     struct pc_request_s *req);
+
+/**
+ * Get the request of id.
+ *
+ * @param  table table instance.
+ * @param  id    request id.
+ * @return       request or NULL if not found.
+ */
+struct pc_request_s *pc_req_table_get(pc_req_table_t *table, uint32_t id);
+
+/**
+ * Remove the request of id from table.
+ *
+ * @param  table table instance.
+ * @param  id    request id.
+ * @return       request removed or NULL if not found.
+ */
+struct pc_request_s *pc_req_table_del(pc_req_table_t *table, uint32_t id);
+
+/**
+ * Remove all the requests from table and fire the release callback for each
+ * of them.
+ *
+ * @param table table instance.
+ */
+void pc_req_table_clear(pc_req_table_t *table);
+
+#endif /* PC_REQ_TABLE_H */
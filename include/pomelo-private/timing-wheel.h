@@ -0,0 +1,66 @@
+#ifndef PC_TIMING_WHEEL_H
+#define PC_TIMING_WHEEL_H
+
+#include <stdint.h>
+#include "pomelo-private/ngx-queue.h"
+
+/**
+ * Hashed timing wheel to keep a large number of deadlines with one timer.
+ * Nodes are hashed into the slots by the tick of their deadline, and a slot
+ * may hold nodes of later rounds which are kept until their deadline.
+ */
+
+#define PC_WHEEL_SLOTS 256
+#define PC_WHEEL_TICK_MS 50
+
+typedef struct {
+  ngx_queue_t queue;
+  /*! Deadline in loop time of milliseconds, 0 if not in wheel. */
+  uint64_t deadline;
+} pc_wheel_node_t;
+
+typedef struct {
+  ngx_queue_t slots[PC_WHEEL_SLOTS];
+  /*! Last tick expired. */
+  uint64_t tick;
+  /*! Number of nodes in wheel. */
+  uint32_t count;
+} pc_timing_wheel_t;
+
+/**
+ * Initiate an empty wheel.
+ *
+ * @param wheel wheel instance.
+ * @param now   current loop time in milliseconds.
+ */
+void pc_wheel_init(pc_timing_wheel_t *wheel, uint64_t now);
+
+/**
+ * Add a node to wheel.
+ *
+ * @param wheel    wheel instance.
+ * @param node     node which is not in wheel.
+ * @param deadline deadline in loop time of milliseconds.
+ */
+void pc_wheel_add(pc_timing_wheel_t *wheel, pc_wheel_node_t *node,
+                  uint64_t deadline);
+
+/**
+ * Remove a node from wheel, nothing to do if the node is not in wheel.
+ *
+ * @param wheel wheel instance.
+ * @param node  node to remove.
+ */
+void pc_wheel_remove(pc_timing_wheel_t *wheel, pc_wheel_node_t *node);
+
+/**
+ * Advance the wheel to now and move the expired nodes out.
+ *
+ * @param wheel   wheel instance.
+ * @param now     current loop time in milliseconds.
+ * @param expired queue to collect the expired nodes.
+ */
+void pc_wheel_expire(pc_timing_wheel_t *wheel, uint64_t now,
+                     ngx_queue_t *expired);
+
+#endif /* PC_TIMING_WHEEL_H */
@@ -9,6 +9,45 @@
  * socket.
  */
 
+#define PC_WRITE_BATCH_FRAMES 64
+#define PC_WRITE_BATCH_BYTES (64 * 1024)
+
+/*! Receive buffer allocated first and kept by an idle connection. */
+#define PC_READ_BUF_MIN 2048
+/*! Reads in a row using less than a quarter before a larger buffer halved. */
+#define PC_READ_SHRINK_READS 8
+
+/**
+ * Callback for an outgoing frame has been written or failed.
+ *
+ * @param transport transport the frame written to.
+ * @param data      data attached to the frame.
+ * @param status    0 for ok or -1 for error.
+ */
+typedef void (*pc_frame_cb)(pc_transport_t *transport, void *data, int status);
+
+/**
+ * Outgoing frame queued in transport.
+ */
+typedef struct {
+  ngx_queue_t queue;
+  char *base;
+  size_t len;
+  /*! Capacity of base, the size to release it with. */
+  size_t size;
+  pc_frame_cb cb;
+  void *data;
+} pc__frame_t;
+
+/**
+ * A vectored write of frames in flight.
+ */
+typedef struct {
+  uv_write_t req;
+  pc_transport_t *transport;
+  ngx_queue_t frames;
+} pc__write_batch_t;
+
 /**
  * Create a new transport instance.
  *
@@ -32,6 +71,51 @@ void pc_transport_destroy(pc_transport_t *transport);
  */
 int pc_transport_start(pc_transport_t *transport);
 
+/**
+ * Queue a frame to write, the frames queued in the same loop iteration would
+ * be sent by one vectored write. Must be invoked in the loop thread.
+ *
+ * Once the batch limit is reached the frames are flushed before return, so
+ * the callbacks of this frame and the ones queued before may run inside
+ * this call, even for 0 returned.
+ *
+ * @param  transport transport instance.
+ * @param  base      frame data, released by transport once queued. The
+ *                   caller keeps it for -1 returned.
+ * @param  len       length of frame.
+ * @param  size      capacity of base, released with it as size.
+ * @param  cb        callback for frame written or failed.
+ * @param  data      data attached to the frame.
+ * @return           0 for ok or -1 for error.
+ */
+int pc_transport_write(pc_transport_t *transport, char *base, size_t len,
+                       size_t size, pc_frame_cb cb, void *data);
+
+/**
+ * Write out all the pending frames of transport.
+ *
+ * @param transport transport instance.
+ */
+void pc_transport_flush(pc_transport_t *transport);
+
+/**
+ * Callback for the flush check of client, run after each poll.
+ *
+ * @param handle flush check handle.
+ * @param status 0 or -1
+ */
+void pc__flush_check_cb(uv_check_t *handle, int status);
+
+/**
+ * Allocate buffer callback for uv_read_start, which hands out the receive
+ * buffer of transport.
+ *
+ * @param  handle         socket of transport.
+ * @param  suggested_size max size of the buffer.
+ * @return                receive buffer.
+ */
+uv_buf_t pc_tp_alloc_buffer(uv_handle_t *handle, size_t suggested_size);
+
 /**
  * Tcp packet arrived callback.
  *
@@ -0,0 +1,155 @@
+#ifndef _PB_SCHEMA_H_
+#define _PB_SCHEMA_H_
+
+/* pb-schema.h: compiled protobuf definitions for pomelo c client library.
+ *
+ * The json definitions from handshake are compiled once into flat field
+ * tables, so that encode and decode never walk the json definitions.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "jansson.h"
+#include "pomelo-private/map.h"
+#include "pomelo-private/ngx-queue.h"
+
+/* Field options. */
+typedef enum {
+  PB_required = 1,
+  PB_optional = 2,
+  PB_repeated = 3
+} pb_option_t;
+
+/* Tags up to this value are indexed by a dense array, or binary search. */
+#define PC_PB_DENSE_TAGS 256
+
+typedef struct pc_pb_field_s pc_pb_field_t;
+typedef struct pc_pb_message_s pc_pb_message_t;
+typedef struct pc_pb_schema_s pc_pb_schema_t;
+typedef struct pc_pb_cache_s pc_pb_cache_t;
+
+struct pc_pb_field_s {
+  char *name;
+  size_t name_len;
+  uint32_t tag;
+  /*! pb_option_t, 0 for unknown option which is ignored. */
+  uint8_t option;
+  /*! pb_wire_type_t of the value, 0 for message. */
+  uint8_t type;
+  /*! Repeated numbers encoded in one length delimited field. */
+  uint8_t packed;
+  /*! Encoded field key (tag << 3 | wire type) as varint. */
+  uint8_t key_len;
+  uint8_t key[5];
+  /*! Type name of message, kept for resolving. */
+  char *type_name;
+  /*! Resolved message type, NULL if not message or not found. */
+  const pc_pb_message_t *message;
+};
+
+struct pc_pb_message_s {
+  char *name;
+  /*! Fields sorted by tag. */
+  pc_pb_field_t *fields;
+  size_t nfields;
+  /*! Fields indexed by tag, NULL if the tags are too sparse. */
+  pc_pb_field_t **tags;
+  uint32_t max_tag;
+  /*! Open addressing table of fields by name. */
+  pc_pb_field_t **names;
+  size_t names_mask;
+  /*! Messages defined in __messages of this message. */
+  pc_pb_message_t **nested;
+  size_t nnested;
+  pc_pb_message_t *parent;
+  ngx_queue_t queue;
+};
+
+struct pc_pb_schema_s {
+  /*! All the messages compiled, released with schema. */
+  ngx_queue_t messages;
+  /*! Route to message. */
+  pc_map_t *routes;
+  /*! Messages defined as "message name" in top level. */
+  pc_map_t *globals;
+};
+
+/**
+ * Compile protobuf definitions of server or client.
+ *
+ * @param  protos json definitions as sent by server in handshake.
+ * @return        compiled schema or NULL for error.
+ */
+pc_pb_schema_t *pc_pb_schema_new(const json_t *protos);
+
+/**
+ * Release the schema and all its messages.
+ *
+ * @param schema schema instance.
+ */
+void pc_pb_schema_destroy(pc_pb_schema_t *schema);
+
+/**
+ * Compile one more message definition against the schema, its message
+ * types are resolved in the schema. The message is released with schema.
+ *
+ * @param  schema schema instance.
+ * @param  def    json definition of message.
+ * @return        compiled message or NULL for error.
+ */
+const pc_pb_message_t *pc_pb_schema_add(pc_pb_schema_t *schema,
+                                        const json_t *def);
+
+/**
+ * Get the compiled message of a json definition for pc_pb_encode and
+ * pc_pb_decode. The definitions of gprotos are compiled once and kept until
+ * called with another gprotos, the json definitions are referenced while
+ * cached and should not be modified.
+ *
+ * @param  gprotos json definitions of all the messages.
+ * @param  protos  json definition of the message.
+ * @param  cache   set to the cache to release after use of the message.
+ * @return         compiled message or NULL for error.
+ */
+const pc_pb_message_t *pc_pb_cache_get(const json_t *gprotos,
+                                       const json_t *protos,
+                                       pc_pb_cache_t **cache);
+
+/**
+ * Release the cache got with a message, the message is not used after.
+ *
+ * @param cache cache from pc_pb_cache_get.
+ */
+void pc_pb_cache_release(pc_pb_cache_t *cache);
+
+/**
+ * Get the message definition of route.
+ *
+ * @param  schema schema instance, may be NULL.
+ * @param  route  route string.
+ * @return        compiled message or NULL if route not use protobuf.
+ */
+const pc_pb_message_t *pc_pb_schema_get(const pc_pb_schema_t *schema,
+                                        const char *route);
+
+/**
+ * Find the field by tag.
+ *
+ * @param  message message definition.
+ * @param  tag     field tag.
+ * @return         field or NULL if not found.
+ */
+const pc_pb_field_t *pc_pb_field_by_tag(const pc_pb_message_t *message,
+                                        uint32_t tag);
+
+/**
+ * Find the field by name.
+ *
+ * @param  message message definition.
+ * @param  name    field name.
+ * @return         field or NULL if not found.
+ */
+const pc_pb_field_t *pc_pb_field_by_name(const pc_pb_message_t *message,
+                                         const char *name);
+
+#endif
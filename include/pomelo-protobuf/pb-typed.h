@@ -0,0 +1,77 @@
+#ifndef _PB_TYPED_H_
+#define _PB_TYPED_H_
+
+/* pb-typed.h: runtime of the C structs generated by tools/pc_protoc.py.
+ *
+ * The generated code encodes and decodes the structs with the same wire
+ * format as pb-encode.c and pb-decode.c, without any json_t in between.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* String field. Decoded strings point into the message buffer and are only
+ * valid in the callback which receives the message. */
+typedef struct {
+  const char *data;
+  size_t len;
+} pc_pb_str_t;
+
+/* Codec of a generated message, passed to the typed api of client. */
+typedef struct pc_typed_codec_s {
+  /*! Name of the message definition. */
+  const char *name;
+  /*! Size of the generated struct. */
+  size_t struct_size;
+  /*! Exact encoded size of the struct. */
+  size_t (*size)(const void *msg);
+  /*! Encode the struct into buf, 0 for ok or -1 for error. */
+  int (*encode)(const void *msg, uint8_t *buf, size_t len);
+  /*! Decode buf into a zeroed struct, 0 for ok or -1 for error. */
+  int (*decode)(void *msg, const uint8_t *buf, size_t len);
+  /*! Release the memory held by a decoded struct, not the struct itself. */
+  void (*release)(void *msg);
+} pc_typed_codec_t;
+
+typedef struct {
+  const uint8_t *p;
+  const uint8_t *end;
+} pc_pb_reader_t;
+
+size_t pc_pb_varint_size(uint64_t value);
+uint8_t *pc_pb_put_varint(uint8_t *p, uint64_t value);
+uint8_t *pc_pb_put_float(uint8_t *p, float value);
+uint8_t *pc_pb_put_double(uint8_t *p, double value);
+uint8_t *pc_pb_put_bytes(uint8_t *p, const char *data, size_t len);
+
+int pc_pb_get_varint(pc_pb_reader_t *r, uint64_t *value);
+int pc_pb_get_float(pc_pb_reader_t *r, float *value);
+int pc_pb_get_double(pc_pb_reader_t *r, double *value);
+/* Length delimited string or message, the view points into the reader. */
+int pc_pb_get_bytes(pc_pb_reader_t *r, const uint8_t **data, size_t *len);
+
+/**
+ * Make room for n more items of a decoded array. The capacity is not stored
+ * but always the next power of two of count.
+ *
+ * @param  items pointer to the array pointer.
+ * @param  count items in array.
+ * @param  n     items to add.
+ * @param  size  size of item.
+ * @return       0 or -1
+ */
+int pc_pb_reserve(void **items, size_t count, size_t n, size_t size);
+
+/**
+ * Release a decoded array grown by pc_pb_reserve.
+ *
+ * @param items array or NULL.
+ * @param count items in array.
+ * @param size  size of item.
+ */
+void pc_pb_release(void *items, size_t count, size_t size);
+
+#define PC_PB_ZIGZAG(v) ((v) < 0 ? ~((uint64_t)(v) << 1) : (uint64_t)(v) << 1)
+#define PC_PB_UNZIGZAG(v) ((v) & 1 ? (int64_t)~((v) >> 1) : (int64_t)((v) >> 1))
+
+#endif
@@ -9,17 +9,71 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "jansson.h"
+#include "pomelo-protobuf/pb-schema.h"
 
 /*
- * protobuf encode
+ * protobuf encode, the json definitions are compiled once and cached for
+ * gprotos, which should not be modified while in use
  */
 int pc_pb_encode(uint8_t *buf, size_t len, size_t *written,
                  const json_t *gprotos, const json_t *protos, json_t *msg);
 
 /*
- * protobuf decode
+ * protobuf decode, the json definitions are compiled once and cached for
+ * gprotos, which should not be modified while in use
  */
 int pc_pb_decode(uint8_t *buf, size_t len, const json_t *gprotos,
                  const json_t *protos, json_t *result);
 
+/*
+ * Sizes of sub messages recorded by the sizing pass in encode order, so that
+ * the encode pass writes each length prefix without sizing again.
+ */
+#define PC_PB_INLINE_SIZES 16
+
+typedef struct {
+    size_t *items;
+    size_t len;
+    size_t cap;
+    /* next size to be used by the encode pass */
+    size_t next;
+    size_t inline_items[PC_PB_INLINE_SIZES];
+} pc_pb_sizes_t;
+
+void pc_pb_sizes_init(pc_pb_sizes_t *sizes);
+void pc_pb_sizes_close(pc_pb_sizes_t *sizes);
+
+/*
+ * protobuf sizing pass, gives the exact encoded size of msg
+ */
+int pc_pb_message_size(const pc_pb_message_t *proto, json_t *msg,
+                       pc_pb_sizes_t *sizes, size_t *size);
+
+/*
+ * protobuf encode pass after pc_pb_message_size with the same sizes,
+ * writes exactly size bytes into buf
+ */
+int pc_pb_encode_sized(uint8_t *buf, size_t size, const pc_pb_message_t *proto,
+                       json_t *msg, pc_pb_sizes_t *sizes);
+
+/*
+ * protobuf encode with compiled message definition
+ */
+int pc_pb_encode_message(uint8_t *buf, size_t len, size_t *written,
+                         const pc_pb_message_t *proto, json_t *msg);
+
+/*
+ * protobuf decode with compiled message definition
+ */
+int pc_pb_decode_message(uint8_t *buf, size_t len,
+                         const pc_pb_message_t *proto, json_t *result);
+
+/*
+ * protobuf decode with compiled message definition, every byte read through
+ * the callback of the input stream the way of any stream other than buffer,
+ * for the benchmark of the buffer fast path
+ */
+int pc_pb_decode_message_stream(uint8_t *buf, size_t len,
+                                const pc_pb_message_t *proto, json_t *result);
+
 #endif
\ No newline at end of file
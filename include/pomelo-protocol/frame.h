@@ -0,0 +1,105 @@
+#ifndef PC_FRAME_H
+#define PC_FRAME_H
+
+#include "pomelo.h"
+#include "pomelo-protocol/message.h"
+
+/**
+ * Frame builder composes an outgoing Pomelo data package in one buffer.
+ *
+ * +--------------+-----------------+----------------+
+ * | package head | flag, id, route |      body      |
+ * +--------------+-----------------+----------------+
+ * |<---------- headroom ---------->|
+ *
+ * The headroom is reserved when the frame begins, so the body serializer
+ * writes straight into the buffer and the package head is filled in when the
+ * frame finishes, without copying the body.
+ */
+
+#define PC_FRAME_BODY_HINT 256
+
+typedef struct {
+  /*! Buffer of the whole package. */
+  char *base;
+  /*! Capacity of buffer. */
+  size_t size;
+  /*! Bytes used, including the headroom. */
+  size_t len;
+  /*! Bytes of the package head and message prefix. */
+  size_t head;
+} pc_frame_builder_t;
+
+/**
+ * Begin a request or notify frame and write the message prefix.
+ *
+ * @param  fb         frame builder.
+ * @param  id         message id, positive for request and 0 for notify.
+ * @param  type       message type, PC_MSG_REQUEST or PC_MSG_NOTIFY.
+ * @param  route      route string, used when route_code is 0.
+ * @param  route_len  length of route string.
+ * @param  route_code route code compressed by dictionary or 0.
+ * @param  body_hint  estimated size of body.
+ * @return            0 for ok or -1 for error.
+ */
+int pc_frame_begin(pc_frame_builder_t *fb, uint32_t id, pc_msg_type type,
+                   const char *route, size_t route_len, int route_code,
+                   size_t body_hint);
+
+/**
+ * Make room for more body bytes.
+ *
+ * @param  fb  frame builder.
+ * @param  len bytes to append.
+ * @return     pointer to write the bytes or NULL for error.
+ */
+char *pc_frame_reserve(pc_frame_builder_t *fb, size_t len);
+
+/**
+ * Append bytes to body.
+ *
+ * @param  fb   frame builder.
+ * @param  data data to append.
+ * @param  len  length of data.
+ * @return      0 for ok or -1 for error.
+ */
+int pc_frame_append(pc_frame_builder_t *fb, const char *data, size_t len);
+
+/**
+ * Fill the package head and take the frame out of builder.
+ *
+ * @param  fb   frame builder.
+ * @param  size output of the capacity of buf.base.
+ * @return      the whole package, buf.len = -1 for error. buf.base should be
+ *              released by pc__free() outside with *size as size.
+ */
+pc_buf_t pc_frame_finish(pc_frame_builder_t *fb, size_t *size);
+
+/**
+ * Release the frame which has not been finished.
+ *
+ * @param fb frame builder.
+ */
+void pc_frame_abort(pc_frame_builder_t *fb);
+
+/**
+ * Encode message body with json into frame.
+ *
+ * @param  fb  frame builder.
+ * @param  msg message body.
+ * @return     0 for ok or -1 for error.
+ */
+int pc__json_encode_frame(pc_frame_builder_t *fb, const json_t *msg);
+
+/**
+ * Encode message body with protobuf into frame.
+ *
+ * @param  fb      frame builder.
+ * @param  msg     message body.
+ * @param  pb_def  compiled protobuf definition for the message.
+ * @return         0 for ok or -1 for error.
+ */
+int pc__pb_encode_frame(pc_frame_builder_t *fb, const json_t *msg,
+                        const pc_pb_message_t *pb_def);
+
+#endif /* PC_FRAME_H */
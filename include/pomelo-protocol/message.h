@@ -15,6 +15,8 @@
 
 #define PC_MSG_ROUTE_CODE_BYTES 2
 
+#define PC_MSG_ROUTE_CODE_MAX 0xffff
+
 #define PC_MSG_HAS_ID(TYPE) ((TYPE) == PC_MSG_REQUEST ||                      \
                              (TYPE) == PC_MSG_RESPONSE)
 
@@ -31,8 +33,6 @@
   }                                                                           \
 }while(0);
 
-#define PC_PB_EVAL_FACTOR 2
-
 /**
  * Types of message.
  */
@@ -59,6 +59,8 @@ typedef struct {
     uint16_t route_code;
     const char *route_str;
   } route;
+  /*! Length of route string. */
+  size_t route_len;
   /*! Message body in bytes. */
   pc_buf_t body;
 } pc__msg_raw_t;
@@ -87,6 +89,33 @@ pc_buf_t pc_msg_encode_route(uint32_t id, pc_msg_type type,
 pc_buf_t pc_msg_encode_code(uint32_t id, pc_msg_type type,
                             int route_code, pc_buf_t msg);
 
+/**
+ * Get the length of message prefix which is composed of flag, id and route.
+ *
+ * @param  id         message id. positive for request and 0 for notify.
+ * @param  type       message type, PC_MSG_REQUEST or PC_MSG_NOTIFY.
+ * @param  route_len  length of route string, used when route_code is 0.
+ * @param  route_code route code compressed by dictionary or 0.
+ * @return            length of message prefix in bytes.
+ */
+size_t pc__msg_prefix_length(uint32_t id, pc_msg_type type,
+                             size_t route_len, int route_code);
+
+/**
+ * Encode message prefix into the buffer which must have enough room, see
+ * pc__msg_prefix_length.
+ *
+ * @param  id         message id. positive for request and 0 for notify.
+ * @param  type       message type, PC_MSG_REQUEST or PC_MSG_NOTIFY.
+ * @param  route      route string, used when route_code is 0.
+ * @param  route_len  length of route string.
+ * @param  route_code route code compressed by dictionary or 0.
+ * @param  base       buffer to write.
+ * @return            bytes written.
+ */
+size_t pc__msg_encode_prefix(uint32_t id, pc_msg_type type, const char *route,
+                             size_t route_len, int route_code, char *base);
+
 /**
  * Decode message header but not uncompress route and body.
  *
@@ -96,6 +125,19 @@ pc_buf_t pc_msg_encode_code(uint32_t id, pc_msg_type type,
  */
 pc__msg_raw_t *pc_msg_decode(const char *data, size_t len);
 
+/**
+ * Decode message header into a raw message structure provided by caller.
+ * The route string and body are views into data without copy, so they are
+ * valid as long as data and the route string is NOT null terminated, see
+ * route_len. The structure must not be passed to pc__raw_msg_destroy.
+ *
+ * @param  data message data in bytes.
+ * @param  len  length of message data.
+ * @param  msg  raw message structure to fill.
+ * @return      0 for ok or -1 for error.
+ */
+int pc_msg_decode_raw(const char *data, size_t len, pc__msg_raw_t *msg);
+
 /**
  * Destroy raw message structure and release inner resources.
  *
@@ -135,10 +177,10 @@ json_t *pc__json_decode(const char *data, size_t offset, size_t len);
  * be released by free().
  *
  * @param  msg    json message to be encoded
- * @param  pb_def protobuf definition for the message
+ * @param  pb_def compiled protobuf definition for the message
  * @return        encode result and buf.len = -1 for error. buf.base should be released by free() outside.
  */
-pc_buf_t pc__pb_encode(const json_t *msg, const json_t *gprotos, const json_t *pb_def);
+pc_buf_t pc__pb_encode(const json_t *msg, const pc_pb_message_t *pb_def);
 
 /**
  * Do protobuf decode for the binary data. The return json_t object could be
@@ -147,10 +189,10 @@ pc_buf_t pc__pb_encode(const json_t *msg, const json_t *gprotos, const json_t *p
  * @param data    binary data to decode
  * @param offset  offset of the data
  * @param len     lenght of the data
- * @param pb_def  protobuf definition for the data
+ * @param pb_def  compiled protobuf definition for the data
  * @return        decode result or NULL for error. Result should be released by json_decref() outside.
  */
 json_t *pc__pb_decode(const char *data, size_t offset, size_t len,
-                      const json_t *gprotos, const json_t *pb_def);
+                      const pc_pb_message_t *pb_def);
 
 #endif /* PC_MESSAGE_H */
\ No newline at end of file
@@ -19,6 +19,11 @@ extern "C" {
 #include "uv.h"
 #include "jansson.h"
 #include "pomelo-private/map.h"
+#include "pomelo-private/mpsc-queue.h"
+#include "pomelo-private/req-table.h"
+#include "pomelo-private/timing-wheel.h"
+#include "pomelo-protobuf/pb-schema.h"
+#include "pomelo-protobuf/pb-typed.h"
 #include "time.h"
 
 #define PC_TYPE "c"
@@ -29,12 +34,19 @@ extern "C" {
 #define PC_EVENT_KICK "onKick"
 #define PC_EVENT_RECONNECT "reconnect"
 
+/*! Request status for no response arrived before the deadline. */
+#define PC_REQ_TIMEOUT -2
+
 #define PC_PROTO_VERSION "protoVersion"
 #define PC_PROTO_CLIENT "clientProtos"
 #define PC_PROTO_SERVER "serverProtos"
 
+/*! Routes shorter than this are copied into the request itself. */
+#define PC_ROUTE_INLINE_BYTES 48
+
 typedef struct pc_client_s pc_client_t;
 typedef struct pc_listener_s pc_listener_t;
+typedef struct pc_listener_table_s pc_listener_table_t;
 typedef struct pc_req_s pc_req_t;
 typedef struct pc_connect_s pc_connect_t;
 typedef struct pc_tcp_req_s pc_tcp_req_t;
@@ -42,6 +54,11 @@ typedef struct pc_request_s pc_request_t;
 typedef struct pc_notify_s pc_notify_t;
 typedef struct pc_msg_s pc_msg_t;
 typedef struct pc_pkg_parser_s pc_pkg_parser_t;
+typedef struct pc_client_group_s pc_client_group_t;
+typedef struct pc_arena_s pc_arena_t;
+typedef struct pc_pool_s pc_pool_t;
+typedef struct pc_route_s pc_route_t;
+typedef struct pc_dict_route_s pc_dict_route_t;
 typedef uv_buf_t pc_buf_t;
 
 /**
@@ -95,6 +112,14 @@ typedef enum {
   PC_TP_ST_CLOSED
 } pc_transport_state;
 
+/**
+ * Policy to assign new clients to the loops of client group.
+ */
+typedef enum {
+  PC_GROUP_ROUND_ROBIN = 1,
+  PC_GROUP_LEAST_LOAD
+} pc_group_policy;
+
 /**
  * operation for proto files.
  */
@@ -104,6 +129,42 @@ typedef enum {
   PC_PROTO_OP_UNKONWN
 } pc_proto_op;
 
+/**
+ * Subsystem of an allocation, passed to the allocator.
+ */
+typedef enum {
+  PC_ALLOC_OTHER = 0,
+  PC_ALLOC_CLIENT,        /* client instance and its strings */
+  PC_ALLOC_HANDLE,        /* uv handles and uv requests */
+  PC_ALLOC_REQUEST,       /* request, notify, connect and route copies */
+  PC_ALLOC_TRANSPORT,     /* transport, frames and read buffers */
+  PC_ALLOC_PACKAGE,       /* encoded packages and package parser */
+  PC_ALLOC_MESSAGE,       /* decoded messages */
+  PC_ALLOC_MAP,           /* maps and request table */
+  PC_ALLOC_LISTENER,      /* listener tables */
+  PC_ALLOC_PROTOBUF,      /* protobuf schemas, buffers and typed arrays */
+  PC_ALLOC_JSON,          /* jansson */
+  PC_ALLOC_ARENA,         /* chunks of message arena */
+  PC_ALLOC_GROUP,         /* client group */
+  PC_ALLOC_TAGS
+} pc_alloc_tag;
+
+/**
+ * Memory allocator of libpomelo.
+ *
+ * The size passed to realloc_fn and free_fn is the size of the allocation,
+ * or 0 if it is not known at the call site, and the tag is always the one
+ * of the allocation. The functions may be called from any thread.
+ */
+typedef struct {
+  /*! Passed to the functions as is. */
+  void *ctx;
+  void *(*malloc_fn)(void *ctx, size_t size, pc_alloc_tag tag);
+  void *(*realloc_fn)(void *ctx, void *ptr, size_t old_size, size_t size,
+                      pc_alloc_tag tag);
+  void (*free_fn)(void *ctx, void *ptr, size_t size, pc_alloc_tag tag);
+} pc_allocator_t;
+
 /**
  * Callbacks
  */
@@ -129,11 +190,34 @@ typedef void (*pc_connect_cb)(pc_connect_t* req, int status);
  * Request callback.
  *
  * @param  req    request instance.
- * @param  status request status. 0 for ok and -1 for error.
+ * @param  status request status. 0 for ok, -1 for error and PC_REQ_TIMEOUT
+ *                for no response before the deadline.
  * @param  resp   response message from server, NULL for error.
  */
 typedef void (*pc_request_cb)(pc_request_t *req, int status, json_t *resp);
 
+/**
+ * Typed request callback.
+ *
+ * @param  req    request instance.
+ * @param  status request status, the same as pc_request_cb.
+ * @param  resp   response decoded into the struct of resp_codec, NULL for
+ *                error. It is released after the callback returns.
+ */
+typedef void (*pc_request_typed_cb)(pc_request_t *req, int status,
+                                    const void *resp);
+
+/**
+ * Raw request callback.
+ *
+ * @param  req    request instance.
+ * @param  status request status, the same as pc_request_cb.
+ * @param  resp   undecoded response, NULL for error. It is valid until the
+ *                callback returns, see pc_msg_body and pc_msg_json.
+ */
+typedef void (*pc_request_raw_cb)(pc_request_t *req, int status,
+                                  pc_msg_t *resp);
+
 /**
  * Notify callback.
  *
@@ -152,6 +236,28 @@ typedef void (*pc_notify_cb)(pc_notify_t *req, int status);
  */
 typedef int (*pc_handshake_cb)(pc_client_t *client, json_t *msg);
 
+/**
+ * Typed event callback for the messages pushed by server.
+ *
+ * @param  client client instance that fire the event.
+ * @param  event  event name that registered before.
+ * @param  msg    message decoded into the struct of listener codec. It is
+ *                released after the callback returns.
+ */
+typedef void (*pc_typed_event_cb)(pc_client_t *client, const char *event,
+                                  const void *msg);
+
+/**
+ * Raw event callback for the messages pushed by server.
+ *
+ * @param  client client instance that fire the event.
+ * @param  event  event name that registered before.
+ * @param  msg    undecoded message with route and id. It is valid until the
+ *                callback returns, see pc_msg_body and pc_msg_json.
+ */
+typedef void (*pc_raw_event_cb)(pc_client_t *client, const char *event,
+                                pc_msg_t *msg);
+
 /**
  * Message parse callback which would be fired when a new message arrived.
  *
@@ -198,6 +304,14 @@ typedef void (*pc_msg_encode_done_cb)(pc_client_t *client, pc_buf_t buf);
 
 typedef void (*pc_proto_cb)(pc_client_t *client, pc_proto_op op, const char* fileName, void *data);
 
+/**
+ * Callback executed in the loop thread of a client group.
+ *
+ * @param client client instance.
+ * @param data   attach data passed to pc_client_group_exec.
+ */
+typedef void (*pc_group_cb)(pc_client_t *client, void *data);
+
 /**
  * Simple structure for memory block.
  * The pc_buf_s is cheap and could be passed by value.
@@ -214,8 +328,28 @@ typedef struct {
   pc_client_t *client;
   uv_tcp_t *socket;
   pc_transport_state state;
+  /* private */
+  /*! Outgoing frames waiting for the flush in the end of loop iteration. */
+  ngx_queue_t frames;
+  int nframes;
+  size_t frame_bytes;
+  /*! Receive buffer reused by reads, sized by the observed read sizes. */
+  char *read_buf;
+  size_t read_buf_size;
+  int read_full;
+  /*! Consecutive reads using less than a quarter of the buffer. */
+  int read_small;
 } pc_transport_t;
 
+/**
+ * Node of the completion queue of client, see pc_client_poll_completions.
+ */
+typedef struct pc_completion_s {
+  pc_mpsc_node_t node;
+  int type;
+  int status;
+} pc_completion_t;
+
 #define PC_REQ_FIELDS                                                         \
   /* private */                                                               \
   pc_client_t *client;                                                        \
@@ -227,6 +361,28 @@ typedef struct {
   /* public */                                                                \
   const char *route;                                                          \
   json_t *msg;                                                                \
+  /* private */                                                               \
+  pc_mpsc_node_t write_node;                                                  \
+  /*! Generated codec and struct used instead of msg by the typed api. */     \
+  const pc_typed_codec_t *codec;                                              \
+  const void *typed_msg;                                                      \
+  /*! Encoded body used instead of msg by the bytes api. */                   \
+  pc_buf_t body;                                                              \
+  int has_body;                                                               \
+  /*! Body is freed by libpomelo once encoded. */                             \
+  int own_body;                                                               \
+  /*! Package encoded by the caller thread, base is NULL for none. */         \
+  pc_buf_t pkg;                                                               \
+  /*! Capacity of pkg.base, the size to release it with. */                   \
+  size_t pkg_size;                                                            \
+  /*! Queued for the polling thread once done, in completion queue mode. */   \
+  pc_completion_t completion;                                                 \
+  /*! Route handle the route belongs to, NULL for the copied routes. */       \
+  pc_route_t *route_handle;                                                   \
+  /*! Pool of client to put back, NULL for the heap ones. */                  \
+  pc_pool_t *pool;                                                            \
+  /*! Copy of the short routes, others are copied to heap. */                 \
+  char route_buf[PC_ROUTE_INLINE_BYTES];                                      \
 
 /**
  * The abstract base class of all async request in Pomelo client.
@@ -252,8 +408,18 @@ struct pc_client_s {
   /* private */
   uv_loop_t *uv_loop;
   pc_transport_t *transport;
-  pc_map_t *listeners;
-  pc_map_t *requests;
+  /*! Swapped on add and remove, dispatch reads it without lock. */
+  pc_listener_table_t *volatile listeners;
+  /*! Dispatches between loading the listener table and referencing it. */
+  volatile long listener_readers;
+  /*! Tables swapped out and not released yet, guarded by listener_mutex. */
+  pc_listener_table_t *retired_listeners;
+  pc_req_table_t *requests;
+  /*! Last request id, taken atomically since callers may encode requests. */
+  volatile long req_id;
+  /*! Deadlines of requests, created when the first timeout request sent. */
+  pc_timing_wheel_t *req_wheel;
+  uv_timer_t *req_timer;
   pc_pkg_parser_t *pkg_parser;
   int heartbeat;
   int timeout;
@@ -261,10 +427,16 @@ struct pc_client_s {
   pc_handshake_cb handshake_cb;
   pc_connect_t *conn_req;
   json_t *route_to_code;
-  json_t *code_to_route;
+  /*! Routes of dictionary indexed by code, the keys of route_to_code. */
+  pc_dict_route_t *code_to_route;
+  /*! Max route code of dictionary plus one. */
+  size_t code_to_route_count;
   json_t *server_protos;
   json_t *client_protos;
   json_t *proto_ver;
+  /*! Compiled from server_protos and client_protos. */
+  pc_pb_schema_t *server_schema;
+  pc_pb_schema_t *client_schema;
   const char *proto_read_dir;
   const char *proto_write_dir;
   pc_proto_cb proto_event_cb;
@@ -272,14 +444,73 @@ struct pc_client_s {
   pc_msg_parse_done_cb parse_msg_done;
   pc_msg_encode_cb encode_msg;
   pc_msg_encode_done_cb encode_msg_done;
+  /*! Chunk size of the arena for decoded messages, 0 for no arena. */
+  size_t msg_arena_size;
+  /*! Arena reset for the next message, only accessed in loop thread. */
+  pc_arena_t *msg_arena;
   uv_timer_t *heartbeat_timer;
   uv_timer_t *timeout_timer;
   uv_timer_t *handshake_timer;
   uv_async_t *close_async;
+  /*! Requests and notifies submitted from any thread, drained in loop. */
+  uv_async_t *write_async;
+  pc_mpsc_queue_t write_queue;
+  /*! Set by stop before write_async is closed, no push is taken after. */
+  volatile long write_closed;
+  /*! Senders between checking write_closed and waking up write_async. */
+  volatile long write_senders;
+  /*! Flush the outgoing frames after poll, idle keeps the poll from blocking. */
+  uv_check_t *flush_check;
+  uv_idle_t *flush_idle;
+  int write_batch_frames;
+  size_t write_batch_bytes;
+  /*! Free lists of the fixed size objects of requests. */
+  pc_pool_t *request_pool;
+  pc_pool_t *notify_pool;
+  pc_pool_t *frame_pool;
+  pc_pool_t *batch_pool;
+  /*! Route handles by route string, they live as long as the client. */
+  pc_map_t *routes;
+  uv_mutex_t route_mutex;
+  /*! Bumped whenever the dictionary or protos changed. */
+  unsigned int route_gen;
+  /*! Encode messages on the threads sending them, see
+   * pc_client_set_caller_encode. */
+  int caller_encode;
+  /*! Held for write while the dictionary or protos changing. */
+  uv_rwlock_t encode_rwlock;
+  /*! Packages of at least this size are decoded on the threadpool, 0 for
+   * none, see pc_client_set_decode_offload. */
+  size_t decode_min_size;
+  /*! Messages waiting for dispatch in arrival order, loop thread only. */
+  struct pc__decode_job_s *decode_head;
+  struct pc__decode_job_s *decode_tail;
+  /*! Decodes running on the threadpool. */
+  int decode_jobs;
+  /*! Bumped when the client stopped or reconnected, stale jobs are dropped. */
+  unsigned int decode_gen;
+  /*! Callbacks are queued for pc_client_poll_completions instead of fired
+   * in loop thread, see pc_client_set_completion_queue. */
+  int completion_mode;
+  pc_mpsc_queue_t completions;
+  /*! Completions pushed and not polled yet, the fd is signaled from 0. */
+  volatile long completions_pending;
+  /*! Eventfd, or the read and write ends of a pipe. */
+  int completion_fds[2];
   uv_mutex_t mutex;
   uv_cond_t cond;
+  /*! Serializes the updates of listener table. */
   uv_mutex_t listener_mutex;
   uv_thread_t worker;
+  int shared_loop;
+  /*! Driven by pc_client_poll in the thread of application, no worker. */
+  int poll_mode;
+  /*! Bounds the wait of pc_client_poll, poll mode only. */
+  uv_timer_t *poll_timer;
+  int closing_handles;
+  int destroy_pending;
+  struct pc__group_loop_s *group_loop;
+  ngx_queue_t group_queue;
 
   uv_mutex_t state_mutex;
   uv_timer_t reconnect_timer;
@@ -309,6 +540,32 @@ struct pc_connect_s {
   uv_tcp_t *socket;
 };
 
+/**
+ * Route of dictionary, interned by the route_to_code of client.
+ */
+struct pc_dict_route_s {
+  const char *route;
+  size_t len;
+};
+
+/**
+ * Route resolved by pc_route_resolve. The dictionary code and the protobuf
+ * definitions of route are cached, and looked up again only when the
+ * handshake changed them.
+ */
+struct pc_route_s {
+  /* public */
+  const char *route;
+  size_t len;
+  /* private */
+  pc_client_t *client;
+  /*! Route generation of client when the cache is filled, 0 for none. */
+  unsigned int gen;
+  int code;
+  const pc_pb_message_t *client_def;
+  const pc_pb_message_t *server_def;
+};
+
 /**
  * Pomelo request class is a subclass of pc_tcp_req_t.
  * Request is the async context for a Pomelo request to server.
@@ -319,6 +576,16 @@ struct pc_request_s {
   uint32_t id;
   pc_request_cb cb;
   ngx_queue_t queue;
+  /* private */
+  /*! Timeout in milliseconds, 0 for no timeout. */
+  int timeout;
+  pc_wheel_node_t timer;
+  pc_request_typed_cb typed_cb;
+  const pc_typed_codec_t *resp_codec;
+  /*! Response is passed undecoded to raw_cb if set. */
+  pc_request_raw_cb raw_cb;
+  /*! Callback of user while cb queues the completion. */
+  pc_request_cb user_cb;
 };
 
 /**
@@ -329,6 +596,9 @@ struct pc_notify_s {
   PC_REQ_FIELDS
   PC_TCP_REQ_FIELDS
   pc_notify_cb cb;
+  /* private */
+  /*! Callback of user while cb queues the completion. */
+  pc_notify_cb user_cb;
 };
 
 /**
@@ -338,6 +608,21 @@ struct pc_msg_s {
   uint32_t id;
   const char* route;
   json_t *msg;
+  /* private */
+  /*! Request taken out by the default parser for a response. */
+  pc_request_t *req;
+  /*! Body of message set by the default parser, a view into the package. */
+  pc_buf_t body;
+  /*! Arena holding the message and its json, NULL if allocated from heap. */
+  pc_arena_t *arena;
+  /*! Route is interned by the route dictionary, not owned by message. */
+  int route_interned;
+  /*! Set while the body is not decoded yet, see pc_msg_json. */
+  pc_client_t *lazy_client;
+  /*! Body is copied out of the package and owned by message. */
+  int own_body;
+  /*! Queued for the polling thread, in completion queue mode. */
+  pc_completion_t completion;
 };
 
 /**
@@ -347,6 +632,48 @@ struct pc_msg_s {
  */
 PC_EXTERN pc_client_t *pc_client_new();
 
+/**
+ * Create and initiate Pomelo client instance on a loop owned by the caller.
+ * Many clients could share one loop, and no worker thread would be created
+ * when connecting, the owner of the loop should drive it with uv_run().
+ *
+ * All the operations of the client except pc_request, pc_notify and
+ * pc_client_disconnect must be invoked in the thread running the loop, and
+ * the blocking pc_client_connect and pc_client_join are not supported.
+ * pc_client_destroy would return immediately and the client is released once
+ * all its handles have been closed by the loop.
+ *
+ * @param  loop uv loop shared by the clients.
+ * @return      Pomelo client instance or NULL for error.
+ */
+PC_EXTERN pc_client_t *pc_client_new_on_loop(uv_loop_t *loop);
+
+/**
+ * Create and initiate Pomelo client instance driven by pc_client_poll, for
+ * the single threaded applications such as the frame loop of a game. No
+ * worker thread would be created when connecting, all the network IO, the
+ * timers and the callbacks run inside pc_client_poll.
+ *
+ * All the operations of the client must be invoked in the thread polling,
+ * then the requests and the listeners need no locking or async wakeup. The
+ * blocking pc_client_connect polls by itself until connected, and
+ * pc_client_destroy polls until all the handles closed.
+ *
+ * @return Pomelo client instance
+ */
+PC_EXTERN pc_client_t *pc_client_new_polled();
+
+/**
+ * Run the loop of a client created by pc_client_new_polled once.
+ *
+ * @param  client     client instance.
+ * @param  timeout_ms 0 to return at once, otherwise wait for the events up
+ *                    to the milliseconds, or until any event if negative.
+ * @return            0 if nothing is left to do, non-zero if the client is
+ *                    still active, -1 for the client not polled.
+ */
+PC_EXTERN int pc_client_poll(pc_client_t *client, int timeout_ms);
+
 /**
  * Create and init Pomelo client instance with reconnect enable
  *
@@ -384,6 +711,117 @@ PC_EXTERN void pc_client_stop(pc_client_t *client);
  */
 PC_EXTERN void pc_client_destroy(pc_client_t *client);
 
+/**
+ * Set the thresholds of write coalescing. The frames produced in one loop
+ * iteration are sent by a single vectored write, and the pending frames are
+ * flushed at once when either threshold is reached.
+ *
+ * @param client     client instance.
+ * @param max_frames max frames in one write, 1 to disable coalescing.
+ * @param max_bytes  max pending bytes before flush.
+ */
+PC_EXTERN void pc_client_set_write_batch(pc_client_t *client, int max_frames,
+                                         size_t max_bytes);
+
+/**
+ * Decode the incoming messages into a bump arena per message. The pc_msg_t,
+ * the route and all the json nodes of a message are allocated from the
+ * arena, and released at once after the message has been dispatched.
+ *
+ * The json passed to the request and event callbacks is read only then: it
+ * must not be modified, json_incref-ed or json_decref-ed, use
+ * pc_msg_arena_retain to keep it after the callback. The json allocator is
+ * hooked from the first call, so it should be called before connecting.
+ *
+ * @param client     client instance.
+ * @param chunk_size chunk size of the arena, 0 to disable the arena.
+ */
+PC_EXTERN void pc_client_set_msg_arena(pc_client_t *client, size_t chunk_size);
+
+/**
+ * Encode the requests and notifies on the threads sending them, so that only
+ * the finished packages go to the loop thread. The encoding of many sending
+ * threads runs in parallel, and the json_t of message is not touched after
+ * the send function returns, it could be released right away then.
+ *
+ * The encode_msg of client, if set, must be thread safe in this mode.
+ *
+ * @param client client instance.
+ * @param enable 1 to encode on the sending threads, 0 on the loop thread.
+ */
+PC_EXTERN void pc_client_set_caller_encode(pc_client_t *client, int enable);
+
+/**
+ * Decode the large messages on the threadpool of libuv, so that the loop
+ * thread keeps sending heartbeats and writes meanwhile. Several large
+ * messages are decoded in parallel, the messages arrived behind them wait
+ * and all of them are dispatched in the order of arrival.
+ *
+ * Only the json of the default parser is decoded off loop, the typed and raw
+ * messages are still decoded by their callbacks. The messages waiting are
+ * not allocated from the msg arena.
+ *
+ * @param client   client instance.
+ * @param min_size packages of at least the size are decoded off loop, 0 to
+ *                 decode all of them on loop.
+ */
+PC_EXTERN void pc_client_set_decode_offload(pc_client_t *client,
+                                            size_t min_size);
+
+/**
+ * Queue the callbacks of requests, notifies, pushes and the events of client
+ * rather than fire them in the loop thread, they are fired later by
+ * pc_client_poll_completions in the thread of application, such as the frame
+ * loop of a game. The decoded messages are handed over as is, and the loop
+ * thread never waits for the application.
+ *
+ * Must be set before connecting, and only works with the default parser.
+ *
+ * @param  client client instance.
+ * @param  enable 1 to queue the callbacks, 0 to fire them in loop thread.
+ * @return        0 or -1
+ */
+PC_EXTERN int pc_client_set_completion_queue(pc_client_t *client, int enable);
+
+/**
+ * Fire the queued callbacks in the calling thread, in the order they
+ * completed. Only one thread may poll a client, and the client must not be
+ * destroyed in the callbacks. The callbacks not polled yet are fired when the
+ * client is destroyed.
+ *
+ * @param  client client instance.
+ * @param  max    max callbacks to fire, 0 for all the queued.
+ * @return        number of callbacks fired.
+ */
+PC_EXTERN int pc_client_poll_completions(pc_client_t *client, int max);
+
+/**
+ * Get the fd which is readable while completions are queued, for the
+ * application to wait on with select, poll or epoll. Do not read it, it is
+ * reset by pc_client_poll_completions.
+ *
+ * @param  client client instance.
+ * @return        fd or -1 if not in completion queue mode or not supported.
+ */
+PC_EXTERN int pc_client_completion_fd(pc_client_t *client);
+
+/**
+ * Keep the arena of the message being dispatched, so that its json stays
+ * valid after the callback. Only valid in the request and event callbacks.
+ *
+ * @return arena to release by pc_msg_arena_release, or NULL if the message
+ *         is not allocated from an arena.
+ */
+PC_EXTERN pc_arena_t *pc_msg_arena_retain();
+
+/**
+ * Release an arena retained by pc_msg_arena_retain, the json of the message
+ * must not be used any more.
+ *
+ * @param arena retained arena.
+ */
+PC_EXTERN void pc_msg_arena_release(pc_arena_t *arena);
+
 /**
  * Join and wait the worker child thread return. It is suitable for the
  * situation that the main thread has nothing to do after the connction
@@ -408,6 +846,16 @@ PC_EXTERN pc_request_t *pc_request_new();
  */
 PC_EXTERN void pc_request_destroy(pc_request_t *req);
 
+/**
+ * Create a request from the free list of client, which saves the malloc and
+ * free of steady request traffic. pc_request_destroy puts the request back
+ * to the free list, even after the client is destroyed.
+ *
+ * @param  client client instance.
+ * @return        request instance or NULL for error.
+ */
+PC_EXTERN pc_request_t *pc_client_request_new(pc_client_t *client);
+
 /**
  * Connect the client to the server which would create a worker child thread
  * and connect to the server.
@@ -482,6 +930,84 @@ PC_EXTERN void pc_connect_req_destroy(pc_connect_t *conn_req);
 PC_EXTERN int pc_request(pc_client_t *client, pc_request_t *req, const char *route,
                json_t *msg, pc_request_cb cb);
 
+/**
+ * Send request to server with a deadline. The request would be failed with
+ * status PC_REQ_TIMEOUT if no response arrived in timeout milliseconds after
+ * it has been sent, and a response arrived later would be discarded.
+ *
+ * @param  client  Pomelo client instance
+ * @param  req     initiated request instance
+ * @param  route   route string
+ * @param  msg     message object
+ * @param  timeout timeout in milliseconds, 0 for no timeout
+ * @param  cb      request callback
+ * @return         0 or -1
+ */
+PC_EXTERN int pc_request_with_timeout(pc_client_t *client, pc_request_t *req,
+                                      const char *route, json_t *msg,
+                                      int timeout, pc_request_cb cb);
+
+/**
+ * Send request and get the response undecoded. The response is decoded by
+ * the default message layer only if pc_msg_json is called in callback.
+ *
+ * @param  client  Pomelo client instance
+ * @param  req     initiated request instance
+ * @param  route   route string
+ * @param  msg     message object
+ * @param  timeout timeout in milliseconds, 0 for no timeout
+ * @param  cb      raw request callback
+ * @return         0 or -1
+ */
+PC_EXTERN int pc_request_raw(pc_client_t *client, pc_request_t *req,
+                             const char *route, json_t *msg, int timeout,
+                             pc_request_raw_cb cb);
+
+/**
+ * Send request with a body encoded by the application, which is sent as is
+ * without json_t, protobuf or the encode_msg of client. req->msg is NULL in
+ * callback.
+ *
+ * @param  client  Pomelo client instance
+ * @param  req     initiated request instance
+ * @param  route   route string
+ * @param  body    encoded body, must keep until the callback invoked unless
+ *                 owned by libpomelo.
+ * @param  own     1 to pass the body to libpomelo, which frees it with the
+ *                 allocator of pc_set_allocator (free by default) once sent.
+ *                 The body is still the caller's if -1 returned.
+ * @param  timeout timeout in milliseconds, 0 for no timeout
+ * @param  cb      request callback
+ * @return         0 or -1
+ */
+PC_EXTERN int pc_request_bytes(pc_client_t *client, pc_request_t *req,
+                               const char *route, pc_buf_t body, int own,
+                               int timeout, pc_request_cb cb);
+
+/**
+ * Send request with a struct generated by tools/pc_protoc.py, the response
+ * is decoded into the struct of resp_codec without any json_t. The struct
+ * and request object must keep until the callback invoked.
+ *
+ * The typed messages are always encoded and decoded by the default message
+ * layer, the encode_msg and parse_msg of client are not used for them.
+ *
+ * @param  client     Pomelo client instance
+ * @param  req        initiated request instance
+ * @param  route      route string
+ * @param  codec      codec of the struct to send
+ * @param  msg        struct to send
+ * @param  resp_codec codec of the response struct
+ * @param  timeout    timeout in milliseconds, 0 for no timeout
+ * @param  cb         typed request callback
+ * @return            0 or -1
+ */
+PC_EXTERN int pc_request_typed(pc_client_t *client, pc_request_t *req,
+                               const char *route, const pc_typed_codec_t *codec,
+                               const void *msg,
+                               const pc_typed_codec_t *resp_codec,
+                               int timeout, pc_request_typed_cb cb);
+
 /**
  * Create and initiate notify instance.
  *
@@ -496,6 +1022,14 @@ PC_EXTERN pc_notify_t *pc_notify_new();
  */
 PC_EXTERN void pc_notify_destroy(pc_notify_t *req);
 
+/**
+ * Create a notify from the free list of client, see pc_client_request_new.
+ *
+ * @param  client client instance.
+ * @return        notify instance or NULL for error.
+ */
+PC_EXTERN pc_notify_t *pc_client_notify_new(pc_client_t *client);
+
 /**
  * Send notify to server.
  * The message object and notify object must keep
@@ -512,7 +1046,76 @@ PC_EXTERN int pc_notify(pc_client_t *client, pc_notify_t *req, const char *route
               json_t *msg, pc_notify_cb cb);
 
 /**
- * Register a listener in the client.
+ * Send notify with a struct generated by tools/pc_protoc.py.
+ * The struct and notify object must keep until the pc_notify_cb invoked.
+ *
+ * @param  client Pomelo client instance
+ * @param  req    initiated notify instance
+ * @param  route  route string
+ * @param  codec  codec of the struct to send
+ * @param  msg    struct to send
+ * @param  cb     notify callback
+ * @return        0 or -1
+ */
+PC_EXTERN int pc_notify_typed(pc_client_t *client, pc_notify_t *req,
+                              const char *route, const pc_typed_codec_t *codec,
+                              const void *msg, pc_notify_cb cb);
+
+/**
+ * Send notify with a body encoded by the application, see pc_request_bytes.
+ */
+PC_EXTERN int pc_notify_bytes(pc_client_t *client, pc_notify_t *req,
+                              const char *route, pc_buf_t body, int own,
+                              pc_notify_cb cb);
+
+/**
+ * Get the handle of route, which could be passed to the *_route send
+ * functions instead of the route string. A send with handle copies nothing
+ * and looks up neither the route dictionary nor the protobuf definitions.
+ * The same handle is returned for the same route, and it is valid until the
+ * client destroyed.
+ *
+ * @param  client Pomelo client instance
+ * @param  route  route string
+ * @return        route handle or NULL for error.
+ */
+PC_EXTERN pc_route_t *pc_route_resolve(pc_client_t *client, const char *route);
+
+/**
+ * Send request with a route handle, see pc_request_with_timeout.
+ */
+PC_EXTERN int pc_request_route(pc_client_t *client, pc_request_t *req,
+                               pc_route_t *route, json_t *msg, int timeout,
+                               pc_request_cb cb);
+
+/**
+ * Send notify with a route handle, see pc_notify.
+ */
+PC_EXTERN int pc_notify_route(pc_client_t *client, pc_notify_t *req,
+                              pc_route_t *route, json_t *msg, pc_notify_cb cb);
+
+/**
+ * Send typed request with a route handle, see pc_request_typed.
+ */
+PC_EXTERN int pc_request_typed_route(pc_client_t *client, pc_request_t *req,
+                                     pc_route_t *route,
+                                     const pc_typed_codec_t *codec,
+                                     const void *msg,
+                                     const pc_typed_codec_t *resp_codec,
+                                     int timeout, pc_request_typed_cb cb);
+
+/**
+ * Send typed notify with a route handle, see pc_notify_typed.
+ */
+PC_EXTERN int pc_notify_typed_route(pc_client_t *client, pc_notify_t *req,
+                                    pc_route_t *route,
+                                    const pc_typed_codec_t *codec,
+                                    const void *msg, pc_notify_cb cb);
+
+/**
+ * Register a listener in the client. The listeners could be added and
+ * removed in any thread, even inside a listener, and take effect from the
+ * next event dispatched.
  *
  * @param  client   client instance.
  * @param  event    event name.
@@ -533,6 +1136,71 @@ PC_EXTERN int pc_add_listener(pc_client_t *client, const char *event,
 PC_EXTERN void pc_remove_listener(pc_client_t *client, const char *event,
                     pc_event_cb event_cb);
 
+/**
+ * Register a typed listener in the client. The messages pushed on the event
+ * are decoded into the struct of codec, and no json_t is created for them if
+ * the event has no untyped listener.
+ *
+ * @param  client   client instance.
+ * @param  event    event name, the route of push.
+ * @param  codec    codec of the struct generated by tools/pc_protoc.py.
+ * @param  event_cb typed event callback.
+ * @return          0 or -1.
+ */
+PC_EXTERN int pc_add_typed_listener(pc_client_t *client, const char *event,
+                                    const pc_typed_codec_t *codec,
+                                    pc_typed_event_cb event_cb);
+
+/**
+ * Remove a typed listener in the client.
+ *
+ * @param  client   client instance.
+ * @param  event    event name.
+ * @param  event_cb typed event callback.
+ */
+PC_EXTERN void pc_remove_typed_listener(pc_client_t *client, const char *event,
+                                        pc_typed_event_cb event_cb);
+
+/**
+ * Register a raw listener in the client. The messages pushed on the event
+ * are passed without decode, and no json_t is created for them if the event
+ * has no untyped listener or the listener calls no pc_msg_json.
+ *
+ * @param  client   client instance.
+ * @param  event    event name, the route of push.
+ * @param  event_cb raw event callback.
+ * @return          0 or -1.
+ */
+PC_EXTERN int pc_add_raw_listener(pc_client_t *client, const char *event,
+                                  pc_raw_event_cb event_cb);
+
+/**
+ * Remove a raw listener in the client.
+ *
+ * @param  client   client instance.
+ * @param  event    event name.
+ * @param  event_cb raw event callback.
+ */
+PC_EXTERN void pc_remove_raw_listener(pc_client_t *client, const char *event,
+                                      pc_raw_event_cb event_cb);
+
+/**
+ * Get the body of message, a view into the received package.
+ *
+ * @param  msg message of a raw callback.
+ * @return     body in bytes, len is 0 for empty body.
+ */
+PC_EXTERN pc_buf_t pc_msg_body(const pc_msg_t *msg);
+
+/**
+ * Decode the body of message with protobuf or json on first access. Only
+ * valid in the raw callback that gets the message.
+ *
+ * @param  msg message of a raw callback.
+ * @return     message object owned by msg, NULL for empty body or error.
+ */
+PC_EXTERN json_t *pc_msg_json(pc_msg_t *msg);
+
 /**
  * Emit a event from the client.
  *
@@ -542,6 +1210,24 @@ PC_EXTERN void pc_remove_listener(pc_client_t *client, const char *event,
  */
 PC_EXTERN void pc_emit_event(pc_client_t *client, const char *event, void *data);
 
+/**
+ * Set the allocator of all the memory allocated by libpomelo, including
+ * jansson unless pc_json_set_alloc_funcs is used. It must be called before
+ * any other function of libpomelo or jansson, since the memory allocated
+ * before would be released by the new allocator.
+ *
+ * @param allocator allocator to copy, NULL for malloc and free.
+ */
+PC_EXTERN void pc_set_allocator(const pc_allocator_t *allocator);
+
+/**
+ * Get the name of an allocation tag, for the statistics of allocator.
+ *
+ * @param  tag allocation tag.
+ * @return     tag name.
+ */
+PC_EXTERN const char *pc_alloc_tag_name(pc_alloc_tag tag);
+
 /**
  * jansson memory malloc, free self-defined function.
  *
@@ -569,6 +1255,82 @@ PC_EXTERN void pc_proto_init2(pc_client_t *client, pc_proto_cb proto_cb);
 
 PC_EXTERN void pc_proto_copy(pc_client_t *client, json_t *proto_ver, json_t *client_protos, json_t *server_protos);
 
+/**
+ * Create a client group which shards clients over a fixed pool of loops,
+ * each of them driven by its own thread.
+ *
+ * @param  loops  number of loops, 0 or negative for one loop per cpu.
+ * @param  policy policy to assign new clients to the loops.
+ * @return        client group instance or NULL for error.
+ */
+PC_EXTERN pc_client_group_t *pc_client_group_new(int loops, pc_group_policy policy);
+
+/**
+ * Shutdown a client group. All the clients in the group are destroyed and
+ * the loop threads are joined before return.
+ *
+ * @param group client group instance.
+ */
+PC_EXTERN void pc_client_group_destroy(pc_client_group_t *group);
+
+/**
+ * Create a new client on one of the loops of the group. The client works in
+ * shared loop mode, see pc_client_new_on_loop. Operations that must run in
+ * the loop thread should be done by pc_client_group_exec.
+ *
+ * Called in a loop thread of the group, such as in a callback of
+ * pc_client_group_exec or a listener, the client is created on that loop
+ * at once instead of the one picked by the policy.
+ *
+ * @param  group client group instance.
+ * @return       Pomelo client instance or NULL for error.
+ */
+PC_EXTERN pc_client_t *pc_client_group_add(pc_client_group_t *group);
+
+/**
+ * Run a callback in the loop thread of the client asynchronously.
+ *
+ * @param  client client created by pc_client_group_add.
+ * @param  cb     callback to run.
+ * @param  data   attach data passed to the callback.
+ * @return        0 or -1.
+ */
+PC_EXTERN int pc_client_group_exec(pc_client_t *client, pc_group_cb cb, void *data);
+
+/**
+ * Connect a client of group to server asynchronously, just like
+ * pc_client_connect3, the reconnect event would be emitted when connected.
+ *
+ * @param  client client created by pc_client_group_add.
+ * @param  addr   server address.
+ * @return        0 or -1.
+ */
+PC_EXTERN int pc_client_group_connect(pc_client_t *client, struct sockaddr_in *addr);
+
+/**
+ * Destroy a client of group asynchronously in its loop thread.
+ *
+ * @param client client created by pc_client_group_add.
+ */
+PC_EXTERN void pc_client_group_remove(pc_client_t *client);
+
+/**
+ * Get the number of loops of the group.
+ *
+ * @param  group client group instance.
+ * @return       number of loops.
+ */
+PC_EXTERN int pc_client_group_loops(pc_client_group_t *group);
+
+/**
+ * Get the number of clients assigned to a loop of the group.
+ *
+ * @param  group client group instance.
+ * @param  index index of the loop.
+ * @return       number of clients or -1 for invalid index.
+ */
+PC_EXTERN int pc_client_group_loop_clients(pc_client_group_t *group, int index);
+
 PC_EXTERN extern volatile time_t pc_last_update_time;
 
 
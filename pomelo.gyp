@@ -62,34 +62,58 @@
       ],
       'sources': [
         'include/pomelo-private/common.h',
+        'include/pomelo-private/completion.h',
+        'include/pomelo-private/group.h',
         'include/pomelo-private/internal.h',
         'include/pomelo-private/listener.h',
         'include/pomelo-private/map.h',
+        'include/pomelo-private/mpsc-queue.h',
+        'include/pomelo-private/pool.h',
+        'include/pomelo-private/alloc.h',
+        'include/pomelo-private/arena.h',
+        'include/pomelo-private/atomic.h',
         'include/pomelo-private/ngx-queue.h',
+        'include/pomelo-private/req-table.h',
+        'include/pomelo-private/timing-wheel.h',
         'include/pomelo-private/transport.h',
         'include/pomelo-private/jansson-memory.h',
+        'include/pomelo-protobuf/pb-schema.h',
+        'include/pomelo-protobuf/pb-typed.h',
         'include/pomelo-protobuf/pb-util.h',
         'include/pomelo-protobuf/pb.h',
+        'include/pomelo-protocol/frame.h',
         'include/pomelo-protocol/message.h',
         'include/pomelo-protocol/package.h',
         'include/pomelo.h',
+        'src/alloc.c',
+        'src/arena.c',
         'src/client.c',
+        'src/completion.c',
         'src/common.c',
+        'src/frame.c',
+        'src/group.c',
         'src/listener.c',
         'src/map.c',
         'src/message.c',
         'src/msg-json.c',
         'src/msg-pb.c',
+        'src/mpsc-queue.c',
         'src/network.c',
         'src/package.c',
         'src/pb-decode.c',
         'src/pb-encode.c',
+        'src/pb-schema.c',
+        'src/pb-typed.c',
         'src/pb-util.c',
         'src/pkg-handshake.c',
         'src/pkg-heartbeat.c',
+        'src/pool.c',
+        'src/route.c',
         'src/transport.c',
         'src/protocol.c',
+        'src/req-table.c',
         'src/thread.c',
+        'src/timing-wheel.c',
         'src/jansson-memory.c',
       ],
       'conditions': [
@@ -205,7 +229,24 @@
               'test/protobuf/test_protobuf.c',
               'src/pb-decode.c',
               'src/pb-encode.c',
-              'src/pb-util.c'
+              'src/pb-util.c',
+              'src/pb-schema.c',
+              'src/map.c'
+            ],
+          },
+          {
+            'target_name': 'test_pb_bytes',
+            'type': 'executable',
+            'dependencies': [
+              'libpomelo',
+            ],
+            'include_dirs': [
+              'include/',
+              './deps/uv/include',
+              './deps/jansson/src',
+            ],
+            'sources': [
+              'test/protobuf/test_bytes.c',
             ],
           },
           {
@@ -222,6 +263,7 @@
             'sources': [
               'test/robot/robot_chat.c',
               'src/client.c',
+              'src/completion.c',
               'src/network.c',
               'src/pkg-handshake.c'
             ],
@@ -229,6 +271,35 @@
              '-ggdb',
            ]
           },
+          {
+            'target_name': 'bench_write',
+            'type': 'executable',
+            'dependencies': [
+              'libpomelo',
+            ],
+            'include_dirs': [
+              'include/',
+              './deps/uv/include',
+            ],
+            'sources': [
+              'test/bench/bench_write.c',
+            ],
+          },
+          {
+            'target_name': 'bench_pb_decode',
+            'type': 'executable',
+            'dependencies': [
+              'libpomelo',
+            ],
+            'include_dirs': [
+              'include/',
+              './deps/uv/include',
+              './deps/jansson/src',
+            ],
+            'sources': [
+              'test/bench/bench_pb_decode.c',
+            ],
+          },
         ]
       }
     ]   # TO == pc
@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <string.h>
+#include "pomelo.h"
+#include "pomelo-private/alloc.h"
+#include "pomelo-private/jansson-memory.h"
+
+static void *pc__default_malloc(void *ctx, size_t size, pc_alloc_tag tag) {
+  return malloc(size);
+}
+
+static void *pc__default_realloc(void *ctx, void *ptr, size_t old_size,
+                                 size_t size, pc_alloc_tag tag) {
+  return realloc(ptr, size);
+}
+
+static void pc__default_free(void *ctx, void *ptr, size_t size,
+                             pc_alloc_tag tag) {
+  free(ptr);
+}
+
+static pc_allocator_t pc__allocator = {
+  NULL,
+  pc__default_malloc,
+  pc__default_realloc,
+  pc__default_free
+};
+
+static const char *pc__alloc_tag_names[PC_ALLOC_TAGS] = {
+  "other",
+  "client",
+  "handle",
+  "request",
+  "transport",
+  "package",
+  "message",
+  "map",
+  "listener",
+  "protobuf",
+  "json",
+  "arena",
+  "group"
+};
+
+void pc_set_allocator(const pc_allocator_t *allocator) {
+  if(allocator == NULL) {
+    pc__allocator.ctx = NULL;
+    pc__allocator.malloc_fn = pc__default_malloc;
+    pc__allocator.realloc_fn = pc__default_realloc;
+    pc__allocator.free_fn = pc__default_free;
+    return;
+  }
+
+  pc__allocator = *allocator;
+  // jansson allocates by the allocator too
+  pc__jsonp_use_allocator();
+}
+
+const char *pc_alloc_tag_name(pc_alloc_tag tag) {
+  if(tag < 0 || tag >= PC_ALLOC_TAGS) {
+    return "unknown";
+  }
+
+  return pc__alloc_tag_names[tag];
+}
+
+void *pc__malloc(size_t size, pc_alloc_tag tag) {
+  return pc__allocator.malloc_fn(pc__allocator.ctx, size, tag);
+}
+
+void *pc__calloc(size_t count, size_t size, pc_alloc_tag tag) {
+  void *ptr;
+
+  if(size && count > (size_t)-1 / size) {
+    return NULL;
+  }
+
+  ptr = pc__allocator.malloc_fn(pc__allocator.ctx, count * size, tag);
+  if(ptr) {
+    memset(ptr, 0, count * size);
+  }
+
+  return ptr;
+}
+
+void *pc__realloc(void *ptr, size_t old_size, size_t size, pc_alloc_tag tag) {
+  if(ptr == NULL) {
+    return pc__allocator.malloc_fn(pc__allocator.ctx, size, tag);
+  }
+
+  return pc__allocator.realloc_fn(pc__allocator.ctx, ptr, old_size, size, tag);
+}
+
+void pc__free(void *ptr, size_t size, pc_alloc_tag tag) {
+  if(ptr == NULL) {
+    return;
+  }
+
+  pc__allocator.free_fn(pc__allocator.ctx, ptr, size, tag);
+}
+
+char *pc__strdup(const char *str, pc_alloc_tag tag) {
+  size_t len = strlen(str) + 1;
+  char *cpy = (char *)pc__malloc(len, tag);
+
+  if(cpy) {
+    memcpy(cpy, str, len);
+  }
+
+  return cpy;
+}
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "pomelo-private/arena.h"
+#include "pomelo-private/atomic.h"
+#include "pomelo-private/jansson-memory.h"
+#include "pomelo-private/alloc.h"
+
+#define PC_ARENA_ALIGN_UP(n)                                                  \
+  (((n) + PC_ARENA_ALIGN - 1) & ~(size_t)(PC_ARENA_ALIGN - 1))
+
+#define PC_ARENA_CHUNK_DATA(chunk)                                            \
+  ((char *)(chunk) + PC_ARENA_ALIGN_UP(sizeof(pc_arena_chunk_t)))
+
+#define PC_ARENA_CHUNK_FREE(chunk)                                            \
+  pc__free((chunk), (size_t)((chunk)->end - (char *)(chunk)), PC_ALLOC_ARENA)
+
+/* Arena serving the json allocations of this thread. */
+static PC_TLS pc_arena_t *pc__arena_tls = NULL;
+
+static pc_arena_chunk_t *pc__arena_chunk_new(size_t size) {
+  pc_arena_chunk_t *chunk;
+  size_t head = PC_ARENA_ALIGN_UP(sizeof(pc_arena_chunk_t));
+
+  chunk = (pc_arena_chunk_t *)pc__malloc(head + size, PC_ALLOC_ARENA);
+  if(chunk == NULL) {
+    return NULL;
+  }
+
+  chunk->next = NULL;
+  chunk->end = (char *)chunk + head + size;
+  return chunk;
+}
+
+pc_arena_t *pc_arena_new(size_t chunk_size) {
+  pc_arena_t *arena = (pc_arena_t *)pc__malloc(sizeof(pc_arena_t),
+                                                 PC_ALLOC_ARENA);
+  if(arena == NULL) {
+    fprintf(stderr, "Fail to malloc for pc_arena_t.\n");
+    return NULL;
+  }
+
+  memset(arena, 0, sizeof(pc_arena_t));
+  arena->refs = 1;
+  arena->chunk_size = PC_ARENA_ALIGN_UP(chunk_size ? chunk_size
+                                                   : PC_ARENA_CHUNK_SIZE);
+  return arena;
+}
+
+void *pc_arena_alloc(pc_arena_t *arena, size_t size) {
+  pc_arena_chunk_t *chunk;
+  char *ptr;
+
+  size = PC_ARENA_ALIGN_UP(size ? size : 1);
+
+  if(arena->chunks && (size_t)(arena->chunks->end - arena->pos) >= size) {
+    ptr = arena->pos;
+    arena->pos += size;
+    return ptr;
+  }
+
+  if(size > arena->chunk_size / 4) {
+    // a large block gets its own chunk, behind the one in use
+    chunk = pc__arena_chunk_new(size);
+    if(chunk == NULL) {
+      return NULL;
+    }
+    if(arena->chunks) {
+      chunk->next = arena->chunks->next;
+      arena->chunks->next = chunk;
+    } else {
+      chunk->next = NULL;
+      arena->chunks = chunk;
+      arena->pos = chunk->end;
+    }
+    return PC_ARENA_CHUNK_DATA(chunk);
+  }
+
+  chunk = pc__arena_chunk_new(arena->chunk_size);
+  if(chunk == NULL) {
+    return NULL;
+  }
+  chunk->next = arena->chunks;
+  arena->chunks = chunk;
+
+  ptr = PC_ARENA_CHUNK_DATA(chunk);
+  arena->pos = ptr + size;
+  return ptr;
+}
+
+int pc_arena_contains(const pc_arena_t *arena, const void *ptr) {
+  const pc_arena_chunk_t *chunk;
+  const char *p = (const char *)ptr;
+
+  for(chunk = arena->chunks; chunk; chunk = chunk->next) {
+    if(p >= PC_ARENA_CHUNK_DATA(chunk) && p < chunk->end) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void pc_arena_reset(pc_arena_t *arena) {
+  pc_arena_chunk_t *chunk, *next, *keep = NULL;
+
+  // keep one chunk of the normal size, so a steady stream of messages
+  // allocates nothing from heap
+  for(chunk = arena->chunks; chunk; chunk = next) {
+    next = chunk->next;
+    if(keep == NULL &&
+       (size_t)(chunk->end - PC_ARENA_CHUNK_DATA(chunk)) == arena->chunk_size) {
+      keep = chunk;
+      keep->next = NULL;
+    } else {
+      PC_ARENA_CHUNK_FREE(chunk);
+    }
+  }
+
+  arena->chunks = keep;
+  arena->pos = keep ? PC_ARENA_CHUNK_DATA(keep) : NULL;
+  arena->alloc = 0;
+}
+
+void pc_arena_destroy(pc_arena_t *arena) {
+  pc_arena_chunk_t *chunk, *next;
+
+  for(chunk = arena->chunks; chunk; chunk = next) {
+    next = chunk->next;
+    PC_ARENA_CHUNK_FREE(chunk);
+  }
+
+  pc__free(arena, sizeof(pc_arena_t), PC_ALLOC_ARENA);
+}
+
+static void *pc__arena_json_malloc(size_t size) {
+  pc_arena_t *arena = pc__arena_tls;
+
+  if(arena && arena->alloc) {
+    return pc_arena_alloc(arena, size);
+  }
+
+  return pc_jsonp_malloc(size);
+}
+
+static void pc__arena_json_free(void *ptr) {
+  pc_arena_t *arena = pc__arena_tls;
+
+  if(ptr == NULL || (arena && pc_arena_contains(arena, ptr))) {
+    return;
+  }
+
+  pc_jsonp_free(ptr);
+}
+
+void pc__arena_install_hooks() {
+  pc__jsonp_set_hooks(pc__arena_json_malloc, pc__arena_json_free);
+}
+
+void pc__arena_enter(pc_arena_t *arena) {
+  arena->alloc = 1;
+  pc__arena_tls = arena;
+}
+
+void pc__arena_stop_alloc() {
+  if(pc__arena_tls) {
+    pc__arena_tls->alloc = 0;
+  }
+}
+
+void pc__arena_leave() {
+  pc__arena_stop_alloc();
+  pc__arena_tls = NULL;
+}
+
+pc_arena_t *pc__arena_current() {
+  return pc__arena_tls;
+}
+
+long pc__arena_unref(pc_arena_t *arena) {
+  return pc__atomic_add_long(&arena->refs, -1);
+}
+
+pc_arena_t *pc_msg_arena_retain() {
+  pc_arena_t *arena = pc__arena_tls;
+
+  if(arena) {
+    pc__atomic_add_long(&arena->refs, 1);
+  }
+
+  return arena;
+}
+
+void pc_msg_arena_release(pc_arena_t *arena) {
+  if(arena && pc__arena_unref(arena) == 0) {
+    pc_arena_destroy(arena);
+  }
+}
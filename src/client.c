@@ -14,16 +14,27 @@
 #include "pomelo-private/internal.h"
 #include "pomelo-private/common.h"
 #include "pomelo-private/ngx-queue.h"
+#include "pomelo-private/group.h"
+#include "pomelo-private/arena.h"
+#include "pomelo-private/alloc.h"
+#include "pomelo-private/pool.h"
+#include "pomelo-private/completion.h"
+#include "pomelo-private/atomic.h"
 
 volatile time_t pc_last_update_time;
 
 static void pc__client_init(pc_client_t *client);
 static void pc__close_async_cb(uv_async_t *handle, int status);
-static void pc__release_listeners(pc_map_t *map, const char* key, void *value);
-static void pc__release_requests(pc_map_t *map, const char* key, void *value);
+static void pc__release_requests(pc_req_table_t *table, pc_request_t *req);
 static void pc__client_reconnect_reset(pc_client_t *client);
 static void pc__client_reconnect_timer_cb(uv_timer_t* timer, int status);
 static void pc__client_reconnect(pc_client_t *client);
+static void pc__client_run_worker(pc_client_t *client);
+static void pc__client_close_handle(pc_client_t *client, uv_handle_t *handle);
+static void pc__client_handle_close_cb(uv_handle_t *handle);
+static void pc__client_write_async_close_cb(uv_handle_t *handle);
+static void pc__client_free(pc_client_t *client);
+static void pc__listeners_release_retired(pc_client_t *client);
 
 static int pc_client_dns_resolve(const char* host, int port, struct sockaddr_in *addr) {
   struct addrinfo hints;
@@ -62,7 +73,8 @@ static int pc_client_dns_resolve(const char* host, int port, struct sockaddr_in
 }
 
 pc_client_t *pc_client_new() {
-  pc_client_t *client = (pc_client_t *)malloc(sizeof(pc_client_t));
+  pc_client_t *client = (pc_client_t *)pc__malloc(sizeof(pc_client_t),
+                                                  PC_ALLOC_CLIENT);
 
   if(!client) {
     fprintf(stderr, "Fail to malloc for pc_client_t.\n");
@@ -82,6 +94,46 @@ pc_client_t *pc_client_new() {
   return client;
 }
 
+pc_client_t *pc_client_new_on_loop(uv_loop_t *loop) {
+  if(loop == NULL) {
+    fprintf(stderr, "Invalid uv_loop_t for pc_client_new_on_loop.\n");
+    return NULL;
+  }
+
+  pc_client_t *client = (pc_client_t *)pc__malloc(sizeof(pc_client_t),
+                                                  PC_ALLOC_CLIENT);
+
+  if(!client) {
+    fprintf(stderr, "Fail to malloc for pc_client_t.\n");
+    abort();
+  }
+
+  memset(client, 0, sizeof(pc_client_t));
+
+  client->uv_loop = loop;
+  client->shared_loop = 1;
+
+  pc__client_init(client);
+
+  return client;
+}
+
+pc_client_t *pc_client_new_polled() {
+  pc_client_t *client = pc_client_new();
+
+  client->poll_mode = 1;
+  client->poll_timer = (uv_timer_t *)pc__malloc(sizeof(uv_timer_t),
+                                                PC_ALLOC_HANDLE);
+  if(client->poll_timer == NULL) {
+    fprintf(stderr, "Fail to malloc client->poll_timer.\n");
+    abort();
+  }
+  uv_timer_init(client->uv_loop, client->poll_timer);
+  client->poll_timer->data = client;
+
+  return client;
+}
+
 pc_client_t *pc_client_new_with_reconnect(int delay, int delay_max, int exp_backoff) {
   pc_client_t* client = pc_client_new();
   assert(client);
@@ -105,6 +157,7 @@ pc_client_t *pc_client_new_with_reconnect(int delay, int delay_max, int exp_back
   }
   /* uv_timer_init never fail */
   uv_timer_init(client->uv_loop, &client->reconnect_timer); 
+  client->reconnect_timer.data = client;
 
   return client;
 }
@@ -117,17 +170,27 @@ void pc_client_disconnect(pc_client_t* client){
   uv_mutex_lock(&client->state_mutex);
   client->state = PC_ST_DISCONNECTING;
   uv_mutex_unlock(&client->state_mutex);
+  if(client->poll_mode) {
+    // already in the loop thread
+    pc_client_stop(client);
+    return;
+  }
   uv_async_send(client->close_async);
 }
 
 void pc__client_init(pc_client_t *client) {
-  client->listeners = pc_map_new(256, pc__release_listeners);
+  client->listeners = pc_listener_table_new();
   if(client->listeners == NULL) {
     fprintf(stderr, "Fail to init client->listeners.\n");
     abort();
   }
 
-  client->requests = pc_map_new(256, pc__release_requests);
+  if(pc__routes_init(client)) {
+    fprintf(stderr, "Fail to init client->routes.\n");
+    abort();
+  }
+
+  client->requests = pc_req_table_new(256, pc__release_requests);
   if(client->requests == NULL) {
     fprintf(stderr, "Fail to init client->requests.\n");
     abort();
@@ -139,7 +202,8 @@ void pc__client_init(pc_client_t *client) {
     abort();
   }
 
-  client->heartbeat_timer = (uv_timer_t *)malloc(sizeof(uv_timer_t));
+  client->heartbeat_timer = (uv_timer_t *)pc__malloc(sizeof(uv_timer_t),
+                                                      PC_ALLOC_HANDLE);
   if(client->heartbeat_timer == NULL) {
     fprintf(stderr, "Fail to malloc client->heartbeat_timer.\n");
     abort();
@@ -152,7 +216,8 @@ void pc__client_init(pc_client_t *client) {
   client->heartbeat_timer->data = client;
   client->heartbeat = 0;
 
-  client->timeout_timer = (uv_timer_t *)malloc(sizeof(uv_timer_t));
+  client->timeout_timer = (uv_timer_t *)pc__malloc(sizeof(uv_timer_t),
+                                                   PC_ALLOC_HANDLE);
   if(client->timeout_timer == NULL) {
     fprintf(stderr, "Fail to malloc client->timeout_timer.\n");
     abort();
@@ -165,16 +230,65 @@ void pc__client_init(pc_client_t *client) {
   client->timeout_timer->data = client;
   client->timeout = 0;
 
-  client->handshake_timer = (uv_timer_t*)malloc(sizeof(uv_timer_t));
+  client->handshake_timer = (uv_timer_t *)pc__malloc(sizeof(uv_timer_t),
+                                                     PC_ALLOC_HANDLE);
   if(uv_timer_init(client->uv_loop, client->handshake_timer)) {
     fprintf(stderr, "Fail to init client->timeout_timer.\n");
     abort();
   }
   client->handshake_timer->data = client;
 
-  client->close_async = (uv_async_t *)malloc(sizeof(uv_async_t));
+  client->close_async = (uv_async_t *)pc__malloc(sizeof(uv_async_t),
+                                                 PC_ALLOC_HANDLE);
   uv_async_init(client->uv_loop, client->close_async, pc__close_async_cb);
   client->close_async->data = client;
+
+  pc_mpsc_queue_init(&client->write_queue);
+  client->write_async = (uv_async_t *)pc__malloc(sizeof(uv_async_t),
+                                                 PC_ALLOC_HANDLE);
+  if(client->write_async == NULL) {
+    fprintf(stderr, "Fail to malloc client->write_async.\n");
+    abort();
+  }
+  uv_async_init(client->uv_loop, client->write_async, pc__async_write_cb);
+  client->write_async->data = client;
+
+  client->flush_check = (uv_check_t *)pc__malloc(sizeof(uv_check_t),
+                                                 PC_ALLOC_HANDLE);
+  client->flush_idle = (uv_idle_t *)pc__malloc(sizeof(uv_idle_t),
+                                               PC_ALLOC_HANDLE);
+  if(client->flush_check == NULL || client->flush_idle == NULL) {
+    fprintf(stderr, "Fail to malloc client flush handles.\n");
+    abort();
+  }
+  uv_check_init(client->uv_loop, client->flush_check);
+  client->flush_check->data = client;
+  uv_idle_init(client->uv_loop, client->flush_idle);
+  client->flush_idle->data = client;
+  client->req_timer = (uv_timer_t *)pc__malloc(sizeof(uv_timer_t),
+                                               PC_ALLOC_HANDLE);
+  if(client->req_timer == NULL) {
+    fprintf(stderr, "Fail to malloc client->req_timer.\n");
+    abort();
+  }
+  uv_timer_init(client->uv_loop, client->req_timer);
+  client->req_timer->data = client;
+
+  client->write_batch_frames = PC_WRITE_BATCH_FRAMES;
+  client->write_batch_bytes = PC_WRITE_BATCH_BYTES;
+
+  client->request_pool = pc_pool_new(sizeof(pc_request_t), 0,
+                                     PC_ALLOC_REQUEST);
+  client->notify_pool = pc_pool_new(sizeof(pc_notify_t), 0, PC_ALLOC_REQUEST);
+  client->frame_pool = pc_pool_new(sizeof(pc__frame_t), 0,
+                                   PC_ALLOC_TRANSPORT);
+  client->batch_pool = pc_pool_new(sizeof(pc__write_batch_t), 0,
+                                   PC_ALLOC_TRANSPORT);
+  if(client->request_pool == NULL || client->notify_pool == NULL ||
+     client->frame_pool == NULL || client->batch_pool == NULL) {
+    fprintf(stderr, "Fail to init client pools.\n");
+    abort();
+  }
   uv_mutex_init(&client->mutex);
   uv_cond_init(&client->cond);
   uv_mutex_init(&client->listener_mutex);
@@ -208,17 +322,33 @@ pc_client_state pc_client_get_state(pc_client_t *client) {
 /**
  * Clear all inner resource of Pomelo client
  */
+static void pc__client_release_pool(pc_pool_t **pool) {
+  if(*pool) {
+    pc_pool_release(*pool);
+    *pool = NULL;
+  }
+}
+
 void pc__client_clear(pc_client_t *client) {
-  if(client->listeners) {
-    pc_map_destroy(client->listeners);
-    client->listeners = NULL;
+  if(client->msg_arena) {
+    pc_arena_destroy(client->msg_arena);
+    client->msg_arena = NULL;
   }
 
   if(client->requests) {
-    pc_map_destroy(client->requests);
+    pc_req_table_destroy(client->requests);
     client->requests = NULL;
   }
 
+  // the failures of requests above are queued too
+  pc__completion_close(client);
+
+  if(client->listeners) {
+    pc_listener_table_release(client->listeners);
+    client->listeners = NULL;
+  }
+  pc__listeners_release_retired(client);
+
   if(client->pkg_parser) {
     pc_pkg_parser_destroy(client->pkg_parser);
     client->pkg_parser = NULL;
@@ -229,14 +359,7 @@ void pc__client_clear(pc_client_t *client) {
     client->handshake_opts = NULL;
   }
 
-  if(client->route_to_code) {
-    json_decref(client->route_to_code);
-    client->route_to_code = NULL;
-  }
-  if(client->code_to_route) {
-    json_decref(client->code_to_route);
-    client->code_to_route = NULL;
-  }
+  pc__routes_clear_dict(client);
   if(client->server_protos) {
     json_decref(client->server_protos);
     client->server_protos = NULL;
@@ -245,18 +368,33 @@ void pc__client_clear(pc_client_t *client) {
     json_decref(client->client_protos);
     client->client_protos = NULL;
   }
+  pc__client_compile_protos(client);
   if(client->proto_ver) {
     json_decref(client->proto_ver);
     client->proto_ver = NULL;
   }
   if(client->host) {
-    free(client->host);
+    pc__free(client->host, strlen(client->host) + 1, PC_ALLOC_CLIENT);
     client->host = NULL;
   }
+
+  if(client->req_wheel) {
+    pc__free(client->req_wheel, sizeof(pc_timing_wheel_t), PC_ALLOC_REQUEST);
+    client->req_wheel = NULL;
+  }
+
+  // requests of the pools may still be destroyed by user later
+  pc__client_release_pool(&client->request_pool);
+  pc__client_release_pool(&client->notify_pool);
+  pc__client_release_pool(&client->frame_pool);
+  pc__client_release_pool(&client->batch_pool);
+  pc__routes_clear(client);
 }
 
 void pc__client_reconnect_reset(pc_client_t *client) {
   assert(client);
+  pc__client_flush_writes(client, -1);
+
   if(client->transport) {
     pc_transport_destroy(client->transport);
     client->transport = NULL;
@@ -277,8 +415,10 @@ void pc__client_reconnect_reset(pc_client_t *client) {
   }
   
   if(client->requests) {
-    pc_map_clear(client->requests);
+    pc_req_table_clear(client->requests);
   }
+  // the messages of last connection still decoding are dropped
+  client->decode_gen++;
 
   if(client->pkg_parser) {
     pc_pkg_parser_reset(client->pkg_parser);
@@ -289,14 +429,7 @@ void pc__client_reconnect_reset(pc_client_t *client) {
     client->handshake_opts = NULL;
   }
 
-  if(client->route_to_code) {
-    json_decref(client->route_to_code);
-    client->route_to_code = NULL;
-  }
-  if(client->code_to_route) {
-    json_decref(client->code_to_route);
-    client->code_to_route = NULL;
-  }
+  pc__routes_clear_dict(client);
   if(client->server_protos) {
     json_decref(client->server_protos);
     client->server_protos = NULL;
@@ -305,6 +438,7 @@ void pc__client_reconnect_reset(pc_client_t *client) {
     json_decref(client->client_protos);
     client->client_protos = NULL;
   }
+  pc__client_compile_protos(client);
   uv_mutex_lock(&client->state_mutex);
   client->state = PC_ST_INITED;
   uv_mutex_unlock(&client->state_mutex);
@@ -326,7 +460,8 @@ void pc_client_stop(pc_client_t *client) {
     return;
   }
 
-  if(PC_ST_INITED == state) {
+  // nothing to release for a client which has never run its own loop
+  if(PC_ST_INITED == state && !client->shared_loop && !client->poll_mode) {
     client->state = PC_ST_CLOSED;
     return;
   }
@@ -339,32 +474,111 @@ void pc_client_stop(pc_client_t *client) {
   client->state = PC_ST_CLOSED;
   uv_mutex_unlock(&client->state_mutex);
 
+  // no more push to the write queue, and no wakeup of the handle closing
+  pc__atomic_add_long(&client->write_closed, 1);
+  while(pc__atomic_add_long(&client->write_senders, 0) != 0);
+
+  // fail the writes which have not been sent yet
+  pc__client_flush_writes(client, -1);
+  client->decode_gen++;
+
   if(client->transport) {
     pc_transport_destroy(client->transport);
     client->transport = NULL;
   }
 
   if(client->heartbeat_timer != NULL) {
-    uv_close((uv_handle_t *)client->heartbeat_timer, pc__handle_close_cb);
+    pc__client_close_handle(client, (uv_handle_t *)client->heartbeat_timer);
     client->heartbeat_timer = NULL;
     client->heartbeat = 0;
   }
   if(client->timeout_timer != NULL) {
-    uv_close((uv_handle_t *)client->timeout_timer, pc__handle_close_cb);
+    pc__client_close_handle(client, (uv_handle_t *)client->timeout_timer);
     client->timeout_timer = NULL;
     client->timeout = 0;
   }
   if(client->handshake_timer != NULL) {
-    uv_close((uv_handle_t*)client->handshake_timer, pc__handle_close_cb);
+    pc__client_close_handle(client, (uv_handle_t *)client->handshake_timer);
     client->handshake_timer = NULL;
   }
   if(client->close_async != NULL) {
-    uv_close((uv_handle_t *)client->close_async, pc__handle_close_cb);
+    pc__client_close_handle(client, (uv_handle_t *)client->close_async);
     client->close_async = NULL;
   }
+  if(client->write_async != NULL) {
+    client->closing_handles++;
+    uv_close((uv_handle_t *)client->write_async,
+             pc__client_write_async_close_cb);
+    client->write_async = NULL;
+  }
+  if(client->flush_check != NULL) {
+    pc__client_close_handle(client, (uv_handle_t *)client->flush_check);
+    client->flush_check = NULL;
+  }
+  if(client->flush_idle != NULL) {
+    pc__client_close_handle(client, (uv_handle_t *)client->flush_idle);
+    client->flush_idle = NULL;
+  }
+  if(client->req_timer != NULL) {
+    pc__client_close_handle(client, (uv_handle_t *)client->req_timer);
+    client->req_timer = NULL;
+  }
 
   if(client->enable_reconnect) {
-    uv_close((uv_handle_t*)&client->reconnect_timer, NULL);
+    pc__client_close_handle(client, (uv_handle_t *)&client->reconnect_timer);
+  }
+}
+
+/**
+ * Close a uv handle of the client and keep track of it until the close
+ * callback fired, the client must not be released before that.
+ */
+static void pc__client_close_handle(pc_client_t *client, uv_handle_t *handle) {
+  client->closing_handles++;
+  uv_close(handle, pc__client_handle_close_cb);
+}
+
+static void pc__client_handle_close_cb(uv_handle_t *handle) {
+  pc_client_t *client = (pc_client_t *)handle->data;
+  if(handle != (uv_handle_t *)&client->reconnect_timer) {
+    pc__free(handle, uv_handle_size(handle->type), PC_ALLOC_HANDLE);
+  }
+  pc__client_handle_closed(client);
+}
+
+static void pc__client_write_async_close_cb(uv_handle_t *handle) {
+  pc_client_t *client = (pc_client_t *)handle->data;
+
+  // nothing is pushed after stop, drain again in case
+  pc__client_flush_writes(client, -1);
+  pc__client_handle_close_cb(handle);
+}
+
+/**
+ * A client on its own loop is finished by the worker thread when the loop
+ * returns. A shared loop never returns for a single client, so the client is
+ * finished here once the last of its handles has been closed.
+ */
+void pc__client_handle_closed(pc_client_t *client) {
+  client->closing_handles--;
+  pc__client_check_closed(client);
+}
+
+void pc__client_check_closed(pc_client_t *client) {
+  if(!(client->shared_loop || client->poll_mode) ||
+     client->closing_handles > 0 || client->decode_jobs > 0) {
+    return;
+  }
+
+  if(PC_ST_CLOSED != pc_client_get_state(client)) {
+    return;
+  }
+
+  pc__emit_event(client, PC_EVENT_DISCONNECT, NULL);
+  pc__cond_broadcast(client);
+
+  if(client->destroy_pending) {
+    pc__client_free(client);
   }
 }
 
@@ -398,7 +612,7 @@ void pc__client_reconnected_cb(pc_connect_t* conn_req, int status) {
   uv_timer_stop(&client->reconnect_timer);
   if (status == 0) {
     client->reconnects = 0;
-    pc_emit_event(client, PC_EVENT_RECONNECT, client);
+    pc__emit_event(client, PC_EVENT_RECONNECT, client);
   } else {
     pc_client_stop(client);
   }
@@ -435,6 +649,10 @@ fail:
   pc_client_stop(client);
 }
 
+static void pc__client_poll_timer_close_cb(uv_handle_t *handle) {
+  pc__free(handle, sizeof(uv_timer_t), PC_ALLOC_HANDLE);
+}
+
 void pc_client_destroy(pc_client_t *client) {
   pc_client_state state;
 
@@ -442,6 +660,42 @@ void pc_client_destroy(pc_client_t *client) {
   state = client->state;
   uv_mutex_unlock(&client->state_mutex);
 
+  if(client->poll_mode) {
+    if(PC_ST_CLOSED != state) {
+      uv_mutex_lock(&client->state_mutex);
+      client->state = PC_ST_DISCONNECTING;
+      uv_mutex_unlock(&client->state_mutex);
+      pc_client_stop(client);
+    }
+    // not counted in closing handles, it is not the one of connection
+    uv_close((uv_handle_t *)client->poll_timer, pc__client_poll_timer_close_cb);
+    client->poll_timer = NULL;
+
+    // finish the closing handles and the decodes in flight
+    uv_run(client->uv_loop, UV_RUN_DEFAULT);
+    goto finally;
+  }
+
+  if(client->shared_loop) {
+    // the handles of the client live in the shared loop, release the client
+    // after all of them closed.
+    client->destroy_pending = 1;
+
+    if(PC_ST_CLOSED != state) {
+      uv_mutex_lock(&client->state_mutex);
+      client->state = PC_ST_DISCONNECTING;
+      uv_mutex_unlock(&client->state_mutex);
+      pc_client_stop(client);
+      return;
+    }
+
+    if(client->closing_handles > 0 || client->decode_jobs > 0) {
+      return;
+    }
+
+    goto finally;
+  }
+
   if(PC_ST_INITED == client->state) {
     goto finally;
   }
@@ -454,20 +708,102 @@ void pc_client_destroy(pc_client_t *client) {
   pc_client_join(client);
 
 finally:
+  pc__client_free(client);
+}
+
+static void pc__client_free(pc_client_t *client) {
+  pc__group_client_released(client);
   pc__client_clear(client);
 
   if(client->uv_loop) {
-    uv_loop_delete(client->uv_loop);
+    if(!client->shared_loop) {
+      uv_loop_delete(client->uv_loop);
+    }
     client->uv_loop = NULL;
   }
-  free(client);
+  pc__free(client, sizeof(pc_client_t), PC_ALLOC_CLIENT);
+}
+
+void pc_client_set_write_batch(pc_client_t *client, int max_frames,
+                               size_t max_bytes) {
+  if(max_frames <= 0 || max_bytes == 0) {
+    fprintf(stderr, "Invalid write batch, frames: %d, bytes: %lu.\n",
+            max_frames, (unsigned long)max_bytes);
+    return;
+  }
+
+  client->write_batch_frames = max_frames;
+  client->write_batch_bytes = max_bytes;
+}
+
+void pc_client_set_caller_encode(pc_client_t *client, int enable) {
+  client->caller_encode = enable ? 1 : 0;
+}
+
+void pc_client_set_decode_offload(pc_client_t *client, size_t min_size) {
+  client->decode_min_size = min_size;
+}
+
+void pc_client_set_msg_arena(pc_client_t *client, size_t chunk_size) {
+  if(chunk_size > 0) {
+    pc__arena_install_hooks();
+    // the same size as the chunks of arena
+    chunk_size = (chunk_size + PC_ARENA_ALIGN - 1) & ~(PC_ARENA_ALIGN - 1);
+  }
+
+  client->msg_arena_size = chunk_size;
+}
+
+pc_arena_t *pc__client_take_arena(pc_client_t *client) {
+  pc_arena_t *arena = client->msg_arena;
+
+  if(arena) {
+    client->msg_arena = NULL;
+    arena->refs = 1;
+    return arena;
+  }
+
+  return pc_arena_new(client->msg_arena_size);
+}
+
+void pc__client_put_arena(pc_client_t *client, pc_arena_t *arena) {
+  if(pc__arena_unref(arena) > 0) {
+    // retained by user, released by pc_msg_arena_release
+    return;
+  }
+
+  pc_arena_reset(arena);
+  if(client->msg_arena == NULL &&
+     arena->chunk_size == client->msg_arena_size) {
+    client->msg_arena = arena;
+  } else {
+    pc_arena_destroy(arena);
+  }
 }
 
 int pc_client_join(pc_client_t *client) {
+  if(client->shared_loop || client->poll_mode) {
+    fprintf(stderr, "No worker thread to join for client on shared loop or polled.\n");
+    return -1;
+  }
   return uv_thread_join(&client->worker);
 }
 
+static void pc__client_run_worker(pc_client_t *client) {
+  // the loop is driven by its owner
+  if(client->shared_loop || client->poll_mode) {
+    return;
+  }
+
+  uv_thread_create(&client->worker, pc__worker, client);
+}
+
 int pc_client_connect(pc_client_t *client, struct sockaddr_in *addr) {
+  if(client->shared_loop) {
+    fprintf(stderr, "Blocking connect is not supported on shared loop.\n");
+    return -1;
+  }
+
   pc_connect_t *conn_req = pc_connect_req_new(addr);
 
   if(client->enable_reconnect){
@@ -487,10 +823,18 @@ int pc_client_connect(pc_client_t *client, struct sockaddr_in *addr) {
   // 1. start work thread
   // 2. wait connect result
 
-  uv_thread_create(&client->worker, pc__worker, client);
+  if(client->poll_mode) {
+    // the handshake timer fails the connection if it takes too long
+    while(PC_ST_CONNECTING == client->state ||
+          PC_ST_CONNECTED == client->state) {
+      pc_client_poll(client, -1);
+    }
+  } else {
+    pc__client_run_worker(client);
 
-  // TODO should set a timeout?
-  pc__cond_wait(client, 0);
+    // TODO should set a timeout?
+    pc__cond_wait(client, 0);
+  }
 
   pc_connect_req_destroy(conn_req);
 
@@ -517,7 +861,7 @@ int pc_client_connect2(pc_client_t *client, pc_connect_t *conn_req, pc_connect_c
 	return -1;
   }
   
-  uv_thread_create(&client->worker, pc__worker, client);
+  pc__client_run_worker(client);
   return 0;
 }
 
@@ -528,7 +872,7 @@ static void pc__client_connect3_cb(pc_connect_t* req, int status) {
     return;
   }
 
-  pc_emit_event(req->client, PC_EVENT_RECONNECT, req->client);
+  pc__emit_event(req->client, PC_EVENT_RECONNECT, req->client);
   pc_connect_req_destroy(req);
 }
 
@@ -549,7 +893,7 @@ int pc_client_connect3(pc_client_t *client, struct sockaddr_in *addr) {
     goto error;
   }
 
-  uv_thread_create(&client->worker, pc__worker, client);
+  pc__client_run_worker(client);
 
   return 0;
 
@@ -570,12 +914,89 @@ int pc_client_connect4(pc_client_t* client, const char *host, int port) {
     return ret;
   }
 
-  client->host = strdup(host);
+  client->host = pc__strdup(host, PC_ALLOC_CLIENT);
   client->port = port;
 
   return pc_client_connect3(client, &addr);
 }
 
+/**
+ * Take a reference of the listener table published. The readers count only
+ * covers the load and the reference, never the callbacks.
+ */
+static pc_listener_table_t *pc__listeners_acquire(pc_client_t *client) {
+  pc_listener_table_t *table;
+
+  pc__atomic_add_long(&client->listener_readers, 1);
+  table = (pc_listener_table_t *)pc__atomic_load_ptr(&client->listeners);
+  pc__atomic_add_long(&table->refs, 1);
+  pc__atomic_add_long(&client->listener_readers, -1);
+
+  return table;
+}
+
+/**
+ * Drop the references of client to the tables swapped out, each one is
+ * destroyed by its last reader.
+ */
+static void pc__listeners_release_retired(pc_client_t *client) {
+  pc_listener_table_t *table;
+
+  while((table = client->retired_listeners) != NULL) {
+    client->retired_listeners = table->retired_next;
+    pc_listener_table_release(table);
+  }
+}
+
+/**
+ * Publish the listener table built by pc__update_listeners. The writers are
+ * serialized by the mutex and never wait for the readers.
+ */
+static void pc__listeners_publish(pc_client_t *client,
+                                  pc_listener_table_t *table) {
+  pc_listener_table_t *old;
+
+  old = (pc_listener_table_t *)pc__atomic_xchg_ptr(&client->listeners, table);
+  old->retired_next = client->retired_listeners;
+  client->retired_listeners = old;
+
+  // a reader may have loaded a table swapped out and not referenced it yet,
+  // the tables are kept until a publish finds no reader in between. Readers
+  // coming later only load the new table.
+  if(pc__atomic_add_long(&client->listener_readers, 0) == 0) {
+    pc__listeners_release_retired(client);
+  }
+}
+
+static int pc__update_listeners(pc_client_t *client, const char *event,
+                                const pc_listener_t *listener, int add) {
+  pc_listener_table_t *table;
+
+  uv_mutex_lock(&client->listener_mutex);
+  if(!add && !pc_listener_table_get(client->listeners, event)) {
+    uv_mutex_unlock(&client->listener_mutex);
+    return 0;
+  }
+
+  table = pc_listener_table_update(client->listeners, event, listener, add);
+  if(table) {
+    pc__listeners_publish(client, table);
+  }
+  uv_mutex_unlock(&client->listener_mutex);
+
+  if(table == NULL && add) {
+    fprintf(stderr, "Fail to update listeners of event: %s\n", event);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int pc__add_listener(pc_client_t *client, const char *event,
+                           pc_listener_t *listener) {
+  return pc__update_listeners(client, event, listener, 1);
+}
+
 int pc_add_listener(pc_client_t *client, const char *event,
                     pc_event_cb event_cb) {
   if(PC_ST_CLOSED == client->state) {
@@ -583,115 +1004,221 @@ int pc_add_listener(pc_client_t *client, const char *event,
     return -1;
   }
 
-  pc_listener_t *listener = pc_listener_new();
-  if(listener == NULL) {
-    fprintf(stderr, "Fail to create listener.\n");
+  pc_listener_t listener;
+  pc_listener_init(&listener);
+  listener.cb = event_cb;
+
+  return pc__add_listener(client, event, &listener);
+}
+
+int pc_add_typed_listener(pc_client_t *client, const char *event,
+                          const pc_typed_codec_t *codec,
+                          pc_typed_event_cb event_cb) {
+  if(PC_ST_CLOSED == client->state) {
+    fprintf(stderr, "Pomelo client has closed.\n");
     return -1;
   }
-  listener->cb = event_cb;
 
-  uv_mutex_lock(&client->listener_mutex);
-  ngx_queue_t *head = (ngx_queue_t *)pc_map_get(client->listeners, event);
-
-  if(head == NULL) {
-    head = (ngx_queue_t *)malloc(sizeof(ngx_queue_t));
-    if(head == NULL) {
-      fprintf(stderr, "Fail to create listener queue.\n");
-      pc_listener_destroy(listener);
-      uv_mutex_unlock(&client->listener_mutex);
-      return -1;
-    }
+  if(codec == NULL || event_cb == NULL) {
+    fprintf(stderr, "Invalid typed listener.\n");
+    return -1;
+  }
 
-    ngx_queue_init(head);
+  pc_listener_t listener;
+  pc_listener_init(&listener);
+  listener.codec = codec;
+  listener.typed_cb = event_cb;
 
-    pc_map_set(client->listeners, event, head);
+  return pc__add_listener(client, event, &listener);
+}
+
+int pc_add_raw_listener(pc_client_t *client, const char *event,
+                        pc_raw_event_cb event_cb) {
+  if(PC_ST_CLOSED == client->state) {
+    fprintf(stderr, "Pomelo client has closed.\n");
+    return -1;
   }
 
-  ngx_queue_insert_tail(head, &listener->queue);
-  uv_mutex_unlock(&client->listener_mutex);
+  if(event_cb == NULL) {
+    fprintf(stderr, "Invalid raw listener.\n");
+    return -1;
+  }
 
-  return 0;
+  pc_listener_t listener;
+  pc_listener_init(&listener);
+  listener.raw_cb = event_cb;
+
+  return pc__add_listener(client, event, &listener);
+}
+
+static void pc__remove_listener(pc_client_t *client, const char *event,
+                                pc_event_cb cb, pc_typed_event_cb typed_cb,
+                                pc_raw_event_cb raw_cb) {
+  pc_listener_t listener;
+
+  pc_listener_init(&listener);
+  listener.cb = cb;
+  listener.typed_cb = typed_cb;
+  listener.raw_cb = raw_cb;
+
+  pc__update_listeners(client, event, &listener, 0);
 }
 
 void pc_remove_listener(pc_client_t *client, const char *event, pc_event_cb cb) {
-  uv_mutex_lock(&client->listener_mutex);
-  ngx_queue_t *head = (ngx_queue_t *)pc_map_get(client->listeners, event);
-  if(head == NULL) {
-    uv_mutex_unlock(&client->listener_mutex);
+  pc__remove_listener(client, event, cb, NULL, NULL);
+}
+
+void pc_remove_typed_listener(pc_client_t *client, const char *event,
+                              pc_typed_event_cb event_cb) {
+  pc__remove_listener(client, event, NULL, event_cb, NULL);
+}
+
+void pc_remove_raw_listener(pc_client_t *client, const char *event,
+                            pc_raw_event_cb event_cb) {
+  pc__remove_listener(client, event, NULL, NULL, event_cb);
+}
+
+void pc_emit_event(pc_client_t *client, const char *event, void *data) {
+  // the listeners added or removed by the callbacks take effect next time
+  pc_listener_table_t *table = pc__listeners_acquire(client);
+  pc_listener_list_t *list = pc_listener_table_get(table, event);
+  size_t i;
+
+  for(i = 0; list && i < list->count; i++) {
+    if(list->items[i].cb) {
+      list->items[i].cb(client, event, data);
+    }
+  }
+
+  pc_listener_table_release(table);
+}
+
+void pc__emit_event(pc_client_t *client, const char *event, void *data) {
+  pc__completion_event_t *completion;
+
+  if(!client->completion_mode) {
+    pc_emit_event(client, event, data);
     return;
   }
 
-  ngx_queue_t *item = NULL;
-  pc_listener_t *listener = NULL;
+  completion = (pc__completion_event_t *)pc__malloc(
+      sizeof(pc__completion_event_t), PC_ALLOC_CLIENT);
+  if(completion == NULL) {
+    fprintf(stderr, "Fail to malloc for event completion: %s\n", event);
+    return;
+  }
+  completion->event = event;
+  completion->data = data;
+  pc__completion_push(client, &completion->completion,
+                      PC__COMPLETION_EVENT, 0);
+}
+
+static int pc__event_has_listener(pc_client_t *client, const char *event,
+                                  int json) {
+  pc_listener_table_t *table = pc__listeners_acquire(client);
+  pc_listener_list_t *list = pc_listener_table_get(table, event);
+  size_t i;
+  int has = 0;
 
-  ngx_queue_foreach(item, head) {
-    listener = ngx_queue_data(item, pc_listener_t, queue);
-    if(listener->cb == cb) {
-      ngx_queue_remove(item);
-      pc_listener_destroy(listener);
+  for(i = 0; list && i < list->count; i++) {
+    if(json ? list->items[i].cb != NULL : list->items[i].cb == NULL) {
+      has = 1;
       break;
     }
   }
 
-  if(ngx_queue_empty(head)) {
-    pc_map_del(client->listeners, event);
-    free(head);
-  }
-  uv_mutex_unlock(&client->listener_mutex);
+  pc_listener_table_release(table);
+  return has;
 }
 
-void pc_emit_event(pc_client_t *client, const char *event, void *data) {
-  uv_mutex_lock(&client->listener_mutex);
-  ngx_queue_t *head = (ngx_queue_t *)pc_map_get(client->listeners, event);
-  if(head == NULL) {
-    uv_mutex_unlock(&client->listener_mutex);
-    return;
-  }
+int pc__event_need_json(pc_client_t *client, const char *event) {
+  // typed and raw listeners decode the message by themselves
+  return pc__event_has_listener(client, event, 1);
+}
+
+int pc__event_need_body(pc_client_t *client, const char *event) {
+  return pc__event_has_listener(client, event, 0);
+}
+
+void pc__emit_msg_event(pc_client_t *client, pc_msg_t *msg) {
+  uint64_t stack[PC__TYPED_STACK_WORDS];
+  const char *event = msg->route;
+  const char *data = msg->body.base;
+  size_t len = msg->body.len;
+  void *obj;
+  pc_listener_table_t *table = pc__listeners_acquire(client);
+  pc_listener_list_t *list = pc_listener_table_get(table, event);
+  pc_listener_t *listener;
+  size_t i;
+
+  for(i = 0; list && i < list->count; i++) {
+    listener = &list->items[i];
+    if(listener->raw_cb) {
+      listener->raw_cb(client, event, msg);
+      continue;
+    }
+    if(listener->codec == NULL) {
+      continue;
+    }
 
-  ngx_queue_t *item = NULL;
-  pc_listener_t *listener = NULL;
+    obj = pc__typed_alloc(listener->codec, stack, sizeof(stack));
+    if(obj == NULL) {
+      fprintf(stderr, "Fail to malloc for typed message: %s\n", event);
+      continue;
+    }
 
-  ngx_queue_foreach(item, head) {
-    listener = ngx_queue_data(item, pc_listener_t, queue);
-    listener->cb(client, event, data);
+    if(listener->codec->decode(obj, (const uint8_t *)data, len)) {
+      fprintf(stderr, "Fail to decode typed message: %s\n", event);
+    } else {
+      listener->typed_cb(client, event, obj);
+      listener->codec->release(obj);
+    }
+
+    if(obj != stack) {
+      pc__free(obj, listener->codec->struct_size, PC_ALLOC_PROTOBUF);
+    }
   }
-  uv_mutex_unlock(&client->listener_mutex);
+
+  pc_listener_table_release(table);
 }
 
-int pc_run(pc_client_t *client) {
-  if(!client || !client->uv_loop) {
-    fprintf(stderr, "Invalid client to run.\n");
+static void pc__client_poll_timer_cb(uv_timer_t *timer, int status) {
+  // nothing to do, the poll returns after the timer fired
+}
+
+int pc_client_poll(pc_client_t *client, int timeout_ms) {
+  int ret;
+
+  if(!client->poll_mode) {
+    fprintf(stderr, "Fail to poll client not created by pc_client_new_polled.\n");
     return -1;
   }
-  return uv_run(client->uv_loop, UV_RUN_DEFAULT);
-};
 
-void pc__release_listeners(pc_map_t *map, const char* key, void *value) {
-  if(value == NULL) {
-    return;
+  if(timeout_ms == 0) {
+    return uv_run(client->uv_loop, UV_RUN_NOWAIT);
   }
 
-  ngx_queue_t *head = (ngx_queue_t *)value;
-  ngx_queue_t *q;
-  pc_listener_t *l;
-  while (!ngx_queue_empty(head)) {
-    q = ngx_queue_head(head);
-    ngx_queue_remove(q);
-    ngx_queue_init(q);
-
-    l = ngx_queue_data(q, pc_listener_t, queue);
-    pc_listener_destroy(l);
+  if(timeout_ms > 0) {
+    uv_timer_start(client->poll_timer, pc__client_poll_timer_cb, timeout_ms, 0);
+  }
+  ret = uv_run(client->uv_loop, UV_RUN_ONCE);
+  if(timeout_ms > 0) {
+    uv_timer_stop(client->poll_timer);
   }
 
-  free(head);
+  return ret;
 }
 
-void pc__release_requests(pc_map_t *map, const char* key, void *value) {
-  if(value == NULL) {
-    return;
+int pc_run(pc_client_t *client) {
+  if(!client || !client->uv_loop) {
+    fprintf(stderr, "Invalid client to run.\n");
+    return -1;
   }
+  return uv_run(client->uv_loop, UV_RUN_DEFAULT);
+};
 
-  pc_request_t *req = (pc_request_t *)value;
+void pc__release_requests(pc_req_table_t *table, pc_request_t *req) {
+  pc__request_timer_stop(req->client, req);
   req->cb(req, -1, NULL);
 }
 
@@ -725,4 +1252,30 @@ void pc_proto_copy(pc_client_t *client, json_t *proto_ver, json_t *client_protos
   client->proto_ver = proto_ver;
   client->client_protos = client_protos;
   client->server_protos = server_protos;
+  pc__client_compile_protos(client);
+}
+
+void pc__client_compile_protos(pc_client_t *client) {
+  // the schemas may be in use by the threads encoding on their own
+  uv_rwlock_wrlock(&client->encode_rwlock);
+  // the dictionary is always set before the protos compiled
+  pc__routes_invalidate(client);
+
+  if(client->server_schema) {
+    pc_pb_schema_destroy(client->server_schema);
+    client->server_schema = NULL;
+  }
+  if(client->client_schema) {
+    pc_pb_schema_destroy(client->client_schema);
+    client->client_schema = NULL;
+  }
+
+  // messages fall back to json if the definitions fail to compile
+  if(client->server_protos) {
+    client->server_schema = pc_pb_schema_new(client->server_protos);
+  }
+  if(client->client_protos) {
+    client->client_schema = pc_pb_schema_new(client->client_protos);
+  }
+  uv_rwlock_wrunlock(&client->encode_rwlock);
 }
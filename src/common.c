@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include "uv.h"
+#include "pomelo-private/alloc.h"
 
 void pc__handle_close_cb(uv_handle_t* handle) {
-  free(handle);
-}
\ No newline at end of file
+  pc__free(handle, uv_handle_size(handle->type), PC_ALLOC_HANDLE);
+}
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include "pomelo.h"
+#include "pomelo-protocol/message.h"
+#include "pomelo-private/internal.h"
+#include "pomelo-private/completion.h"
+#include "pomelo-private/atomic.h"
+#include "pomelo-private/alloc.h"
+
+#define PC__COMPLETION_OWNER(completion, type)                                \
+  ((type *)((char *)(completion) - offsetof(type, completion)))
+
+static int pc__completion_fds_open(int fds[2]) {
+#if defined(__linux__)
+  fds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  fds[1] = fds[0];
+  return fds[0] == -1 ? -1 : 0;
+#elif defined(_WIN32)
+  // no fd to wait on, the application polls every frame
+  fds[0] = fds[1] = -1;
+  return 0;
+#else
+  int i;
+
+  if(pipe(fds)) {
+    return -1;
+  }
+  for(i = 0; i < 2; i++) {
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+  }
+  return 0;
+#endif
+}
+
+static void pc__completion_fds_close(int fds[2]) {
+#ifndef _WIN32
+  if(fds[0] != -1) close(fds[0]);
+  if(fds[1] != -1 && fds[1] != fds[0]) close(fds[1]);
+#endif
+  fds[0] = fds[1] = -1;
+}
+
+static void pc__completion_signal(pc_client_t *client) {
+#if defined(__linux__)
+  uint64_t one = 1;
+  if(write(client->completion_fds[1], &one, sizeof(one)) < 0) {
+    // the counter is full and readable anyway
+  }
+#elif !defined(_WIN32)
+  char one = 1;
+  if(write(client->completion_fds[1], &one, 1) < 0) {
+    // the pipe is full and readable anyway
+  }
+#endif
+}
+
+static void pc__completion_reset(pc_client_t *client) {
+#if defined(__linux__)
+  uint64_t count;
+  if(read(client->completion_fds[0], &count, sizeof(count)) < 0) {
+    // not signaled
+  }
+#elif !defined(_WIN32)
+  char buf[64];
+  while(read(client->completion_fds[0], buf, sizeof(buf)) > 0);
+#endif
+}
+
+int pc__completion_open(pc_client_t *client) {
+  if(pc__completion_fds_open(client->completion_fds)) {
+    fprintf(stderr, "Fail to create fd for completion queue.\n");
+    client->completion_fds[0] = client->completion_fds[1] = -1;
+    return -1;
+  }
+
+  pc_mpsc_queue_init(&client->completions);
+  client->completions_pending = 0;
+  client->completion_mode = 1;
+  return 0;
+}
+
+void pc__completion_close(pc_client_t *client) {
+  if(!client->completion_mode) {
+    return;
+  }
+
+  // the callbacks would not be fired in any other way
+  pc_client_poll_completions(client, 0);
+  client->completion_mode = 0;
+  pc__completion_fds_close(client->completion_fds);
+}
+
+void pc__completion_push(pc_client_t *client, pc_completion_t *completion,
+                         int type, int status) {
+  completion->type = type;
+  completion->status = status;
+  pc_mpsc_queue_push(&client->completions, &completion->node);
+
+  // signal only for the first one, the rest are found by the same poll
+  if(pc__atomic_add_long(&client->completions_pending, 1) == 1) {
+    pc__completion_signal(client);
+  }
+}
+
+void pc__request_complete_cb(pc_request_t *req, int status, json_t *resp) {
+  pc__completion_push(req->client, &req->completion, PC__COMPLETION_REQUEST,
+                      status);
+}
+
+void pc__notify_complete_cb(pc_notify_t *req, int status) {
+  pc__completion_push(req->client, &req->completion, PC__COMPLETION_NOTIFY,
+                      status);
+}
+
+static void pc__completion_fire(pc_client_t *client,
+                                pc_completion_t *completion) {
+  pc_request_t *req;
+  pc_notify_t *notify;
+  pc_msg_t *msg;
+  pc__completion_event_t *event;
+
+  switch(completion->type) {
+    case PC__COMPLETION_REQUEST:
+      req = PC__COMPLETION_OWNER(completion, pc_request_t);
+      req->cb = req->user_cb;
+      req->cb(req, completion->status, NULL);
+    break;
+    case PC__COMPLETION_NOTIFY:
+      notify = PC__COMPLETION_OWNER(completion, pc_notify_t);
+      notify->cb = notify->user_cb;
+      notify->cb(notify, completion->status);
+    break;
+    case PC__COMPLETION_MSG:
+      msg = PC__COMPLETION_OWNER(completion, pc_msg_t);
+      pc__msg_deliver(client, msg);
+      pc_msg_destroy(msg);
+    break;
+    case PC__COMPLETION_EVENT:
+      event = (pc__completion_event_t *)completion;
+      pc_emit_event(client, event->event, event->data);
+      pc__free(event, sizeof(pc__completion_event_t), PC_ALLOC_CLIENT);
+    break;
+    default:
+      fprintf(stderr, "Unknown completion type: %d\n", completion->type);
+    break;
+  }
+}
+
+int pc_client_poll_completions(pc_client_t *client, int max) {
+  pc_mpsc_node_t *node;
+  int n = 0;
+
+  if(!client->completion_mode) {
+    return 0;
+  }
+
+  // reset before popping, so a push racing with the poll signals again
+  pc__completion_reset(client);
+
+  while((max <= 0 || n < max) &&
+        (node = pc_mpsc_queue_pop(&client->completions)) != NULL) {
+    n++;
+    pc__completion_fire(client, (pc_completion_t *)node);
+  }
+
+  // keep the fd readable for the completions left
+  if(pc__atomic_add_long(&client->completions_pending, -n) > 0) {
+    pc__completion_signal(client);
+  }
+
+  return n;
+}
+
+int pc_client_completion_fd(pc_client_t *client) {
+  return client->completion_mode ? client->completion_fds[0] : -1;
+}
+
+int pc_client_set_completion_queue(pc_client_t *client, int enable) {
+  if(PC_ST_INITED != client->state) {
+    fprintf(stderr, "Fail to set completion queue of client in state: %d\n",
+            client->state);
+    return -1;
+  }
+
+  if(enable && !client->completion_mode) {
+    return pc__completion_open(client);
+  }
+
+  if(!enable) {
+    pc__completion_close(client);
+  }
+
+  return 0;
+}
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "pomelo-protocol/package.h"
+#include "pomelo-protocol/frame.h"
+#include "pomelo-private/alloc.h"
+
+static int pc__frame_grow(pc_frame_builder_t *fb, size_t need);
+
+int pc_frame_begin(pc_frame_builder_t *fb, uint32_t id, pc_msg_type type,
+                   const char *route, size_t route_len, int route_code,
+                   size_t body_hint) {
+  size_t prefix_len = pc__msg_prefix_length(id, type, route_len, route_code);
+
+  memset(fb, 0, sizeof(pc_frame_builder_t));
+  fb->head = PC_PKG_HEAD_BYTES + prefix_len;
+  fb->size = fb->head + (body_hint ? body_hint : PC_FRAME_BODY_HINT);
+  fb->base = (char *)pc__malloc(fb->size, PC_ALLOC_PACKAGE);
+  if(fb->base == NULL) {
+    fprintf(stderr, "Fail to malloc for frame, size: %lu.\n",
+            (unsigned long)fb->size);
+    fb->size = 0;
+    return -1;
+  }
+
+  pc__msg_encode_prefix(id, type, route, route_len, route_code,
+                        fb->base + PC_PKG_HEAD_BYTES);
+  fb->len = fb->head;
+
+  return 0;
+}
+
+char *pc_frame_reserve(pc_frame_builder_t *fb, size_t len) {
+  if(fb->len + len > fb->size && pc__frame_grow(fb, fb->len + len)) {
+    return NULL;
+  }
+
+  return fb->base + fb->len;
+}
+
+int pc_frame_append(pc_frame_builder_t *fb, const char *data, size_t len) {
+  char *dest = pc_frame_reserve(fb, len);
+  if(dest == NULL) {
+    return -1;
+  }
+
+  memcpy(dest, data, len);
+  fb->len += len;
+
+  return 0;
+}
+
+pc_buf_t pc_frame_finish(pc_frame_builder_t *fb, size_t *size) {
+  pc_buf_t buf;
+  size_t body_len = fb->len - PC_PKG_HEAD_BYTES;
+
+  if(body_len >= PC_PKG_MAX_BODY_BYTES) {
+    fprintf(stderr, "Data is to large for Pomelo package. Body limit: %d.\n",
+            PC_PKG_MAX_BODY_BYTES);
+    pc_frame_abort(fb);
+    buf.base = NULL;
+    buf.len = -1;
+    return buf;
+  }
+
+  fb->base[0] = PC_PKG_DATA & PC_PKG_TYPE_MASK;
+  fb->base[1] = (body_len >> 16) & 0xff;
+  fb->base[2] = (body_len >> 8) & 0xff;
+  fb->base[3] = body_len & 0xff;
+
+  // the spare capacity is kept, the package is released with it as size
+  buf.base = fb->base;
+  buf.len = fb->len;
+  *size = fb->size;
+
+  fb->base = NULL;
+  fb->size = 0;
+  fb->len = 0;
+
+  return buf;
+}
+
+void pc_frame_abort(pc_frame_builder_t *fb) {
+  if(fb->base) {
+    pc__free(fb->base, fb->size, PC_ALLOC_PACKAGE);
+  }
+  memset(fb, 0, sizeof(pc_frame_builder_t));
+}
+
+static int pc__frame_grow(pc_frame_builder_t *fb, size_t need) {
+  size_t size = fb->size * 2;
+  char *base;
+
+  if(size < need) {
+    size = need;
+  }
+
+  base = (char *)pc__realloc(fb->base, fb->size, size, PC_ALLOC_PACKAGE);
+  if(base == NULL) {
+    fprintf(stderr, "Fail to realloc for frame, size: %lu.\n",
+            (unsigned long)size);
+    return -1;
+  }
+
+  fb->base = base;
+  fb->size = size;
+
+  return 0;
+}
@@ -0,0 +1,414 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "pomelo.h"
+#include "pomelo-private/group.h"
+#include "pomelo-private/ngx-queue.h"
+#include "pomelo-private/alloc.h"
+
+/**
+ * Client group shards the clients over a fixed number of loops, each of them
+ * driven by its own thread. The clients are created on the loops in shared
+ * loop mode, and all the operations which must be run in the loop thread are
+ * posted to the loop as tasks.
+ */
+
+static void pc__group_worker(void *arg);
+static void pc__group_async_cb(uv_async_t *handle, int status);
+static int pc__group_post(pc__group_loop_t *loop, pc__group_task_t *task);
+static pc__group_loop_t *pc__group_pick(pc_client_group_t *group);
+static pc__group_loop_t *pc__group_current(pc_client_group_t *group);
+static pc_client_t *pc__group_add_client(pc__group_loop_t *loop);
+static void pc__group_add_task(pc__group_task_t *task);
+static void pc__group_exec_task(pc__group_task_t *task);
+static void pc__group_connect_task(pc__group_task_t *task);
+static void pc__group_remove_task(pc__group_task_t *task);
+static void pc__group_shutdown_task(pc__group_task_t *task);
+
+pc_client_group_t *pc_client_group_new(int loops, pc_group_policy policy) {
+  pc_client_group_t *group = NULL;
+  int i;
+
+  if(loops <= 0) {
+    uv_cpu_info_t *cpus = NULL;
+    uv_err_t err = uv_cpu_info(&cpus, &loops);
+    if(err.code != UV_OK || loops <= 0) {
+      loops = 1;
+    } else {
+      uv_free_cpu_info(cpus, loops);
+    }
+  }
+
+  if(policy != PC_GROUP_ROUND_ROBIN && policy != PC_GROUP_LEAST_LOAD) {
+    fprintf(stderr, "Invalid client group policy: %d.\n", policy);
+    return NULL;
+  }
+
+  group = (pc_client_group_t *)pc__malloc(sizeof(pc_client_group_t),
+                                              PC_ALLOC_GROUP);
+  if(group == NULL) {
+    fprintf(stderr, "Fail to malloc for pc_client_group_t.\n");
+    return NULL;
+  }
+  memset(group, 0, sizeof(pc_client_group_t));
+
+  group->loops = (pc__group_loop_t *)pc__malloc(
+      sizeof(pc__group_loop_t) * loops, PC_ALLOC_GROUP);
+  if(group->loops == NULL) {
+    fprintf(stderr, "Fail to malloc for client group loops.\n");
+    pc__free(group, sizeof(pc_client_group_t), PC_ALLOC_GROUP);
+    return NULL;
+  }
+  memset(group->loops, 0, sizeof(pc__group_loop_t) * loops);
+
+  group->policy = policy;
+  group->nloops = loops;
+  uv_mutex_init(&group->mutex);
+
+  for(i=0; i<loops; i++) {
+    pc__group_loop_t *loop = &group->loops[i];
+    loop->group = group;
+    loop->index = i;
+    loop->uv_loop = uv_loop_new();
+    if(loop->uv_loop == NULL) {
+      fprintf(stderr, "Fail to create uv_loop_t.\n");
+      abort();
+    }
+
+    uv_mutex_init(&loop->mutex);
+    ngx_queue_init(&loop->tasks);
+    ngx_queue_init(&loop->clients);
+
+    // the async handle keeps the loop alive until the group shutdown
+    uv_async_init(loop->uv_loop, &loop->async, pc__group_async_cb);
+    loop->async.data = loop;
+
+    uv_thread_create(&loop->thread, pc__group_worker, loop);
+  }
+
+  return group;
+}
+
+void pc_client_group_destroy(pc_client_group_t *group) {
+  pc__group_task_t *tasks = NULL;
+  int i;
+
+  tasks = (pc__group_task_t *)pc__malloc(
+      sizeof(pc__group_task_t) * group->nloops, PC_ALLOC_GROUP);
+  if(tasks == NULL) {
+    fprintf(stderr, "Fail to malloc for client group shutdown.\n");
+    abort();
+  }
+  memset(tasks, 0, sizeof(pc__group_task_t) * group->nloops);
+
+  // shutdown all loops at once and then wait them
+  for(i=0; i<group->nloops; i++) {
+    tasks[i].run = pc__group_shutdown_task;
+    if(pc__group_post(&group->loops[i], &tasks[i])) {
+      fprintf(stderr, "Client group loop %d has been shutdown.\n", i);
+    }
+  }
+
+  for(i=0; i<group->nloops; i++) {
+    pc__group_loop_t *loop = &group->loops[i];
+    uv_thread_join(&loop->thread);
+    uv_loop_delete(loop->uv_loop);
+    uv_mutex_destroy(&loop->mutex);
+  }
+
+  pc__free(tasks, sizeof(pc__group_task_t) * group->nloops, PC_ALLOC_GROUP);
+  uv_mutex_destroy(&group->mutex);
+  pc__free(group->loops, sizeof(pc__group_loop_t) * group->nloops,
+           PC_ALLOC_GROUP);
+  pc__free(group, sizeof(pc_client_group_t), PC_ALLOC_GROUP);
+}
+
+pc_client_t *pc_client_group_add(pc_client_group_t *group) {
+  pc__group_task_t task;
+  uv_sem_t done;
+  pc__group_loop_t *loop = pc__group_current(group);
+
+  // waiting for a task of the loop itself would never return
+  if(loop) {
+    uv_mutex_lock(&group->mutex);
+    loop->nclients++;
+    uv_mutex_unlock(&group->mutex);
+    return pc__group_add_client(loop);
+  }
+
+  memset(&task, 0, sizeof(pc__group_task_t));
+  if(uv_sem_init(&done, 0)) {
+    fprintf(stderr, "Fail to init semaphore for client group.\n");
+    return NULL;
+  }
+
+  task.run = pc__group_add_task;
+  task.done = &done;
+
+  loop = pc__group_pick(group);
+  if(pc__group_post(loop, &task)) {
+    uv_mutex_lock(&group->mutex);
+    loop->nclients--;
+    uv_mutex_unlock(&group->mutex);
+    uv_sem_destroy(&done);
+    return NULL;
+  }
+
+  uv_sem_wait(&done);
+  uv_sem_destroy(&done);
+
+  return task.client;
+}
+
+int pc_client_group_exec(pc_client_t *client, pc_group_cb cb, void *data) {
+  if(client->group_loop == NULL) {
+    fprintf(stderr, "Client does not belong to any client group.\n");
+    return -1;
+  }
+
+  pc__group_task_t *task =
+      (pc__group_task_t *)pc__malloc(sizeof(pc__group_task_t), PC_ALLOC_GROUP);
+  if(task == NULL) {
+    fprintf(stderr, "Fail to malloc for client group task.\n");
+    return -1;
+  }
+  memset(task, 0, sizeof(pc__group_task_t));
+
+  task->run = pc__group_exec_task;
+  task->client = client;
+  task->cb = cb;
+  task->data = data;
+
+  if(pc__group_post(client->group_loop, task)) {
+    pc__free(task, sizeof(pc__group_task_t), PC_ALLOC_GROUP);
+    return -1;
+  }
+
+  return 0;
+}
+
+int pc_client_group_connect(pc_client_t *client, struct sockaddr_in *addr) {
+  if(client->group_loop == NULL || addr == NULL) {
+    fprintf(stderr, "Invalid arguments for client group connect.\n");
+    return -1;
+  }
+
+  pc__group_task_t *task =
+      (pc__group_task_t *)pc__malloc(sizeof(pc__group_task_t), PC_ALLOC_GROUP);
+  if(task == NULL) {
+    fprintf(stderr, "Fail to malloc for client group task.\n");
+    return -1;
+  }
+  memset(task, 0, sizeof(pc__group_task_t));
+
+  task->run = pc__group_connect_task;
+  task->client = client;
+  memcpy(&task->addr, addr, sizeof(struct sockaddr_in));
+
+  if(pc__group_post(client->group_loop, task)) {
+    pc__free(task, sizeof(pc__group_task_t), PC_ALLOC_GROUP);
+    return -1;
+  }
+
+  return 0;
+}
+
+void pc_client_group_remove(pc_client_t *client) {
+  if(client->group_loop == NULL) {
+    fprintf(stderr, "Client does not belong to any client group.\n");
+    return;
+  }
+
+  pc__group_task_t *task =
+      (pc__group_task_t *)pc__malloc(sizeof(pc__group_task_t), PC_ALLOC_GROUP);
+  if(task == NULL) {
+    fprintf(stderr, "Fail to malloc for client group task.\n");
+    return;
+  }
+  memset(task, 0, sizeof(pc__group_task_t));
+
+  task->run = pc__group_remove_task;
+  task->client = client;
+
+  if(pc__group_post(client->group_loop, task)) {
+    pc__free(task, sizeof(pc__group_task_t), PC_ALLOC_GROUP);
+  }
+}
+
+int pc_client_group_loops(pc_client_group_t *group) {
+  return group->nloops;
+}
+
+int pc_client_group_loop_clients(pc_client_group_t *group, int index) {
+  int count;
+
+  if(index < 0 || index >= group->nloops) {
+    return -1;
+  }
+
+  uv_mutex_lock(&group->mutex);
+  count = group->loops[index].nclients;
+  uv_mutex_unlock(&group->mutex);
+
+  return count;
+}
+
+void pc__group_client_released(pc_client_t *client) {
+  pc__group_loop_t *loop = client->group_loop;
+  if(loop == NULL) {
+    return;
+  }
+
+  ngx_queue_remove(&client->group_queue);
+  client->group_loop = NULL;
+
+  uv_mutex_lock(&loop->group->mutex);
+  loop->nclients--;
+  uv_mutex_unlock(&loop->group->mutex);
+}
+
+/**
+ * Pick a loop for a new client and reserve the slot.
+ */
+static pc__group_loop_t *pc__group_pick(pc_client_group_t *group) {
+  pc__group_loop_t *loop = NULL;
+  int i;
+
+  uv_mutex_lock(&group->mutex);
+  if(PC_GROUP_LEAST_LOAD == group->policy) {
+    loop = &group->loops[0];
+    for(i=1; i<group->nloops; i++) {
+      if(group->loops[i].nclients < loop->nclients) {
+        loop = &group->loops[i];
+      }
+    }
+  } else {
+    loop = &group->loops[group->next];
+    group->next = (group->next + 1) % group->nloops;
+  }
+  loop->nclients++;
+  uv_mutex_unlock(&group->mutex);
+
+  return loop;
+}
+
+/**
+ * Find the loop driven by the calling thread, NULL for the other threads.
+ */
+static pc__group_loop_t *pc__group_current(pc_client_group_t *group) {
+  unsigned long self = uv_thread_self();
+  int i;
+
+  for(i=0; i<group->nloops; i++) {
+    if(group->loops[i].thread_id == self) {
+      return &group->loops[i];
+    }
+  }
+
+  return NULL;
+}
+
+static int pc__group_post(pc__group_loop_t *loop, pc__group_task_t *task) {
+  uv_mutex_lock(&loop->mutex);
+  if(loop->closing) {
+    uv_mutex_unlock(&loop->mutex);
+    fprintf(stderr, "Fail to post task to a closing client group loop.\n");
+    return -1;
+  }
+  task->loop = loop;
+  ngx_queue_insert_tail(&loop->tasks, &task->queue);
+  if(pc__group_shutdown_task == task->run) {
+    loop->closing = 1;
+  }
+  uv_mutex_unlock(&loop->mutex);
+
+  uv_async_send(&loop->async);
+  return 0;
+}
+
+static void pc__group_worker(void *arg) {
+  pc__group_loop_t *loop = (pc__group_loop_t *)arg;
+  loop->thread_id = uv_thread_self();
+  uv_run(loop->uv_loop, UV_RUN_DEFAULT);
+}
+
+static void pc__group_async_cb(uv_async_t *handle, int status) {
+  pc__group_loop_t *loop = (pc__group_loop_t *)handle->data;
+  ngx_queue_t tasks;
+  ngx_queue_t *q;
+
+  // take all the pending tasks at once
+  ngx_queue_init(&tasks);
+  uv_mutex_lock(&loop->mutex);
+  if(!ngx_queue_empty(&loop->tasks)) {
+    ngx_queue_add(&tasks, &loop->tasks);
+    ngx_queue_init(&loop->tasks);
+  }
+  uv_mutex_unlock(&loop->mutex);
+
+  while(!ngx_queue_empty(&tasks)) {
+    q = ngx_queue_head(&tasks);
+    ngx_queue_remove(q);
+    pc__group_task_t *task = ngx_queue_data(q, pc__group_task_t, queue);
+    task->run(task);
+  }
+}
+
+/**
+ * Create a client on the loop with the slot reserved, in the loop thread.
+ */
+static pc_client_t *pc__group_add_client(pc__group_loop_t *loop) {
+  pc_client_t *client = pc_client_new_on_loop(loop->uv_loop);
+
+  if(client) {
+    client->group_loop = loop;
+    ngx_queue_insert_tail(&loop->clients, &client->group_queue);
+  } else {
+    uv_mutex_lock(&loop->group->mutex);
+    loop->nclients--;
+    uv_mutex_unlock(&loop->group->mutex);
+  }
+
+  return client;
+}
+
+static void pc__group_add_task(pc__group_task_t *task) {
+  task->client = pc__group_add_client(task->loop);
+  uv_sem_post(task->done);
+}
+
+static void pc__group_exec_task(pc__group_task_t *task) {
+  task->cb(task->client, task->data);
+  pc__free(task, sizeof(pc__group_task_t), PC_ALLOC_GROUP);
+}
+
+static void pc__group_connect_task(pc__group_task_t *task) {
+  if(pc_client_connect3(task->client, &task->addr)) {
+    fprintf(stderr, "Fail to connect client in group loop %d.\n",
+            task->loop->index);
+  }
+  pc__free(task, sizeof(pc__group_task_t), PC_ALLOC_GROUP);
+}
+
+static void pc__group_remove_task(pc__group_task_t *task) {
+  pc_client_destroy(task->client);
+  pc__free(task, sizeof(pc__group_task_t), PC_ALLOC_GROUP);
+}
+
+static void pc__group_shutdown_task(pc__group_task_t *task) {
+  pc__group_loop_t *loop = task->loop;
+  ngx_queue_t *q = ngx_queue_head(&loop->clients);
+  ngx_queue_t *next;
+
+  // the client would be detached from the queue once released
+  while(q != ngx_queue_sentinel(&loop->clients)) {
+    next = ngx_queue_next(q);
+    pc_client_destroy(ngx_queue_data(q, pc_client_t, group_queue));
+    q = next;
+  }
+
+  // loop returns after the clients finished closing
+  uv_close((uv_handle_t *)&loop->async, NULL);
+}
@@ -3,11 +3,23 @@
 
 #include "jansson.h"
 #include "pomelo.h"
+#include "pomelo-private/alloc.h"
 #include "pomelo-private/jansson-memory.h"
 
+static void *pc__jsonp_default_malloc(size_t size)
+{
+    return pc__malloc(size, PC_ALLOC_JSON);
+}
+
+static void pc__jsonp_default_free(void *ptr)
+{
+    pc__free(ptr, 0, PC_ALLOC_JSON);
+}
+
 /* memory function pointers */
-static json_malloc_t do_malloc = malloc;
-static json_free_t do_free = free;
+static json_malloc_t do_malloc = pc__jsonp_default_malloc;
+static json_free_t do_free = pc__jsonp_default_free;
+static int hooked = 0;
 
 void *pc_jsonp_malloc(size_t size)
 {
@@ -24,7 +36,20 @@ void pc_jsonp_free(void *ptr)
 
 void pc_json_set_alloc_funcs(json_malloc_t malloc_fn, json_free_t free_fn)
 {
-	json_set_alloc_funcs(malloc_fn, free_fn);
+	if(!hooked)
+		json_set_alloc_funcs(malloc_fn, free_fn);
 	do_malloc = malloc_fn;
 	do_free = free_fn;
 }
+
+void pc__jsonp_set_hooks(json_malloc_t malloc_fn, json_free_t free_fn)
+{
+	hooked = 1;
+	json_set_alloc_funcs(malloc_fn, free_fn);
+}
+
+void pc__jsonp_use_allocator()
+{
+	if(!hooked)
+		pc__jsonp_set_hooks(pc_jsonp_malloc, pc_jsonp_free);
+}
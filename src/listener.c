@@ -1,28 +1,167 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include "pomelo-private/listener.h"
+#include "pomelo-private/atomic.h"
+#include "pomelo-private/alloc.h"
 
-pc_listener_t *pc_listener_new() {
-  pc_listener_t *listener = (pc_listener_t *)malloc(sizeof(pc_listener_t));
-  if(listener == NULL) {
+#define PC__LISTENER_LIST_SIZE(count)                                         \
+  (sizeof(pc_listener_list_t) + ((count) - 1) * sizeof(pc_listener_t))
+
+/*! Buckets of the tables, listener maps are small and copied often. */
+#define PC__LISTENER_TABLE_CAPACITY 64
+
+int pc_listener_init(pc_listener_t *listener) {
+  memset(listener, 0, sizeof(pc_listener_t));
+  return 0;
+}
+
+static int pc__listener_match(const pc_listener_t *a, const pc_listener_t *b) {
+  return a->cb == b->cb && a->typed_cb == b->typed_cb &&
+         a->raw_cb == b->raw_cb;
+}
+
+static pc_listener_list_t *pc__list_new(size_t count) {
+  pc_listener_list_t *list;
+
+  list = (pc_listener_list_t *)pc__malloc(PC__LISTENER_LIST_SIZE(count),
+                                          PC_ALLOC_LISTENER);
+  if(list == NULL) {
+    fprintf(stderr, "Fail to malloc for listener list.\n");
+    return NULL;
+  }
+  list->count = count;
+
+  return list;
+}
+
+static void pc__release_list(pc_map_t *map, const char *key, void *value) {
+  pc_listener_list_t *list = (pc_listener_list_t *)value;
+
+  if(list) {
+    pc__free(list, PC__LISTENER_LIST_SIZE(list->count), PC_ALLOC_LISTENER);
+  }
+}
+
+pc_listener_table_t *pc_listener_table_new() {
+  pc_listener_table_t *table;
+
+  table = (pc_listener_table_t *)pc__malloc(sizeof(pc_listener_table_t),
+                                            PC_ALLOC_LISTENER);
+  if(table == NULL) {
+    fprintf(stderr, "Fail to malloc for listener table.\n");
     return NULL;
   }
 
-  if(pc_listener_init(listener)) {
-    free(listener);
+  table->refs = 1;
+  table->retired_next = NULL;
+  table->lists = pc_map_new(PC__LISTENER_TABLE_CAPACITY, pc__release_list);
+  if(table->lists == NULL) {
+    fprintf(stderr, "Fail to create listener map.\n");
+    pc__free(table, sizeof(pc_listener_table_t), PC_ALLOC_LISTENER);
     return NULL;
   }
 
-  return listener;
+  return table;
 }
 
-int pc_listener_init(pc_listener_t *listener) {
-  memset(listener, 0, sizeof(pc_listener_t));
-  ngx_queue_init(&listener->queue);
+/**
+ * Copy the listeners of an event into the new table, with the listener
+ * added or the first matching one removed. No list is set if none is left.
+ */
+static int pc__list_copy(pc_listener_table_t *table, const char *event,
+                         const pc_listener_list_t *old,
+                         const pc_listener_t *listener, int add) {
+  size_t count = old ? old->count : 0;
+  size_t i, j, skip = count;
+  pc_listener_list_t *list;
+
+  if(listener && !add) {
+    for(i = 0; i < count; i++) {
+      if(pc__listener_match(&old->items[i], listener)) {
+        skip = i;
+        break;
+      }
+    }
+    if(skip == count) {
+      return 1;
+    }
+    if(count == 1) {
+      return 0;
+    }
+  }
+
+  list = pc__list_new(listener ? (add ? count + 1 : count - 1) : count);
+  if(list == NULL) {
+    return -1;
+  }
+
+  for(i = 0, j = 0; i < count; i++) {
+    if(i != skip) {
+      list->items[j++] = old->items[i];
+    }
+  }
+  if(listener && add) {
+    list->items[j] = *listener;
+  }
+
+  if(pc_map_set(table->lists, event, list)) {
+    fprintf(stderr, "Fail to set listener list: %s\n", event);
+    pc__release_list(NULL, event, list);
+    return -1;
+  }
+
   return 0;
 }
 
-void pc_listener_destroy(pc_listener_t *listener) {
-  ngx_queue_remove(&listener->queue);
-  free(listener);
-}
\ No newline at end of file
+pc_listener_table_t *pc_listener_table_update(pc_listener_table_t *table,
+                                              const char *event,
+                                              const pc_listener_t *listener,
+                                              int add) {
+  pc_listener_table_t *copy;
+  pc_map_t *map = table->lists;
+  ngx_queue_t *q;
+  pc__pair_t *pair;
+  size_t i;
+
+  copy = pc_listener_table_new();
+  if(copy == NULL) {
+    return NULL;
+  }
+
+  for(i = 0; i < map->capacity; i++) {
+    ngx_queue_foreach(q, &map->buckets[i]) {
+      pair = ngx_queue_data(q, pc__pair_t, queue);
+      if(strcmp(pair->key, event) &&
+         pc__list_copy(copy, pair->key, (pc_listener_list_t *)pair->value,
+                       NULL, 0)) {
+        goto error;
+      }
+    }
+  }
+
+  if(pc__list_copy(copy, event, pc_listener_table_get(table, event),
+                   listener, add)) {
+    goto error;
+  }
+
+  return copy;
+
+error:
+  pc_listener_table_release(copy);
+  return NULL;
+}
+
+pc_listener_list_t *pc_listener_table_get(pc_listener_table_t *table,
+                                          const char *event) {
+  return (pc_listener_list_t *)pc_map_get(table->lists, event);
+}
+
+void pc_listener_table_release(pc_listener_table_t *table) {
+  if(pc__atomic_add_long(&table->refs, -1) > 0) {
+    return;
+  }
+
+  pc_map_destroy(table->lists);
+  pc__free(table, sizeof(pc_listener_table_t), PC_ALLOC_LISTENER);
+}
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <string.h>
 #include "pomelo-protocol/message.h"
+#include "pomelo-private/alloc.h"
 
 #if defined(_WIN32) && defined(_MSC_VER) && !defined(__cplusplus)
 #define inline __inline
@@ -28,7 +29,7 @@ pc_buf_t pc_msg_encode_route(uint32_t id, pc_msg_type type,
   size_t msg_len = PC_MSG_FLAG_BYTES + id_len + PC_MSG_ROUTE_LEN_BYTES +
                    route_len + msg.len;
 
-  char *base = buf.base = (char *)malloc(msg_len);
+  char *base = buf.base = (char *)pc__malloc(msg_len, PC_ALLOC_MESSAGE);
 
   if(buf.base == NULL) {
     buf.len = -1;
@@ -58,7 +59,7 @@ pc_buf_t pc_msg_encode_route(uint32_t id, pc_msg_type type,
   return buf;
 
 error:
-  if(buf.len != -1) free(buf.base);
+  if(buf.len != -1) pc__free(buf.base, msg_len, PC_ALLOC_MESSAGE);
   buf.len = -1;
   return buf;
 }
@@ -74,7 +75,7 @@ pc_buf_t pc_msg_encode_code(uint32_t id, pc_msg_type type,
 
   size_t msg_len = PC_MSG_FLAG_BYTES + id_len + route_len + msg.len;
 
-  char *base = buf.base = (char *)malloc(msg_len);
+  char *base = buf.base = (char *)pc__malloc(msg_len, PC_ALLOC_MESSAGE);
 
   if(buf.base == NULL) {
     buf.len = -1;
@@ -105,21 +106,53 @@ pc_buf_t pc_msg_encode_code(uint32_t id, pc_msg_type type,
   return buf;
 
 error:
-  if(buf.len != -1) free(buf.base);
+  if(buf.len != -1) pc__free(buf.base, msg_len, PC_ALLOC_MESSAGE);
   buf.len = -1;
   return buf;
 }
 
-pc__msg_raw_t *pc_msg_decode(const char *data, size_t len) {
-  pc__msg_raw_t *msg = NULL;
-  char *route_str = NULL;
-  char *body = NULL;
+size_t pc__msg_prefix_length(uint32_t id, pc_msg_type type,
+                             size_t route_len, int route_code) {
+  size_t len = PC_MSG_FLAG_BYTES;
 
-  msg = (pc__msg_raw_t *)malloc(sizeof(pc__msg_raw_t));
-  if(msg == NULL) {
-    fprintf(stderr, "Fail to malloc for pc_raw_msg_t.\n");
-    return NULL;
+  if(PC_MSG_HAS_ID(type)) {
+    len += pc__msg_id_length(id);
   }
+
+  if(PC_MSG_HAS_ROUTE(type)) {
+    if(route_code > 0) {
+      len += PC_MSG_ROUTE_CODE_BYTES;
+    } else {
+      len += PC_MSG_ROUTE_LEN_BYTES + route_len;
+    }
+  }
+
+  return len;
+}
+
+size_t pc__msg_encode_prefix(uint32_t id, pc_msg_type type, const char *route,
+                             size_t route_len, int route_code, char *base) {
+  size_t offset = 0;
+
+  offset = pc__msg_encode_flag(type, route_code > 0, base, offset);
+
+  if(PC_MSG_HAS_ID(type)) {
+    offset = pc__msg_encode_id(id, base, offset);
+  }
+
+  if(PC_MSG_HAS_ROUTE(type)) {
+    if(route_code > 0) {
+      base[offset++] = (route_code >> 8) & 0xff;
+      base[offset++] = route_code & 0xff;
+    } else {
+      offset = pc__msg_encode_route(route, route_len, base, offset);
+    }
+  }
+
+  return offset;
+}
+
+int pc_msg_decode_raw(const char *data, size_t len, pc__msg_raw_t *msg) {
   memset(msg, 0, sizeof(pc__msg_raw_t));
 
   size_t offset = 0;
@@ -146,10 +179,10 @@ pc__msg_raw_t *pc_msg_decode(const char *data, size_t len) {
   uint32_t id = 0;
 
   if(PC_MSG_HAS_ID(type)) {
-    PC__MSG_CHECK_LEN(offset + 1, len);
     int i = 0;
     uint8_t m;
     do{
+      PC__MSG_CHECK_LEN(offset + 1, len);
       m = data[offset++];
       id = id + ((m & 0x7f) * (1 << (7*i)));
       i++;
@@ -165,40 +198,69 @@ pc__msg_raw_t *pc_msg_decode(const char *data, size_t len) {
       msg->route.route_code |= data[offset++] & 0xff;
     } else {
       PC__MSG_CHECK_LEN(offset + PC_MSG_ROUTE_LEN_BYTES, len);
-      size_t route_len = data[offset++];
-
-      if(route_len) {
-        route_str = (char *)malloc(route_len + 1);
-        if(route_str == NULL) {
-          fprintf(stderr, "Fail to malloc for message route string.\n");
-          goto error;
-        }
-
-        PC__MSG_CHECK_LEN(offset + route_len, len);
-        memset(route_str, 0, route_len + 1);
-        memcpy(route_str, data + offset, route_len);
-        msg->route.route_str = route_str;
-      }
+      size_t route_len = data[offset++] & 0xff;
+
+      PC__MSG_CHECK_LEN(offset + route_len, len);
+      msg->route.route_str = route_len ? data + offset : NULL;
+      msg->route_len = route_len;
 
       offset += route_len;
     }
   }
 
   // body
-  size_t body_len = len - offset;
-  if(body_len) {
-    body = (char *)malloc(body_len);
-    memcpy(body, data + offset, body_len);
+  msg->body.base = (char *)data + offset;
+  msg->body.len = len - offset;
+
+  return 0;
+
+error:
+  return -1;
+}
+
+pc__msg_raw_t *pc_msg_decode(const char *data, size_t len) {
+  pc__msg_raw_t *msg = NULL;
+  char *route_str = NULL;
+  char *body = NULL;
+
+  msg = (pc__msg_raw_t *)pc__malloc(sizeof(pc__msg_raw_t), PC_ALLOC_MESSAGE);
+  if(msg == NULL) {
+    fprintf(stderr, "Fail to malloc for pc_raw_msg_t.\n");
+    return NULL;
+  }
+
+  if(pc_msg_decode_raw(data, len, msg)) {
+    goto error;
+  }
+
+  // copy out the views
+  if(!msg->compressRoute && msg->route_len) {
+    route_str = (char *)pc__malloc(msg->route_len + 1, PC_ALLOC_MESSAGE);
+    if(route_str == NULL) {
+      fprintf(stderr, "Fail to malloc for message route string.\n");
+      goto error;
+    }
+    memcpy(route_str, msg->route.route_str, msg->route_len);
+    route_str[msg->route_len] = '\0';
+    msg->route.route_str = route_str;
+  }
+
+  if(msg->body.len) {
+    body = (char *)pc__malloc(msg->body.len, PC_ALLOC_MESSAGE);
+    if(body == NULL) {
+      fprintf(stderr, "Fail to malloc for message body.\n");
+      goto error;
+    }
+    memcpy(body, msg->body.base, msg->body.len);
   }
   msg->body.base = body;
-  msg->body.len = body_len;
 
   return msg;
 
 error:
-  if(msg) free(msg);
-  if(route_str) free((void *)route_str);
-  if(body) free(body);
+  if(route_str) pc__free(route_str, msg->route_len + 1, PC_ALLOC_MESSAGE);
+  pc__free(body, msg->body.len, PC_ALLOC_MESSAGE);
+  pc__free(msg, sizeof(pc__msg_raw_t), PC_ALLOC_MESSAGE);
   return NULL;
 }
 
@@ -243,20 +305,28 @@ static uint8_t pc__msg_id_length(uint32_t id) {
 
 void pc_msg_destroy(pc_msg_t *msg) {
   if(msg == NULL) return;
-  if(msg->route) free((void *)msg->route);
+  // released with the arena
+  if(msg->arena) return;
+  if(msg->route && !msg->route_interned) {
+    pc__free((void *)msg->route, strlen(msg->route) + 1, PC_ALLOC_MESSAGE);
+  }
+  if(msg->own_body) {
+    pc__free(msg->body.base, msg->body.len, PC_ALLOC_MESSAGE);
+  }
   if(msg->msg) {
     json_decref(msg->msg);
     msg->msg = NULL;
   }
-  free(msg);
+  pc__free(msg, sizeof(pc_msg_t), PC_ALLOC_MESSAGE);
 }
 
 void pc__raw_msg_destroy(pc__msg_raw_t *msg) {
   if(!msg->compressRoute && msg->route.route_str) {
-    free((void *)msg->route.route_str);
+    pc__free((void *)msg->route.route_str, msg->route_len + 1,
+             PC_ALLOC_MESSAGE);
   }
   if(msg->body.len > 0) {
-    free(msg->body.base);
+    pc__free(msg->body.base, msg->body.len, PC_ALLOC_MESSAGE);
   }
-  free(msg);
+  pc__free(msg, sizeof(pc__msg_raw_t), PC_ALLOC_MESSAGE);
 }
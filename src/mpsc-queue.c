@@ -0,0 +1,59 @@
+#include <stddef.h>
+#include "pomelo-private/atomic.h"
+#include "pomelo-private/mpsc-queue.h"
+
+/**
+ * Dmitry Vyukov's intrusive MPSC node-based queue. A push is a single atomic
+ * exchange and a pop never blocks the producers.
+ */
+
+void pc_mpsc_queue_init(pc_mpsc_queue_t *queue) {
+  queue->stub.next = NULL;
+  queue->head = &queue->stub;
+  queue->tail = &queue->stub;
+}
+
+void pc_mpsc_queue_push(pc_mpsc_queue_t *queue, pc_mpsc_node_t *node) {
+  pc_mpsc_node_t *prev;
+
+  node->next = NULL;
+  prev = (pc_mpsc_node_t *)pc__atomic_xchg_ptr(&queue->head, node);
+  // the node is visible to consumer once linked
+  pc__atomic_store_ptr(&prev->next, node);
+}
+
+pc_mpsc_node_t *pc_mpsc_queue_pop(pc_mpsc_queue_t *queue) {
+  pc_mpsc_node_t *tail = queue->tail;
+  pc_mpsc_node_t *next =
+      (pc_mpsc_node_t *)pc__atomic_load_ptr(&tail->next);
+
+  if(tail == &queue->stub) {
+    if(next == NULL) {
+      return NULL;
+    }
+    queue->tail = next;
+    tail = next;
+    next = (pc_mpsc_node_t *)pc__atomic_load_ptr(&tail->next);
+  }
+
+  if(next != NULL) {
+    queue->tail = next;
+    return tail;
+  }
+
+  if(tail != (pc_mpsc_node_t *)pc__atomic_load_ptr(&queue->head)) {
+    // a producer has swapped the head but not linked it yet
+    return NULL;
+  }
+
+  // push the stub back to take out the last node
+  pc_mpsc_queue_push(queue, &queue->stub);
+
+  next = (pc_mpsc_node_t *)pc__atomic_load_ptr(&tail->next);
+  if(next != NULL) {
+    queue->tail = next;
+    return tail;
+  }
+
+  return NULL;
+}
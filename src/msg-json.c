@@ -1,6 +1,7 @@
 #include <string.h>
 #include "jansson.h"
 #include "pomelo-protocol/message.h"
+#include "pomelo-protocol/frame.h"
 
 pc_buf_t pc__json_encode(const json_t *msg) {
   pc_buf_t buf;
@@ -28,3 +29,15 @@ json_t *pc__json_decode(const char *data, size_t offset, size_t len) {
 
   return res;
 }
+
+static int pc__json_frame_cb(const char *buffer, size_t size, void *data) {
+  return pc_frame_append((pc_frame_builder_t *)data, buffer, size);
+}
+
+int pc__json_encode_frame(pc_frame_builder_t *fb, const json_t *msg) {
+  if(json_dump_callback(msg, pc__json_frame_cb, fb, JSON_COMPACT)) {
+    fprintf(stderr, "Fail to json encode for message.\n");
+    return -1;
+  }
+  return 0;
+}
@@ -1,55 +1,52 @@
 #include <string.h>
 #include "jansson.h"
 #include "pomelo-protocol/message.h"
+#include "pomelo-protocol/frame.h"
 #include "pomelo-protobuf/pb.h"
 #include "pomelo-private/jansson-memory.h"
 
-pc_buf_t pc__pb_encode(const json_t *msg, const json_t *gprotos, const json_t *pb_def) {
-    pc_buf_t buf, json_buf;
-    memset(&buf, 0, sizeof(pc_buf_t));
-    memset(&json_buf, 0, sizeof(pc_buf_t));
+pc_buf_t pc__pb_encode(const json_t *msg, const pc_pb_message_t *pb_def) {
+    pc_buf_t buf;
+    pc_pb_sizes_t sizes;
+    size_t size = 0;
 
-    json_buf = pc__json_encode(msg);
+    buf.base = NULL;
+    buf.len = -1;
+    pc_pb_sizes_init(&sizes);
 
-    if (json_buf.len == -1) {
-        fprintf(stderr, "Fail to encode json for protobuf evaluate.\n");
+    // sizing pass, then encode into the buffer of exact size
+    if (!pc_pb_message_size(pb_def, (json_t *)msg, &sizes, &size)) {
+        fprintf(stderr, "Fail to evaluate protobuf size.\n");
         goto error;
     }
 
-    size_t eval_size = json_buf.len * PC_PB_EVAL_FACTOR;
-
-    buf.base = (char *)malloc(eval_size);
-
+    buf.base = (char *)pc_jsonp_malloc(size ? size : 1);
     if (buf.base == NULL) {
         fprintf(stderr, "Fail to malloc for protobuf encode.\n");
-        buf.len = -1;
         goto error;
     }
 
-    size_t written = 0;
-    if (!pc_pb_encode((uint8_t *)buf.base, eval_size, &written,
-                      (json_t *)gprotos, (json_t *)pb_def, (json_t *)msg)) {
+    if (!pc_pb_encode_sized((uint8_t *)buf.base, size, pb_def, (json_t *)msg,
+                            &sizes)) {
         fprintf(stderr, "Fail to do protobuf encode.\n");
         goto error;
     }
 
-    buf.len = written;
-
-    pc_jsonp_free(json_buf.base);
+    buf.len = size;
+    pc_pb_sizes_close(&sizes);
 
     return buf;
 
 error:
-    if (json_buf.len == -1 && json_buf.base != NULL) pc_jsonp_free(json_buf.base);
-    if (buf.len == -1) {
-        free(buf.base);
-        buf.base = NULL;
-    }
+    pc_pb_sizes_close(&sizes);
+    pc_jsonp_free(buf.base);
+    buf.base = NULL;
+    buf.len = -1;
     return buf;
 }
 
 json_t *pc__pb_decode(const char *data, size_t offset, size_t len,
-                      const json_t *gprotos, const json_t *pb_def) {
+                      const pc_pb_message_t *pb_def) {
 
     json_t *result = json_object();
     if (result == NULL) {
@@ -57,8 +54,8 @@ json_t *pc__pb_decode(const char *data, size_t offset, size_t len,
         goto error;
     }
 
-    if (!pc_pb_decode((uint8_t *)(data + offset), len,
-                      (json_t *)gprotos, (json_t *)pb_def, result)) {
+    if (!pc_pb_decode_message((uint8_t *)(data + offset), len,
+                              pb_def, result)) {
         fprintf(stderr, "Fail to do protobuf decode.\n");
         goto error;
     }
@@ -70,3 +67,37 @@ error:
 
     return NULL;
 }
+
+int pc__pb_encode_frame(pc_frame_builder_t *fb, const json_t *msg,
+                        const pc_pb_message_t *pb_def) {
+    pc_pb_sizes_t sizes;
+    size_t size = 0;
+    char *base;
+    int res = -1;
+
+    pc_pb_sizes_init(&sizes);
+
+    // sizing pass, then encode right into the frame
+    if (!pc_pb_message_size(pb_def, (json_t *)msg, &sizes, &size)) {
+        fprintf(stderr, "Fail to evaluate protobuf size.\n");
+        goto done;
+    }
+
+    base = pc_frame_reserve(fb, size);
+    if (base == NULL) {
+        goto done;
+    }
+
+    if (!pc_pb_encode_sized((uint8_t *)base, size, pb_def, (json_t *)msg,
+                            &sizes)) {
+        fprintf(stderr, "Fail to do protobuf encode.\n");
+        goto done;
+    }
+
+    fb->len += size;
+    res = 0;
+
+done:
+    pc_pb_sizes_close(&sizes);
+    return res;
+}
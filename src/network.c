@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <assert.h>
 #include "pomelo.h"
@@ -7,22 +8,67 @@
 #include "pomelo-protocol/message.h"
 #include "pomelo-private/common.h"
 #include "pomelo-private/transport.h"
+#include "pomelo-private/internal.h"
+#include "pomelo-private/alloc.h"
+#include "pomelo-private/pool.h"
+#include "pomelo-private/atomic.h"
+#include "pomelo-private/completion.h"
 
 int pc__handshake_req(pc_client_t *client);
 
+/**
+ * Context of the tcp connect, allocated along with the uv request.
+ */
+typedef struct {
+  uv_connect_t req;
+  pc_transport_t *transport;
+  pc_connect_t *conn_req;
+} pc__connect_ctx_t;
+
 // private callback functions
-static uv_buf_t pc__alloc_buffer(uv_handle_t *handle, size_t suggested_size);
 static void pc__on_tcp_read(uv_stream_t *handle, ssize_t nread, uv_buf_t buf);
 static void pc__on_tcp_connect(uv_connect_t *req, int status);
-static void pc__on_notify(uv_write_t* req, int status);
-static void pc__on_request(uv_write_t *req, int status);
+static void pc__on_notify(pc_transport_t *transport, void *data, int status);
+static void pc__on_request(pc_transport_t *transport, void *data, int status);
 static int pc__async_write(pc_transport_t *transport, pc_tcp_req_t *req,
-                           const char *route, json_t *msg);
-static void pc__async_write_cb(uv_async_t* handle, int status);
+                           const char *route, pc_route_t *handle, json_t *msg);
+static int pc__async_write_body(pc_transport_t *transport, pc_tcp_req_t *req,
+                                const char *route, pc_buf_t body, int own);
 static void pc__notify(pc_notify_t *req, int status);
 static void pc__request(pc_request_t *req, int status);
+static void pc__request_timer_start(pc_client_t *client, pc_request_t *req);
 
-static uint32_t pc__req_id = 0;
+static void pc__tcp_req_free_route(pc_tcp_req_t *req) {
+  // the route of handle is owned by client
+  if(req->route && req->route != req->route_buf && req->route_handle == NULL) {
+    pc__free((void *)req->route, strlen(req->route) + 1, PC_ALLOC_REQUEST);
+  }
+  req->route = NULL;
+  req->route_handle = NULL;
+}
+
+/**
+ * Take the next request id, 0 is reserved for notify.
+ */
+static uint32_t pc__client_next_req_id(pc_client_t *client) {
+  uint32_t id;
+
+  do {
+    id = (uint32_t)pc__atomic_add_long(&client->req_id, 1);
+  } while(id == 0);
+
+  return id;
+}
+
+static void pc__tcp_req_release_body(pc_tcp_req_t *req) {
+  if(req->own_body) {
+    pc__free(req->body.base, req->body.len, PC_ALLOC_MESSAGE);
+  }
+  req->body.base = NULL;
+  req->body.len = 0;
+  req->has_body = 0;
+  req->own_body = 0;
+}
 
 /**
  * Create and initiate connect request instance.
@@ -33,7 +79,8 @@ pc_connect_t *pc_connect_req_new(struct sockaddr_in *address) {
     return NULL;
   }
 
-  pc_connect_t *req = (pc_connect_t *)malloc(sizeof(pc_connect_t));
+  pc_connect_t *req = (pc_connect_t *)pc__malloc(sizeof(pc_connect_t),
+                                                 PC_ALLOC_REQUEST);
   if(req == NULL) {
     fprintf(stderr, "Fail to malloc for pc_connect_t.\n");
     return NULL;
@@ -43,7 +90,8 @@ pc_connect_t *pc_connect_req_new(struct sockaddr_in *address) {
   req->type = PC_CONNECT;
 
   struct sockaddr_in *cpy_addr =
-      (struct sockaddr_in *)malloc(sizeof (struct sockaddr_in));
+      (struct sockaddr_in *)pc__malloc(sizeof(struct sockaddr_in),
+                                        PC_ALLOC_REQUEST);
 
   if(cpy_addr == NULL) {
     fprintf(stderr, "Fail to malloc sockaddr_in in pc_connect_req_init.\n");
@@ -56,17 +104,16 @@ pc_connect_t *pc_connect_req_new(struct sockaddr_in *address) {
   return req;
 
 error:
-  if(req) free(req);
-  if(cpy_addr) free(cpy_addr);
+  pc__free(req, sizeof(pc_connect_t), PC_ALLOC_REQUEST);
   return NULL;
 }
 
 void pc_connect_req_destroy(pc_connect_t *req) {
   if(req->address) {
-    free(req->address);
+    pc__free(req->address, sizeof(struct sockaddr_in), PC_ALLOC_REQUEST);
     req->address = NULL;
   }
-  free(req);
+  pc__free(req, sizeof(pc_connect_t), PC_ALLOC_REQUEST);
 }
 
 /**
@@ -88,23 +135,16 @@ int pc_connect(pc_client_t *client, pc_connect_t *req,
 
   client->state = PC_ST_CONNECTING;
 
-  uv_connect_t *connect_req = NULL;
+  pc__connect_ctx_t *ctx = NULL;
   pc_transport_t *transport = NULL;
-  void **data = NULL;
 
-  connect_req = (uv_connect_t *)malloc(sizeof(uv_connect_t));
-  if(connect_req == NULL) {
+  ctx = (pc__connect_ctx_t *)pc__malloc(sizeof(pc__connect_ctx_t),
+                                        PC_ALLOC_HANDLE);
+  if(ctx == NULL) {
     fprintf(stderr, "Fail to malloc for uv_connect_t.\n");
     return -1;
   }
 
-  data = (void **)malloc(sizeof(void *) * 2);
-
-  if(data == NULL) {
-    fprintf(stderr, "Fail to malloc for data array in pc_connect.\n");
-    goto error;
-  }
-
   transport = pc_transport_new(client);
   if(transport == NULL) {
     goto error;
@@ -118,11 +158,10 @@ int pc_connect(pc_client_t *client, pc_connect_t *req,
   req->client = client;
   req->transport = transport;
   req->cb = cb;
-  data[0] = transport;
-  data[1] = req;
-  connect_req->data = (void *)data;
+  ctx->transport = transport;
+  ctx->conn_req = req;
 
-  if(uv_tcp_connect(connect_req, transport->socket,
+  if(uv_tcp_connect(&ctx->req, transport->socket,
                     *req->address, pc__on_tcp_connect)) {
     fprintf(stderr, "Fail to connect to server.");
     goto error;
@@ -133,15 +172,15 @@ int pc_connect(pc_client_t *client, pc_connect_t *req,
 
 error:
   req->data = NULL;
-  if(data) free(data);
   if(transport) pc_transport_destroy(transport);
-  if(connect_req) free(connect_req);
+  pc__free(ctx, sizeof(pc__connect_ctx_t), PC_ALLOC_HANDLE);
 
   return -1;
 }
 
 pc_request_t *pc_request_new() {
-  pc_request_t *req = (pc_request_t *)malloc(sizeof(pc_request_t));
+  pc_request_t *req = (pc_request_t *)pc__malloc(sizeof(pc_request_t),
+                                                 PC_ALLOC_REQUEST);
   if(req == NULL) {
     fprintf(stderr, "Fail to malloc for new pc_request_t.\n");
     return NULL;
@@ -153,30 +192,165 @@ pc_request_t *pc_request_new() {
   return req;
 }
 
+pc_request_t *pc_client_request_new(pc_client_t *client) {
+  pc_request_t *req = (pc_request_t *)pc_pool_get(client->request_pool);
+  if(req == NULL) {
+    fprintf(stderr, "Fail to malloc for new pc_request_t.\n");
+    return NULL;
+  }
+
+  memset(req, 0, sizeof(pc_request_t));
+  req->type = PC_REQUEST;
+  req->pool = client->request_pool;
+
+  return req;
+}
+
 void pc_request_destroy(pc_request_t *req) {
-  if(req->route) {
-    free((void *)req->route);
-    req->route = NULL;
+  pc__tcp_req_free_route((pc_tcp_req_t *)req);
+  pc__tcp_req_release_body((pc_tcp_req_t *)req);
+  if(req->pool) {
+    pc_pool_put(req->pool, req);
+  } else {
+    pc__free(req, sizeof(pc_request_t), PC_ALLOC_REQUEST);
   }
-  free(req);
 }
 
-int pc_request(pc_client_t *client, pc_request_t *req, const char *route,
-               json_t *msg, pc_request_cb cb) {
+/**
+ * Check and reset a request for sending, the shared part of all the request
+ * functions.
+ */
+static int pc__request_init(pc_client_t *client, pc_request_t *req,
+                            int timeout, pc_request_cb cb) {
   if(PC_ST_WORKING != client->state) {
     fprintf(stderr, "Invalid client state to send request: %d\n", client->state);
     return -1;
   }
+  if(timeout < 0) {
+    fprintf(stderr, "Invalid request timeout: %d\n", timeout);
+    return -1;
+  }
+  pc__tcp_req_release_body((pc_tcp_req_t *)req);
   req->cb = cb;
-  req->id = ++pc__req_id;
-  return pc__async_write(client->transport, (pc_tcp_req_t *)req, route, msg);
+  if(client->completion_mode) {
+    req->user_cb = cb;
+    req->cb = pc__request_complete_cb;
+  }
+  req->timeout = timeout;
+  req->timer.deadline = 0;
+  req->codec = NULL;
+  req->typed_msg = NULL;
+  req->resp_codec = NULL;
+  req->raw_cb = NULL;
+  return 0;
+}
+
+int pc_request(pc_client_t *client, pc_request_t *req, const char *route,
+               json_t *msg, pc_request_cb cb) {
+  return pc_request_with_timeout(client, req, route, msg, 0, cb);
+}
+
+int pc_request_with_timeout(pc_client_t *client, pc_request_t *req,
+                            const char *route, json_t *msg,
+                            int timeout, pc_request_cb cb) {
+  if(pc__request_init(client, req, timeout, cb)) {
+    return -1;
+  }
+  return pc__async_write(client->transport, (pc_tcp_req_t *)req, route, NULL,
+                         msg);
+}
+
+int pc_request_route(pc_client_t *client, pc_request_t *req, pc_route_t *route,
+                     json_t *msg, int timeout, pc_request_cb cb) {
+  if(pc__request_init(client, req, timeout, cb)) {
+    return -1;
+  }
+  return pc__async_write(client->transport, (pc_tcp_req_t *)req, NULL, route,
+                         msg);
+}
+
+int pc_request_bytes(pc_client_t *client, pc_request_t *req,
+                     const char *route, pc_buf_t body, int own, int timeout,
+                     pc_request_cb cb) {
+  if(pc__request_init(client, req, timeout, cb)) {
+    return -1;
+  }
+  return pc__async_write_body(client->transport, (pc_tcp_req_t *)req, route,
+                              body, own);
+}
+
+/**
+ * Errors of raw request are reported by the callback of json request.
+ */
+static void pc__raw_request_cb(pc_request_t *req, int status, json_t *resp) {
+  req->raw_cb(req, status, NULL);
+}
+
+int pc_request_raw(pc_client_t *client, pc_request_t *req, const char *route,
+                   json_t *msg, int timeout, pc_request_raw_cb cb) {
+  if(cb == NULL || pc__request_init(client, req, timeout, pc__raw_request_cb)) {
+    return -1;
+  }
+  req->raw_cb = cb;
+  return pc__async_write(client->transport, (pc_tcp_req_t *)req, route, NULL,
+                         msg);
+}
+
+/**
+ * Errors of typed request are reported by the callback of json request.
+ */
+static void pc__typed_request_cb(pc_request_t *req, int status, json_t *resp) {
+  req->typed_cb(req, status, NULL);
+}
+
+static int pc__request_typed_send(pc_client_t *client, pc_request_t *req,
+                                  const char *route, pc_route_t *handle,
+                                  const pc_typed_codec_t *codec,
+                                  const void *msg,
+                                  const pc_typed_codec_t *resp_codec,
+                                  int timeout, pc_request_typed_cb cb) {
+  if(codec == NULL || msg == NULL || resp_codec == NULL) {
+    fprintf(stderr, "Invalid typed request: %s\n",
+            handle ? handle->route : route);
+    return -1;
+  }
+  if(pc__request_init(client, req, timeout, pc__typed_request_cb)) {
+    return -1;
+  }
+  req->typed_cb = cb;
+  req->codec = codec;
+  req->typed_msg = msg;
+  req->resp_codec = resp_codec;
+  return pc__async_write(client->transport, (pc_tcp_req_t *)req, route, handle,
+                         NULL);
+}
+
+int pc_request_typed(pc_client_t *client, pc_request_t *req,
+                     const char *route, const pc_typed_codec_t *codec,
+                     const void *msg, const pc_typed_codec_t *resp_codec,
+                     int timeout, pc_request_typed_cb cb) {
+  return pc__request_typed_send(client, req, route, NULL, codec, msg,
+                                resp_codec, timeout, cb);
+}
+
+int pc_request_typed_route(pc_client_t *client, pc_request_t *req,
+                           pc_route_t *route, const pc_typed_codec_t *codec,
+                           const void *msg, const pc_typed_codec_t *resp_codec,
+                           int timeout, pc_request_typed_cb cb) {
+  if(route == NULL) {
+    fprintf(stderr, "Invalid route handle of typed request.\n");
+    return -1;
+  }
+  return pc__request_typed_send(client, req, NULL, route, codec, msg,
+                                resp_codec, timeout, cb);
 }
 
 /**
  * Create and initiate notify request instance.
  */
 pc_notify_t *pc_notify_new() {
-  pc_notify_t *req = (pc_notify_t *)malloc(sizeof(pc_notify_t));
+  pc_notify_t *req = (pc_notify_t *)pc__malloc(sizeof(pc_notify_t),
+                                               PC_ALLOC_REQUEST);
   if(req == NULL) {
     fprintf(stderr, "Fail to malloc new pc_notify_t.\n");
     return NULL;
@@ -187,30 +361,170 @@ pc_notify_t *pc_notify_new() {
   return req;
 }
 
+pc_notify_t *pc_client_notify_new(pc_client_t *client) {
+  pc_notify_t *req = (pc_notify_t *)pc_pool_get(client->notify_pool);
+  if(req == NULL) {
+    fprintf(stderr, "Fail to malloc new pc_notify_t.\n");
+    return NULL;
+  }
+
+  memset(req, 0, sizeof(pc_notify_t));
+  req->type = PC_NOTIFY;
+  req->pool = client->notify_pool;
+
+  return req;
+}
+
 void pc_notify_destroy(pc_notify_t *req) {
-  if(req->route) {
-    free((void *)req->route);
-    req->route = NULL;
+  pc__tcp_req_free_route((pc_tcp_req_t *)req);
+  pc__tcp_req_release_body((pc_tcp_req_t *)req);
+  if(req->pool) {
+    pc_pool_put(req->pool, req);
+  } else {
+    pc__free(req, sizeof(pc_notify_t), PC_ALLOC_REQUEST);
   }
-  free(req);
 }
 
 /**
- * Send notify to server.
+ * Check and reset a notify for sending, see pc__request_init.
  */
-int pc_notify(pc_client_t *client, pc_notify_t *req, const char *route,
-              json_t *msg, pc_notify_cb cb) {
+static int pc__notify_init(pc_client_t *client, pc_notify_t *req,
+                           pc_notify_cb cb) {
   if(PC_ST_WORKING != client->state) {
     fprintf(stderr, "Invalid client state to send notify: %d\n", client->state);
     return -1;
   }
 
+  pc__tcp_req_release_body((pc_tcp_req_t *)req);
   req->cb = cb;
-  return pc__async_write(client->transport, (pc_tcp_req_t *)req, route, msg);
+  if(client->completion_mode) {
+    req->user_cb = cb;
+    req->cb = pc__notify_complete_cb;
+  }
+  req->codec = NULL;
+  req->typed_msg = NULL;
+  return 0;
+}
+
+/**
+ * Send notify to server.
+ */
+int pc_notify(pc_client_t *client, pc_notify_t *req, const char *route,
+              json_t *msg, pc_notify_cb cb) {
+  if(pc__notify_init(client, req, cb)) {
+    return -1;
+  }
+  return pc__async_write(client->transport, (pc_tcp_req_t *)req, route, NULL,
+                         msg);
+}
+
+int pc_notify_route(pc_client_t *client, pc_notify_t *req, pc_route_t *route,
+                    json_t *msg, pc_notify_cb cb) {
+  if(pc__notify_init(client, req, cb)) {
+    return -1;
+  }
+  return pc__async_write(client->transport, (pc_tcp_req_t *)req, NULL, route,
+                         msg);
+}
+
+static int pc__notify_typed_send(pc_client_t *client, pc_notify_t *req,
+                                 const char *route, pc_route_t *handle,
+                                 const pc_typed_codec_t *codec,
+                                 const void *msg, pc_notify_cb cb) {
+  if(codec == NULL || msg == NULL) {
+    fprintf(stderr, "Invalid typed notify: %s\n",
+            handle ? handle->route : route);
+    return -1;
+  }
+  if(pc__notify_init(client, req, cb)) {
+    return -1;
+  }
+  req->codec = codec;
+  req->typed_msg = msg;
+  return pc__async_write(client->transport, (pc_tcp_req_t *)req, route, handle,
+                         NULL);
+}
+
+int pc_notify_typed(pc_client_t *client, pc_notify_t *req, const char *route,
+                    const pc_typed_codec_t *codec, const void *msg,
+                    pc_notify_cb cb) {
+  return pc__notify_typed_send(client, req, route, NULL, codec, msg, cb);
+}
+
+int pc_notify_typed_route(pc_client_t *client, pc_notify_t *req,
+                          pc_route_t *route, const pc_typed_codec_t *codec,
+                          const void *msg, pc_notify_cb cb) {
+  if(route == NULL) {
+    fprintf(stderr, "Invalid route handle of typed notify.\n");
+    return -1;
+  }
+  return pc__notify_typed_send(client, req, NULL, route, codec, msg, cb);
+}
+
+int pc_notify_bytes(pc_client_t *client, pc_notify_t *req, const char *route,
+                    pc_buf_t body, int own, pc_notify_cb cb) {
+  if(pc__notify_init(client, req, cb)) {
+    return -1;
+  }
+  return pc__async_write_body(client->transport, (pc_tcp_req_t *)req, route,
+                              body, own);
+}
+
+/**
+ * Encode a request or notify into a data package. The default encoder builds
+ * the package in one buffer, while a custom encoder of client is followed by
+ * a package encode. Typed messages and encoded bodies always take the
+ * default encoder. The capacity of package buffer is output by size.
+ */
+static pc_buf_t pc__encode_package(pc_client_t *client, uint32_t id,
+                                   pc_tcp_req_t *req, size_t *size) {
+  pc_buf_t msg_buf, pkg_buf;
+  pc_route_t lookup;
+  pc_route_t *handle = req->route_handle;
+  const char *route = req->route;
+  json_t *msg = req->msg;
+
+  if(req->codec || req->has_body ||
+     client->encode_msg == pc__default_msg_encode_cb) {
+    // handles keep their lookups until the dictionary or protos change
+    if(handle) {
+      pc__route_update(client, handle);
+    } else {
+      pc__route_lookup(client, route, &lookup);
+      handle = &lookup;
+    }
+
+    if(req->codec) {
+      return pc__typed_frame_encode(client, id, handle, req->codec,
+                                    req->typed_msg, size);
+    }
+    if(req->has_body) {
+      return pc__body_frame_encode(client, id, handle, req->body, size);
+    }
+    return pc__default_frame_encode(client, id, handle, msg, size);
+  }
+
+  msg_buf = client->encode_msg(client, id, route, msg);
+  if(msg_buf.len == -1) {
+    fprintf(stderr, "Fail to encode message.\n");
+    return msg_buf;
+  }
+
+  pkg_buf = pc_pkg_encode(PC_PKG_DATA, msg_buf.base, msg_buf.len);
+  client->encode_msg_done(client, msg_buf);
+  *size = pkg_buf.len;
+
+  return pkg_buf;
 }
 
 static void pc__request(pc_request_t *req, int status) {
+  // package encoded by caller, which has taken the request id too
+  pc_buf_t pkg_buf = req->pkg;
+  size_t pkg_size = req->pkg_size;
+  req->pkg.base = NULL;
+
   if(status == -1) {
+    pc__free(pkg_buf.base, pkg_size, PC_ALLOC_PACKAGE);
     req->cb(req, status, NULL);
     return;
   }
@@ -220,76 +534,51 @@ static void pc__request(pc_request_t *req, int status) {
   // check transport state again
   if(PC_TP_ST_WORKING != transport->state) {
     fprintf(stderr, "Fail to request for transport not working.\n");
+    pc__free(pkg_buf.base, pkg_size, PC_ALLOC_PACKAGE);
     req->cb(req, status, NULL);
     return;
   }
 
   pc_client_t *client = transport->client;
-  pc_buf_t msg_buf, pkg_buf;
-  uv_write_t * write_req = NULL;
-  void **data = NULL;
 
   pc_last_update_time = time(NULL);
 
-  memset(&msg_buf, 0, sizeof(pc_buf_t));
-  memset(&pkg_buf, 0, sizeof(pc_buf_t));
-
-  msg_buf = client->encode_msg(client, req->id, req->route, req->msg);
-
-  if(msg_buf.len == -1) {
-    fprintf(stderr, "Fail to encode request message.\n");
-    goto error;
+  if(pkg_buf.base == NULL) {
+    req->id = pc__client_next_req_id(client);
+    pkg_buf = pc__encode_package(client, req->id, (pc_tcp_req_t *)req,
+                                 &pkg_size);
+    // the body is copied into package
+    pc__tcp_req_release_body((pc_tcp_req_t *)req);
+    if(pkg_buf.len == -1) {
+      fprintf(stderr, "Fail to encode request package.\n");
+      goto error;
+    }
   }
 
-  pkg_buf = pc_pkg_encode(PC_PKG_DATA, msg_buf.base, msg_buf.len);
-
-  if(msg_buf.len == -1) {
-    fprintf(stderr, "Fail to encode request package.\n");
-    goto error;
-  }
-
-  write_req = (uv_write_t *)malloc(sizeof(uv_write_t));
-
-  if(write_req == NULL) {
+  // the request lives in the table until responded or failed
+  if(pc_req_table_set(client->requests, req->id, req)) {
     goto error;
   }
 
-  memset(write_req, 0, sizeof(uv_write_t));
-
-  // record request context
-  data = (void **)malloc(sizeof(void *) * 2);
-  if(data == NULL) {
-    fprintf(stderr, "Fail to malloc void** for pc__request.\n");
-    goto error;
+  // before the write, whose flush may fail and release the request already
+  if(req->timeout > 0) {
+    pc__request_timer_start(client, req);
   }
 
-  data[0] = (void *)req;
-  data[1] = pkg_buf.base;
-  write_req->data = (void *)data;
-
-  int res = uv_write(write_req, (uv_stream_t *)client->transport->socket,
-                     (uv_buf_t *)&pkg_buf, 1, pc__on_request);
-
-  if(res == -1) {
-    fprintf(stderr, "Send message error %s\n",
-            uv_err_name(uv_last_error(client->uv_loop)));
+  // the frame is owned by transport from now on. It keeps the id rather
+  // than the request, which may time out and be released before the write
+  // callback.
+  if(pc_transport_write(transport, pkg_buf.base, pkg_buf.len, pkg_size,
+                        pc__on_request, (void *)(uintptr_t)req->id)) {
+    pc_req_table_del(client->requests, req->id);
+    pc__request_timer_stop(client, req);
     goto error;
   }
 
-  char req_id_str[64];
-  memset(req_id_str, 0, 64);
-  sprintf(req_id_str, "%u", req->id);
-  pc_map_set(client->requests, req_id_str, req);
-
-  client->encode_msg_done(client, msg_buf);
-
   return;
 
 error:
-  if(msg_buf.len != -1) free(msg_buf.base);
-  if(pkg_buf.len != -1) free(pkg_buf.base);
-  if(write_req) free(write_req);
-  if(data) free(data);
+  if(pkg_buf.len != -1) pc__free(pkg_buf.base, pkg_size, PC_ALLOC_PACKAGE);
   req->cb(req, -1, NULL);
 }
 
@@ -297,7 +586,12 @@ error:
  * Async callback and send notify to server finally.
  */
 static void pc__notify(pc_notify_t *req, int status) {
+  pc_buf_t pkg_buf = req->pkg;
+  size_t pkg_size = req->pkg_size;
+  req->pkg.base = NULL;
+
   if(status == -1) {
+    pc__free(pkg_buf.base, pkg_size, PC_ALLOC_PACKAGE);
     req->cb(req, status);
     return;
   }
@@ -309,91 +603,45 @@ static void pc__notify(pc_notify_t *req, int status) {
   // check client state again
   if(PC_TP_ST_WORKING != transport->state) {
     fprintf(stderr, "Fail to notify for transport not working.\n");
+    pc__free(pkg_buf.base, pkg_size, PC_ALLOC_PACKAGE);
     req->cb(req, status);
     return;
   }
 
   pc_client_t *client = transport->client;
-  pc_buf_t msg_buf;
-  pc_buf_t pkg_buf;
-  memset(&msg_buf, 0, sizeof(pc_buf_t));
-  memset(&pkg_buf, 0, sizeof(pc_buf_t));
-
-  uv_write_t * write_req = NULL;
-  void** data = NULL;
 
-  msg_buf = client->encode_msg(client, 0, req->route, req->msg);
-
-  if(msg_buf.len == -1) {
-    fprintf(stderr, "Fail to encode request message.\n");
-    goto error;
+  if(pkg_buf.base == NULL) {
+    pkg_buf = pc__encode_package(client, 0, (pc_tcp_req_t *)req, &pkg_size);
+    pc__tcp_req_release_body((pc_tcp_req_t *)req);
+    if(pkg_buf.len == -1) {
+      fprintf(stderr, "Fail to encode notify package.\n");
+      goto error;
+    }
   }
 
-  pkg_buf = pc_pkg_encode(PC_PKG_DATA, msg_buf.base, msg_buf.len);
-
-  if(msg_buf.len == -1) {
-    fprintf(stderr, "Fail to encode request package.\n");
+  // the frame is owned by transport from now on
+  if(pc_transport_write(transport, pkg_buf.base, pkg_buf.len, pkg_size,
+                        pc__on_notify, req)) {
     goto error;
   }
 
-  write_req = (uv_write_t *)malloc(sizeof(uv_write_t));
-
-  if(write_req == NULL) {
-    goto error;
-  }
-
-  memset(write_req, 0, sizeof(uv_write_t));
-
-  // record notify context
-  data = (void **)malloc(sizeof(void *) * 2);
-  if(data == NULL) {
-    fprintf(stderr, "Fail to malloc void** for pc__request.\n");
-    goto error;
-  }
-
-  data[0] = (void *)req;
-  data[1] = pkg_buf.base;
-  write_req->data = (void *)data;
-
-  int res = uv_write(write_req, (uv_stream_t *)client->transport->socket,
-                     (uv_buf_t *)&pkg_buf, 1, pc__on_notify);
-
-  if(res == -1) {
-    fprintf(stderr, "Send message error %s\n",
-            uv_err_name(uv_last_error(client->uv_loop)));
-    goto error;
-  }
-
-  client->encode_msg_done(client, msg_buf);
-
   return;
 
 error:
-  if(msg_buf.len != -1) free(msg_buf.base);
-  if(pkg_buf.len != -1) free(pkg_buf.base);
-  if(write_req) free(write_req);
-  if(data) free(data);
+  if(pkg_buf.len != -1) pc__free(pkg_buf.base, pkg_size, PC_ALLOC_PACKAGE);
   req->cb(req, -1);
 }
 
-/**
- * Allocate buffer callback for uv_read_start.
- */
-static uv_buf_t pc__alloc_buffer(uv_handle_t *handle, size_t suggested_size) {
-  return uv_buf_init((char*) malloc(suggested_size), suggested_size);
-}
-
 /**
  * Tcp connection established callback.
  */
 static void pc__on_tcp_connect(uv_connect_t *req, int status) {
-  void **data = (void **)req->data;
-  pc_transport_t *transport = (pc_transport_t *)data[0];
-  pc_connect_t *conn_req = (pc_connect_t *)data[1];
+  pc__connect_ctx_t *ctx = (pc__connect_ctx_t *)req;
+  pc_transport_t *transport = ctx->transport;
+  pc_connect_t *conn_req = ctx->conn_req;
   pc_client_t *client = transport->client;
 
-  free(req);
-  free(data);
+  pc__free(ctx, sizeof(pc__connect_ctx_t), PC_ALLOC_HANDLE);
 
   pc_last_update_time = time(NULL);
 
@@ -415,7 +663,7 @@ static void pc__on_tcp_connect(uv_connect_t *req, int status) {
   client->transport = transport;
 
   // start the tcp reading until disconnect
-  if(uv_read_start((uv_stream_t*)transport->socket, pc__alloc_buffer,
+  if(uv_read_start((uv_stream_t*)transport->socket, pc_tp_alloc_buffer,
                    pc_tp_on_tcp_read)) {
     fprintf(stderr, "Fail to start reading server %s\n",
             uv_err_name(uv_last_error(client->uv_loop)));
@@ -452,9 +700,39 @@ error:
   conn_req->cb(conn_req, -1);
 }
 
+/**
+ * Encode the request on the sending thread, while the dictionary and the
+ * protos are kept from changing by the loop thread.
+ */
+static int pc__encode_on_caller(pc_client_t *client, pc_tcp_req_t *req) {
+  uint32_t id = 0;
+  pc_buf_t pkg_buf;
+  size_t pkg_size;
+
+  if(req->type == PC_REQUEST) {
+    id = pc__client_next_req_id(client);
+    ((pc_request_t *)req)->id = id;
+  }
+
+  uv_rwlock_rdlock(&client->encode_rwlock);
+  pkg_buf = pc__encode_package(client, id, req, &pkg_size);
+  uv_rwlock_rdunlock(&client->encode_rwlock);
+
+  if(pkg_buf.len == -1) {
+    fprintf(stderr, "Fail to encode package on caller: %s\n", req->route);
+    return -1;
+  }
+
+  // the body is copied into package
+  pc__tcp_req_release_body(req);
+  req->pkg = pkg_buf;
+  req->pkg_size = pkg_size;
+  return 0;
+}
+
 // Async write for pc_notify or pc_request may be invoked in other threads.
 static int pc__async_write(pc_transport_t *transport, pc_tcp_req_t *req,
-                           const char *route, json_t *msg) {
+                           const char *route, pc_route_t *handle, json_t *msg) {
   if (!transport) {
     fprintf(stderr, "Fail to async write for transport not initializing.\n");
     return -1;
@@ -466,194 +744,243 @@ static int pc__async_write(pc_transport_t *transport, pc_tcp_req_t *req,
     return -1;
   }
 
-  if(!req || !route /*|| !msg*/) {
+  if(!req || !(route || handle) /*|| !msg*/) {
     fprintf(stderr, "Invalid tcp request.\n");
     return -1;
   }
 
   pc_client_t *client = transport->client;
-  size_t route_len = strlen(route) + 1;
-  const char *cpy_route = NULL;
-  uv_async_t *async_req = NULL;
-  req->route = NULL;
 
-  cpy_route = (char *)malloc(route_len);
-  if(cpy_route == NULL) {
-    fprintf(stderr, "Fail to malloc for route string in pc__async_write.\n");
-    goto error;
+  if(handle) {
+    if(handle->client != client) {
+      fprintf(stderr, "Invalid route handle of other client: %s\n",
+              handle->route);
+      return -1;
+    }
+    // nothing to copy, the handle lives as long as client
+    pc__tcp_req_free_route(req);
+    req->route = handle->route;
+    req->route_handle = handle;
+  } else {
+    size_t route_len = strlen(route) + 1;
+    char *cpy_route = req->route_buf;
+
+    if(route_len > sizeof(req->route_buf)) {
+      cpy_route = (char *)pc__malloc(route_len, PC_ALLOC_REQUEST);
+      if(cpy_route == NULL) {
+        fprintf(stderr, "Fail to malloc for route string in pc__async_write.\n");
+        return -1;
+      }
+    }
+    // the route may be the one of last use of request
+    memmove(cpy_route, route, route_len);
+    if(req->route != cpy_route) {
+      pc__tcp_req_free_route(req);
+    }
+    req->route = cpy_route;
   }
-  memcpy((void *)cpy_route, route, route_len);
 
-  int async_inited = 0;
   req->client = client;
   req->transport = transport;
-  req->route = cpy_route;
   req->msg = msg;
+  req->pkg.base = NULL;
 
-  assert(IS_VALID_JSON(msg));
+  assert(req->codec || req->has_body || IS_VALID_JSON(msg));
 
-  async_req = (uv_async_t *)malloc(sizeof(uv_async_t));
-  if(async_req == NULL) {
-    fprintf(stderr, "Fail to malloc for async notify.\n");
-    goto error;
+  if(client->caller_encode && pc__encode_on_caller(client, req)) {
+    return -1;
   }
 
-  if(uv_async_init(client->uv_loop, async_req, pc__async_write_cb)) {
-    fprintf(stderr, "Fail to init async write tcp request, type: %d.\n",
-            req->type);
-    goto error;
+  // the write handle is closed by stop in the loop thread, which waits for
+  // the senders past the check of closed flag before closing it.
+  pc__atomic_add_long(&client->write_senders, 1);
+  if(pc__atomic_add_long(&client->write_closed, 0)) {
+    pc__atomic_add_long(&client->write_senders, -1);
+    fprintf(stderr, "Fail to async write for client closed.\n");
+    return -1;
   }
 
-  async_inited = 1;
+  // all the writes share the persistent async handle of client, and the
+  // wakeups would be merged by libuv under high request rates.
+  pc_mpsc_queue_push(&client->write_queue, &req->write_node);
+  if(client->poll_mode) {
+    pc__atomic_add_long(&client->write_senders, -1);
+    // the caller is the thread of loop, no wakeup needed
+    pc__client_flush_writes(client, 0);
+    return 0;
+  }
 
-  async_req->data = (void *)req;
-  if(uv_async_send(async_req)) {
+  if(uv_async_send(client->write_async)) {
     fprintf(stderr, "Fail to send async write tcp request, type: %d.\n",
             req->type);
-    goto error;
   }
+  pc__atomic_add_long(&client->write_senders, -1);
 
   return 0;
+}
 
-error:
-  if(req->route) {
-    free((void *)req->route);
-    req->route = NULL;
+static int pc__async_write_body(pc_transport_t *transport, pc_tcp_req_t *req,
+                                const char *route, pc_buf_t body, int own) {
+  if(body.base == NULL && body.len > 0) {
+    fprintf(stderr, "Invalid body of tcp request.\n");
+    return -1;
   }
-  if(async_inited) {
-    // should not release the async_req before close callback
-    uv_close((uv_handle_t *)async_req, pc__handle_close_cb);
-  } else {
-    if(async_req) free(async_req);
+
+  req->body = body;
+  req->has_body = 1;
+  req->own_body = own;
+  if(pc__async_write(transport, req, route, NULL, NULL)) {
+    // the body is still owned by caller
+    req->own_body = 0;
+    pc__tcp_req_release_body(req);
+    return -1;
   }
-  return -1;
+
+  return 0;
 }
 
-static void pc__async_write_cb(uv_async_t* req, int status) {
-  pc_tcp_req_t *tcp_req = (pc_tcp_req_t *)req->data;
-  uv_close((uv_handle_t *)req, pc__handle_close_cb);
-  assert(IS_VALID_JSON(tcp_req->msg)
-          && "Sorry to say an unrepairable bug of libpomelo has been triggered");
-  if(tcp_req->type == PC_NOTIFY) {
-    pc__notify((pc_notify_t *)tcp_req, status);
-  } else if(tcp_req->type == PC_REQUEST) {
-    pc__request((pc_request_t *)tcp_req, status);
-  } else {
-    fprintf(stderr, "Unknown tcp request type: %d\n", tcp_req->type);
-    // TDOO: should abort? How to free unknown tcp request
-    free(tcp_req);
-    return;
+void pc__async_write_cb(uv_async_t *handle, int status) {
+  pc__client_flush_writes((pc_client_t *)handle->data, status);
+}
+
+void pc__client_flush_writes(pc_client_t *client, int status) {
+  pc_mpsc_node_t *node;
+  pc_tcp_req_t *tcp_req;
+
+  while((node = pc_mpsc_queue_pop(&client->write_queue)) != NULL) {
+    tcp_req = (pc_tcp_req_t *)((char *)node - offsetof(pc_tcp_req_t, write_node));
+    assert((tcp_req->pkg.base || tcp_req->codec || tcp_req->has_body ||
+            IS_VALID_JSON(tcp_req->msg))
+            && "Sorry to say an unrepairable bug of libpomelo has been triggered");
+    if(tcp_req->type == PC_NOTIFY) {
+      pc__notify((pc_notify_t *)tcp_req, status);
+    } else if(tcp_req->type == PC_REQUEST) {
+      pc__request((pc_request_t *)tcp_req, status);
+    } else {
+      fprintf(stderr, "Unknown tcp request type: %d\n", tcp_req->type);
+      // TDOO: should abort? The request goes back to its pool at least
+      pc__free(tcp_req->pkg.base, tcp_req->pkg_size, PC_ALLOC_PACKAGE);
+      if(tcp_req->pool) {
+        pc_pool_put(tcp_req->pool, tcp_req);
+      } else {
+        pc__free(tcp_req, sizeof(pc_tcp_req_t), PC_ALLOC_REQUEST);
+      }
+    }
   }
 }
 
 /**
  * Request callback.
  */
-static void pc__on_request(uv_write_t *req, int status) {
-  void **data = (void **)req->data;
-  pc_request_t *request_req = (pc_request_t *)data[0];
-  pc_transport_t *transport = request_req->transport;
+static void pc__on_request(pc_transport_t *transport, void *data, int status) {
+  uint32_t id = (uint32_t)(uintptr_t)data;
   pc_client_t *client = transport->client;
-  char *base = (char *)data[1];
+  pc_request_t *request_req;
 
   pc_last_update_time = time(NULL);
-  free(base);
-  free(req);
-  free(data);
 
   if(PC_TP_ST_WORKING != transport->state) {
     fprintf(stderr, "Request error for transport not working.\n");
+    status = -1;
+  }
+
+  // the request may have been failed by the clear of request table or timed
+  // out already
+  if(status == -1 && client->requests &&
+     (request_req = pc_req_table_del(client->requests, id)) != NULL) {
+    pc__request_timer_stop(client, request_req);
     request_req->cb(request_req, -1, NULL);
+  }
+}
+
+/**
+ * Put the request into the timing wheel of client, and start the request
+ * timer for the first deadline.
+ */
+static void pc__request_timer_start(pc_client_t *client, pc_request_t *req) {
+  uint64_t now = uv_now(client->uv_loop);
+
+  if(client->req_wheel == NULL) {
+    client->req_wheel = (pc_timing_wheel_t *)pc__malloc(
+        sizeof(pc_timing_wheel_t), PC_ALLOC_REQUEST);
+    if(client->req_wheel == NULL) {
+      fprintf(stderr, "Fail to malloc for request timing wheel.\n");
+      return;
+    }
+    pc_wheel_init(client->req_wheel, now);
+  }
+
+  if(client->req_wheel->count == 0) {
+    // forget the ticks passed while the wheel is empty
+    client->req_wheel->tick = now / PC_WHEEL_TICK_MS;
+    uv_timer_start(client->req_timer, pc__request_timer_cb,
+                   PC_WHEEL_TICK_MS, PC_WHEEL_TICK_MS);
+  }
+
+  pc_wheel_add(client->req_wheel, &req->timer, now + req->timeout);
+}
+
+void pc__request_timer_stop(pc_client_t *client, pc_request_t *req) {
+  if(client->req_wheel == NULL) {
     return;
   }
 
-  if(status == -1) {
-    fprintf(stderr, "Request error %s\n",
-            uv_err_name(uv_last_error(client->uv_loop)));
-    char req_id_str[64];
-    memset(req_id_str, 0, 64);
-    sprintf(req_id_str, "%u", request_req->id);
+  pc_wheel_remove(client->req_wheel, &req->timer);
+  if(client->req_wheel->count == 0 && client->req_timer) {
+    uv_timer_stop(client->req_timer);
+  }
+}
+
+void pc__request_timer_cb(uv_timer_t *handle, int status) {
+  pc_client_t *client = (pc_client_t *)handle->data;
+  ngx_queue_t expired;
+  ngx_queue_t *q;
+  pc_request_t *req;
 
-    // clean request map
-    pc_map_del(client->requests, req_id_str);
+  ngx_queue_init(&expired);
+  pc_wheel_expire(client->req_wheel, uv_now(client->uv_loop), &expired);
 
-    request_req->cb(request_req, status, NULL);
+  if(client->req_wheel->count == 0) {
+    uv_timer_stop(handle);
   }
 
+  while(!ngx_queue_empty(&expired)) {
+    q = ngx_queue_head(&expired);
+    ngx_queue_remove(q);
+    req = ngx_queue_data(q, pc_request_t, timer.queue);
+
+    // a late response would find nothing in the table and be discarded
+    if(pc_req_table_del(client->requests, req->id)) {
+      req->cb(req, PC_REQ_TIMEOUT, NULL);
+    }
+  }
 }
 
 /**
  * Notify callback.
  */
-static void pc__on_notify(uv_write_t *req, int status) {
-  void **data = (void **)req->data;
-  pc_notify_t *notify_req = (pc_notify_t *)data[0];
-  pc_transport_t *transport = notify_req->transport;
-  pc_client_t *client = transport->client;
-  char *base = (char *)data[1];
+static void pc__on_notify(pc_transport_t *transport, void *data, int status) {
+  pc_notify_t *notify_req = (pc_notify_t *)data;
 
   pc_last_update_time = time(NULL);
 
-  free(base);
-  free(req);
-  free(data);
-
   if(PC_TP_ST_WORKING != transport->state) {
     fprintf(stderr, "Notify error for transport not working.\n");
     notify_req->cb(notify_req, -1);
     return;
   }
 
-  if(status == -1) {
-    fprintf(stderr, "Notify error %s\n",
-            uv_err_name(uv_last_error(client->uv_loop)));
-  }
-
   notify_req->cb(notify_req, status);
 }
 
 int pc__binary_write(pc_client_t *client, const char *data, size_t len,
-                            uv_write_cb cb) {
+                     pc_frame_cb cb) {
   if(PC_ST_CONNECTED != client->state && PC_ST_WORKING != client->state) {
     fprintf(stderr, "Fail to write binary for invalid client state: %d.\n",
             client->state);
     return -1;
   }
 
-  uv_write_t *req = NULL;
-  void **attach = NULL;
-
-  req = (uv_write_t *)malloc(sizeof(uv_write_t));
-  if(req == NULL) {
-    fprintf(stderr, "Fail to malloc for uv_write_t.\n");
-    goto error;
-  }
-
-  memset(req, 0, sizeof(uv_write_t));
-
-  attach = (void **)malloc(sizeof(void *) * 2);
-  if(data == NULL) {
-    fprintf(stderr, "Fail to malloc data for handshake ack.\n");
-    goto error;
-  }
-
-  attach[0] = client->transport;
-  attach[1] = (void *)data;
-  req->data = (void *)attach;
-
-  uv_buf_t buf;
-  buf.base = (char *)data;
-  buf.len = len;
-
-  if(uv_write(req, (uv_stream_t *)client->transport->socket, &buf, 1, cb)) {
-    fprintf(stderr, "Fail to write handshake ack pakcage, %s\n",
-            uv_err_name(uv_last_error(client->uv_loop)));
-    goto error;
-  }
-
-  return 0;
-error:
-  if(req) free(req);
-  if(attach) free(attach);
-  return -1;
+  return pc_transport_write(client->transport, (char *)data, len, len, cb,
+                            client);
 }
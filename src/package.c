@@ -3,15 +3,19 @@
 #include <string.h>
 #include "pomelo-private/internal.h"
 #include "pomelo-private/common.h"
+#include "pomelo-private/alloc.h"
 #include "pomelo-protocol/package.h"
 
 static size_t pc__pkg_head(pc_pkg_parser_t *parser,
                            const char *data, size_t offset, size_t nread);
 static size_t pc__pkg_body(pc_pkg_parser_t *parser,
                            const char *data, size_t offset, size_t nread);
+static size_t pc__pkg_whole(pc_pkg_parser_t *parser,
+                            const char *data, size_t offset, size_t nread);
 
 pc_pkg_parser_t *pc_pkg_parser_new(pc_pkg_cb cb, void *attach) {
-  pc_pkg_parser_t *parser = (pc_pkg_parser_t *)malloc(sizeof(pc_pkg_parser_t));
+  pc_pkg_parser_t *parser =
+      (pc_pkg_parser_t *)pc__malloc(sizeof(pc_pkg_parser_t), PC_ALLOC_PACKAGE);
   if(parser == NULL) {
     fprintf(stderr, "Fail to malloc for pc_pkg_parser_t.\n");
     return NULL;
@@ -20,7 +24,7 @@ pc_pkg_parser_t *pc_pkg_parser_new(pc_pkg_cb cb, void *attach) {
   memset(parser, 0, sizeof(pc_pkg_parser_t));
 
   if(pc_pkg_parser_init(parser, cb, attach)) {
-    free(parser);
+    pc__free(parser, sizeof(pc_pkg_parser_t), PC_ALLOC_PACKAGE);
     return NULL;
   }
 
@@ -41,7 +45,7 @@ int pc_pkg_parser_init(pc_pkg_parser_t *parser, pc_pkg_cb cb, void *attach) {
 
 void pc_pkg_parser_destroy(pc_pkg_parser_t *parser) {
   pc_pkg_parser_close(parser);
-  free(parser);
+  pc__free(parser, sizeof(pc_pkg_parser_t), PC_ALLOC_PACKAGE);
 }
 
 void pc_pkg_parser_close(pc_pkg_parser_t *parser) {
@@ -51,9 +55,7 @@ void pc_pkg_parser_close(pc_pkg_parser_t *parser) {
 
   parser->state = PC_PKG_CLOSED;
 
-  if(parser->pkg_buf) {
-    free(parser->pkg_buf);
-  }
+  pc__free(parser->pkg_buf, parser->pkg_size, PC_ALLOC_PACKAGE);
 }
 
 void pc_pkg_parser_reset(pc_pkg_parser_t *parser) {
@@ -62,9 +64,7 @@ void pc_pkg_parser_reset(pc_pkg_parser_t *parser) {
   }
 
   parser->head_offset = 0;
-  if(parser->pkg_buf) {
-    free(parser->pkg_buf);
-  }
+  pc__free(parser->pkg_buf, parser->pkg_size, PC_ALLOC_PACKAGE);
   parser->pkg_buf = NULL;
   parser->pkg_offset = 0;
   parser->pkg_size = 0;
@@ -75,6 +75,13 @@ int pc_pkg_parser_feed(pc_pkg_parser_t *parser, const char *data, size_t nread)
   size_t offset = 0;
 
   while(offset < nread) {
+    if(parser->state == PC_PKG_HEAD && parser->head_offset == 0) {
+      offset = pc__pkg_whole(parser, data, offset, nread);
+      if(offset >= nread) {
+        break;
+      }
+    }
+
     if(parser->state == PC_PKG_HEAD) {
       offset = pc__pkg_head(parser, data, offset, nread);
       if(offset == -1) {
@@ -113,7 +120,7 @@ pc_buf_t pc_pkg_encode(pc_pkg_type type, const char *data, size_t len) {
   }
 
   size_t size = PC_PKG_HEAD_BYTES + len;
-  buf.base = (char *)malloc(size);
+  buf.base = (char *)pc__malloc(size, PC_ALLOC_PACKAGE);
   if(buf.base == NULL) {
     fprintf(stderr, "Fail to malloc for Pomelo package, size: %lu.\n", size);
     buf.len = -1;
@@ -170,16 +177,7 @@ static size_t pc__pkg_head(pc_pkg_parser_t *parser,
       pkg_len += parser->head_buf[i] & 0xff;
     }
 
-    if(pkg_len > 0) {
-      parser->pkg_buf = (char *)malloc(pkg_len);
-      if(parser->pkg_buf == NULL) {
-        fprintf(stderr, "Fail to malloc buffer for package size: %lu\n", pkg_len);
-        return -1;
-      }
-
-      memset(parser->pkg_buf, 0, pkg_len);
-    }
-
+    // body buffer is allocated only if the body is split across reads
     parser->pkg_offset = 0;
     parser->pkg_size = pkg_len;
     parser->state = PC_PKG_BODY;
@@ -188,6 +186,38 @@ static size_t pc__pkg_head(pc_pkg_parser_t *parser,
   return offset + len;
 }
 
+/**
+ * Hand up the packages which sit in data buffer entirely as views without
+ * copy, and stop at the first package split across reads.
+ *
+ * @param  parser package parser instance
+ * @param  data   data buffer
+ * @param  offset offset of data buffer
+ * @return        new offset of data buffer
+ */
+static size_t pc__pkg_whole(pc_pkg_parser_t *parser,
+                            const char *data, size_t offset, size_t nread) {
+  size_t pkg_len;
+
+  while(nread - offset >= PC_PKG_HEAD_BYTES &&
+        parser->state == PC_PKG_HEAD) {
+    pkg_len = ((data[offset + 1] & 0xff) << 16) |
+              ((data[offset + 2] & 0xff) << 8) |
+              (data[offset + 3] & 0xff);
+
+    if(nread - offset - PC_PKG_HEAD_BYTES < pkg_len) {
+      break;
+    }
+
+    parser->cb((pc_pkg_type)pc__pkg_type((data + offset)),
+               pkg_len ? data + offset + PC_PKG_HEAD_BYTES : NULL,
+               pkg_len, parser->attach);
+    offset += PC_PKG_HEAD_BYTES + pkg_len;
+  }
+
+  return offset;
+}
+
 /**
  * Read package body from data buffer.
  *
@@ -202,6 +232,23 @@ static size_t pc__pkg_body(pc_pkg_parser_t *parser,
   size_t data_len = nread - offset;
   size_t len = MIN(need_len, data_len);
 
+  if(parser->pkg_offset == 0 && data_len >= need_len) {
+    // the whole body is in data, hand it up as a view
+    parser->cb((pc_pkg_type)pc__pkg_type(parser->head_buf),
+               need_len ? data + offset : NULL, need_len, parser->attach);
+    pc_pkg_parser_reset(parser);
+    return offset + len;
+  }
+
+  if(parser->pkg_buf == NULL) {
+    parser->pkg_buf = (char *)pc__malloc(parser->pkg_size, PC_ALLOC_PACKAGE);
+    if(parser->pkg_buf == NULL) {
+      fprintf(stderr, "Fail to malloc buffer for package size: %lu\n",
+              parser->pkg_size);
+      return -1;
+    }
+  }
+
   if(len > 0) {
     memcpy(parser->pkg_buf + parser->pkg_offset, data + offset, len);
     parser->pkg_offset += len;
@@ -16,6 +16,7 @@
 #define PB_INTERNALS
 #include "pomelo-protobuf/pb.h"
 #include "pomelo-protobuf/pb-util.h"
+#include "pomelo-private/alloc.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -45,7 +46,7 @@ struct _pb_istream_t {
 #endif
 };
 
-static int pb_decode(pb_istream_t *stream, const json_t *gprotos, const json_t *protos, json_t *result);
+static int pb_decode(pb_istream_t *stream, const pc_pb_message_t *protos, json_t *result);
 
 static pb_istream_t pb_istream_from_buffer(uint8_t *buf, size_t bufsize);
 static int pb_read(pb_istream_t *stream, uint8_t *buf, size_t count);
@@ -54,9 +55,9 @@ static int pb_read(pb_istream_t *stream, uint8_t *buf, size_t count);
 /* --- Helper functions ---
  * You may want to use these from your caller or callbacks.
  */
-static int pb_decode_proto(pb_istream_t *stream, const json_t *gprotos, const json_t *proto, const json_t *protos, const char *key, json_t *result);
+static int pb_decode_proto(pb_istream_t *stream, const pc_pb_field_t *proto, const char *key, json_t *result);
 
-static int pb_decode_array(pb_istream_t *stream, const json_t *gprotos, const json_t *proto, const json_t *protos, const char *key, json_t *result);
+static int pb_decode_array(pb_istream_t *stream, const pc_pb_field_t *proto, json_t *result);
 
 /* Decode the tag for the next field in the stream. Gives the wire type and
  * field tag. At end of the message, returns 0 and sets eof to 1. */
@@ -68,6 +69,15 @@ static int pb_decode_varint(pb_istream_t *stream, uint64_t *dest);
 
 static int pb_decode_varint32(pb_istream_t *stream, uint32_t *dest);
 
+/* Decode a varint right from the memory of a buffer stream, without a read
+ * callback per byte. */
+static int pb_decode_varint_buf(pb_istream_t *stream, uint64_t *dest);
+
+/* Decode count packed numbers of a repeated field from a buffer stream into
+ * array in one loop. */
+static int pb_decode_packed_buf(pb_istream_t *stream, const pc_pb_field_t *proto,
+                                uint32_t count, json_t *array);
+
 /* Decode an integer in the zig-zagged svarint format. This works for sint32
  * and sint64. */
 static int pb_decode_svarint(pb_istream_t *stream, int64_t *dest);
@@ -89,12 +99,51 @@ static int checkreturn pb_decode_strlen(pb_istream_t *stream, uint32_t *size);
 static int pb_decode_string(pb_istream_t *stream, void *dest, uint32_t size);
 
 /* Decode submessage in __messages protos */
-static int pb_decode_submessage(pb_istream_t *stream, const json_t *gprotos, const json_t *protos, void *dest);
+static int pb_decode_submessage(pb_istream_t *stream, const pc_pb_message_t *protos, void *dest);
 
 int pc_pb_decode(uint8_t *buf, size_t len, const json_t *gprotos, const json_t *protos,
                  json_t *result) {
+    pc_pb_cache_t *cache;
+    const pc_pb_message_t *proto;
+    int res;
+
+    /* compiled once for the gprotos, see pc_pb_cache_get */
+    proto = pc_pb_cache_get(gprotos, protos, &cache);
+    if (proto == NULL) {
+        return 0;
+    }
+    res = pc_pb_decode_message(buf, len, proto, result);
+    pc_pb_cache_release(cache);
+    return res;
+}
+
+int pc_pb_decode_message(uint8_t *buf, size_t len, const pc_pb_message_t *proto,
+                         json_t *result) {
     pb_istream_t stream = pb_istream_from_buffer(buf, len);
-    if (!pb_decode(&stream, gprotos, protos, result)) {
+    if (!pb_decode(&stream, proto, result)) {
+        fprintf(stderr, "decode error\n");
+        return 0;
+    }
+    return 1;
+}
+
+/* same as buf_read, but keeps the decoder off the buffer fast path */
+static int checkreturn stream_read(pb_istream_t *stream, uint8_t *buf,
+                                   size_t count) {
+    uint8_t *source = (uint8_t *) stream->state;
+
+    if (buf != NULL )
+        memcpy(buf, source, count);
+
+    stream->state = source + count;
+    return 1;
+}
+
+int pc_pb_decode_message_stream(uint8_t *buf, size_t len,
+                                const pc_pb_message_t *proto, json_t *result) {
+    pb_istream_t stream = pb_istream_from_buffer(buf, len);
+    stream.callback = stream_read;
+    if (!pb_decode(&stream, proto, result)) {
         fprintf(stderr, "decode error\n");
         return 0;
     }
@@ -155,18 +204,14 @@ static pb_istream_t pb_istream_from_buffer(uint8_t *buf, size_t bufsize) {
  * Decode a single field *
  *************************/
 
-static int checkreturn pb_decode_proto(pb_istream_t *stream, const json_t *gprotos, const json_t *proto,
-                                       const json_t *protos, const char *key, json_t *result) {
-    json_t *type, *_messages, *sub_msg, *sub_value;
-    const char *type_text;
+static int checkreturn pb_decode_proto(pb_istream_t *stream, const pc_pb_field_t *proto,
+                                       const char *key, json_t *result) {
+    json_t *sub_value;
 
 #ifdef PB_DEBUG
     char* debug_log = NULL;
 #endif
 
-    type = json_object_get(proto, "type");
-    type_text = json_string_value(type);
-
     uint64_t int_value;
     int64_t sint_value;
     float float_value;
@@ -181,8 +226,7 @@ static int checkreturn pb_decode_proto(pb_istream_t *stream, const json_t *gprot
     debug_log = NULL;
 #endif
 
-    _messages = json_object_get(protos, "__messages");
-    switch (pb__get_type(type_text)) {
+    switch (proto->type) {
     case PB_uInt32:
         if (!pb_decode_varint(stream, &int_value)) {
             return 0;
@@ -228,13 +272,12 @@ static int checkreturn pb_decode_proto(pb_istream_t *stream, const json_t *gprot
         if (!pb_decode_strlen(stream, &str_len)) {
             return 0;
         }
-        str_value = (char *)malloc(str_len + 1);
+        str_value = (char *)pc__malloc(str_len + 1, PC_ALLOC_PROTOBUF);
         if (str_value == NULL) {
-            free(str_value);
             return 0;
         }
         if (!pb_decode_string(stream, str_value, str_len)) {
-            free(str_value);
+            pc__free(str_value, str_len + 1, PC_ALLOC_PROTOBUF);
             return 0;
         }
         if (json_is_object(result)) {
@@ -242,49 +285,35 @@ static int checkreturn pb_decode_proto(pb_istream_t *stream, const json_t *gprot
         } else {
             json_array_append_new(result, json_string(str_value));
         }
-        free(str_value);
+        pc__free(str_value, str_len + 1, PC_ALLOC_PROTOBUF);
         break;
     default:
-        if (_messages) {
-            sub_msg = json_object_get(_messages, type_text);
-            if (!sub_msg) {
-                const char *head = "message ";
-                size_t len = strlen(head) + strlen(type_text) + 1;
-                char *head_text = (char *)malloc(len);
-                memset(head_text, 0, len);
-                strcpy(head_text, head);
-                strcat(head_text, type_text);
-                // check root msg in gprotos
-                sub_msg = json_object_get(gprotos, head_text);
-                free(head_text);
+        // sub message resolved at compile time
+        if (proto->message == NULL) {
+            return 0;
+        }
+        if (!key) {
+            if (!pb_decode_submessage(stream, proto->message, result)) {
+                return 0;
             }
-
-            if (sub_msg) {
-                if (!key) {
-                    if (!pb_decode_submessage(stream, gprotos, sub_msg, result)) {
-                        return 0;
-                    }
-                } else {
-                    sub_value = json_object();
-                    if (!pb_decode_submessage(stream, gprotos, sub_msg, sub_value)) {
-                        return 0;
-                    }
-                    json_object_set(result, key, sub_value);
-                    json_decref(sub_value);
-                }
-            } else {
+        } else {
+            sub_value = json_object();
+            if (!pb_decode_submessage(stream, proto->message, sub_value)) {
+                json_decref(sub_value);
                 return 0;
             }
+            json_object_set(result, key, sub_value);
+            json_decref(sub_value);
         }
 
     }
     return 1;
 }
 
-static int checkreturn pb_decode_array(pb_istream_t *stream, const json_t *gprotos, const json_t *proto, const json_t *protos,
-                                       const char *key, json_t *result) {
-    json_t *type, *array, *value;
-    const char *type_text;
+static int checkreturn pb_decode_array(pb_istream_t *stream, const pc_pb_field_t *proto,
+                                       json_t *result) {
+    json_t *array, *value;
+    const char *key = proto->name;
     uint32_t size;
     int i;
     int need_decref = 0;
@@ -293,48 +322,46 @@ static int checkreturn pb_decode_array(pb_istream_t *stream, const json_t *gprot
     char* debug_log = NULL;
 #endif
 
-    type = json_object_get(proto, "type");
-    type_text = json_string_value(type);
     if (!result) {
         fprintf(stderr, "error result is null pb_decode_array\n");
         return 0;
     }
     array = json_object_get(result, key);
 
-#ifdef PB_DEBUG
-    debug_log = json_dumps(proto, JSON_ENCODE_ANY);
-    fprintf(stderr, "proto %s\n", debug_log);
-    jsonp_free(debug_log);
-    debug_log = NULL;
-#endif
-
     if (!array) {
         array = json_array();
         need_decref = 1;
     }
 
-    if (pb__get_type(type_text) && pb__get_type(type_text) != PB_string) {
+    if (proto->packed && stream->callback == &buf_read) {
+        if (!pb_decode_varint32(stream, &size)
+                || !pb_decode_packed_buf(stream, proto, size, array)) {
+            if (need_decref)
+                json_decref(array);
+            return 0;
+        }
+    } else if (proto->packed) {
         if (!pb_decode_varint32(stream, &size)) {
             if (need_decref)
                 json_decref(array);
             return 0;
         }
         for (i = 0; i < size; i++) {
-            if (!pb_decode_proto(stream, gprotos, proto, protos, key, array)) {
+            if (!pb_decode_proto(stream, proto, key, array)) {
                 if (need_decref)
                     json_decref(array);
                 return 0;
             }
         }
-    } else if (pb__get_type(type_text) && pb__get_type(type_text) == PB_string) {
-        if (!pb_decode_proto(stream, gprotos, proto, protos, key, array)) {
+    } else if (proto->type == PB_string) {
+        if (!pb_decode_proto(stream, proto, key, array)) {
             if (need_decref)
                 json_decref(array);
             return 0;
         }
     } else {
         value = json_object();
-        if (!pb_decode_proto(stream, gprotos, proto, protos, NULL, value)) {
+        if (!pb_decode_proto(stream, proto, NULL, value)) {
             json_decref(value);
             if (need_decref)
                 json_decref(array);
@@ -362,43 +389,28 @@ static int checkreturn pb_decode_array(pb_istream_t *stream, const json_t *gprot
  * Decode all fields *
  *********************/
 
-static int checkreturn pb_decode(pb_istream_t *stream, const json_t *gprotos,
-                                 const json_t *protos, json_t *result) {
+static int checkreturn pb_decode(pb_istream_t *stream, const pc_pb_message_t *protos,
+                                 json_t *result) {
     while (stream->bytes_left) {
         uint32_t tag;
         int wire_type;
         int eof;
-        json_t *tags, *_tag, *option, *proto;
-        const char *name;
-        const char *option_text;
+        const pc_pb_field_t *proto;
         if (!pb_decode_tag(stream, &wire_type, &tag, &eof)) {
             if (eof)
                 break;
             else
                 return 0;
         }
-        char buffer[64];
-        memset(&buffer, 0, 64);
-        tags = json_object_get(protos, "__tags");
-        if (!tags)
-            return 0;
-
-        sprintf(buffer, "%u", tag);
-        _tag = json_object_get(tags, buffer);
-        if (!_tag)
-            return 0;
-        name = json_string_value(_tag);
-        proto = json_object_get(protos, name);
+        proto = pc_pb_field_by_tag(protos, tag);
         if (!proto)
             return 0;
-        option = json_object_get(proto, "option");
-        option_text = json_string_value(option);
-        if (strcmp(option_text, "optional") == 0
-                || strcmp(option_text, "required") == 0) {
-            if (!pb_decode_proto(stream, gprotos, proto, protos, name, result))
+        if (proto->option == PB_optional
+                || proto->option == PB_required) {
+            if (!pb_decode_proto(stream, proto, proto->name, result))
                 return 0;
-        } else if (strcmp(option_text, "repeated") == 0) {
-            if (!pb_decode_array(stream, gprotos, proto, protos, name, result))
+        } else if (proto->option == PB_repeated) {
+            if (!pb_decode_array(stream, proto, result))
                 return 0;
         }
     }
@@ -428,6 +440,10 @@ static int checkreturn pb_decode_varint32(pb_istream_t *stream, uint32_t *dest)
 int checkreturn pb_decode_varint(pb_istream_t *stream, uint64_t *dest) {
     uint8_t byte;
     int bitpos = 0;
+
+    if (stream->callback == &buf_read)
+        return pb_decode_varint_buf(stream, dest);
+
     *dest = 0;
 
     while (bitpos < 64 && pb_read(stream, &byte, 1)) {
@@ -441,6 +457,111 @@ int checkreturn pb_decode_varint(pb_istream_t *stream, uint64_t *dest) {
     PB_RETURN_ERROR(stream, "varint overflow");
 }
 
+/* One byte of the unrolled varint decoding: add the byte in place and take
+ * the continuation bit off again if set, no shift and mask of each byte. */
+#define PB_VARINT_BYTE(n) \
+    b = p[n]; \
+    v += (uint64_t)b << (7 * (n)); \
+    if (b < 0x80) { \
+        len = (n) + 1; \
+        goto done; \
+    } \
+    v -= (uint64_t)0x80 << (7 * (n));
+
+static int checkreturn pb_decode_varint_buf(pb_istream_t *stream, uint64_t *dest) {
+    const uint8_t *p = (const uint8_t *) stream->state;
+    size_t len = 0;
+    uint64_t v = 0;
+    uint8_t b;
+
+    if (stream->bytes_left >= 10) {
+        /* no bounds check for the longest varint */
+        PB_VARINT_BYTE(0)
+        PB_VARINT_BYTE(1)
+        PB_VARINT_BYTE(2)
+        PB_VARINT_BYTE(3)
+        PB_VARINT_BYTE(4)
+        PB_VARINT_BYTE(5)
+        PB_VARINT_BYTE(6)
+        PB_VARINT_BYTE(7)
+        PB_VARINT_BYTE(8)
+        PB_VARINT_BYTE(9)
+        PB_RETURN_ERROR(stream, "varint overflow");
+    }
+
+    while (len < stream->bytes_left && len < 10) {
+        b = p[len];
+        v |= (uint64_t)(b & 0x7F) << (7 * len);
+        len++;
+        if (!(b & 0x80))
+            goto done;
+    }
+
+    if (len == stream->bytes_left)
+        PB_RETURN_ERROR(stream, "end-of-stream");
+    PB_RETURN_ERROR(stream, "varint overflow");
+
+done:
+    stream->state = (uint8_t *) p + len;
+    stream->bytes_left -= len;
+    *dest = v;
+    return 1;
+}
+
+#undef PB_VARINT_BYTE
+
+static int checkreturn pb_decode_packed_buf(pb_istream_t *stream, const pc_pb_field_t *proto,
+                                            uint32_t count, json_t *array) {
+    uint64_t value;
+    uint8_t *p;
+    uint32_t i;
+    size_t width = proto->type == PB_float ? 4 : 8;
+    union {
+        float f;
+        double d;
+        uint8_t bytes[8];
+    } fixed;
+
+    for (i = 0; i < count; i++) {
+        switch (proto->type) {
+        case PB_uInt32:
+            if (!pb_decode_varint_buf(stream, &value))
+                return 0;
+            json_array_append_new(array, json_integer(value));
+            break;
+        case PB_int32:
+        case PB_sInt32:
+            if (!pb_decode_varint_buf(stream, &value))
+                return 0;
+            json_array_append_new(array, json_integer(value & 1 ?
+                                  (int64_t) (~(value >> 1)) : (int64_t) (value >> 1)));
+            break;
+        case PB_float:
+        case PB_double:
+            if (stream->bytes_left < width)
+                PB_RETURN_ERROR(stream, "end-of-stream");
+            p = (uint8_t *) stream->state;
+#ifdef __BIG_ENDIAN__
+            {
+                size_t j;
+                for (j = 0; j < width; j++)
+                    fixed.bytes[j] = p[width - 1 - j];
+            }
+#else
+            memcpy(fixed.bytes, p, width);
+#endif
+            stream->state = p + width;
+            stream->bytes_left -= width;
+            json_array_append_new(array, json_real(width == 4 ? fixed.f : fixed.d));
+            break;
+        default:
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
 /* Decode an integer in the zig-zagged svarint format. This works for sint32
  * and sint64. */
 static int pb_decode_svarint(pb_istream_t *stream, int64_t *dest) {
@@ -564,7 +685,7 @@ static void pb_close_string_substream(pb_istream_t *stream, pb_istream_t *substr
 }
 
 /* Decode submessage in __messages protos */
-static int pb_decode_submessage(pb_istream_t *stream, const json_t *gprotos, const json_t *protos,
+static int pb_decode_submessage(pb_istream_t *stream, const pc_pb_message_t *protos,
                                 void *dest) {
     int status;
     pb_istream_t substream;
@@ -574,7 +695,7 @@ static int pb_decode_submessage(pb_istream_t *stream, const json_t *gprotos, con
     }
     /* New array entries need to be initialized, while required and optional
      * submessages have already been initialized in the top-level pb_decode. */
-    status = pb_decode(&substream, gprotos, protos, (json_t *)dest);
+    status = pb_decode(&substream, protos, (json_t *)dest);
 
     pb_close_string_substream(stream, &substream);
     return status;
@@ -8,7 +8,9 @@
 //#define __BIG_ENDIAN__
 #include "pomelo-protobuf/pb.h"
 #include "pomelo-protobuf/pb-util.h"
+#include "pomelo-private/alloc.h"
 #include <string.h>
+#include <stdlib.h>
 
 /* The warn_unused_result attribute appeared first in gcc-3.4.0 */
 #if !defined(__GNUC__) || ( __GNUC__ < 3) || (__GNUC__ == 3 && __GNUC_MINOR__ < 4)
@@ -42,9 +44,10 @@ struct _pb_ostream_t {
     void *state; /* Free field for use by callback implementation */
     size_t max_size; /* Limit number of output bytes written (or use SIZE_MAX). */
     size_t bytes_written;
+    pc_pb_sizes_t *sizes; /* Sub message sizes, recorded if callback is NULL */
 };
 
-static int pb_encode(pb_ostream_t *stream, const json_t *gprotos, const json_t *protos, json_t *msg);
+static int pb_encode(pb_ostream_t *stream, const pc_pb_message_t *protos, json_t *msg);
 
 static pb_ostream_t pb_ostream_from_buffer(uint8_t *buf, size_t bufsize);
 static int pb_write(pb_ostream_t *stream, const uint8_t *buf, size_t count);
@@ -54,16 +57,12 @@ static int pb_write(pb_ostream_t *stream, const uint8_t *buf, size_t count);
  * You may want to use these from your caller or callbacks.
  */
 
-static int pb_encode_proto(pb_ostream_t *stream, const json_t *gprotos, const json_t *protos, const json_t *proto, json_t *value);
+static int pb_encode_proto(pb_ostream_t *stream, const pc_pb_field_t *proto, json_t *value);
 
-static int pb_encode_array(pb_ostream_t *stream, const json_t *gprotos, const json_t *protos, const json_t *proto, json_t *array);
+static int pb_encode_array(pb_ostream_t *stream, const pc_pb_field_t *proto, json_t *array);
 /* Encode field header based on LTYPE and field number defined in the field structure.
  * Call this from the callback before writing out field contents. */
-static int pb_encode_tag_for_field(pb_ostream_t *stream, const json_t *field);
-
-/* Encode field header by manually specifing wire type. You need to use this if
- * you want to write out packed arrays from a callback field. */
-static int pb_encode_tag(pb_ostream_t *stream, int wiretype, uint32_t field_number);
+static int pb_encode_tag_for_field(pb_ostream_t *stream, const pc_pb_field_t *field);
 
 /* Encode an integer in the varint format.
  * This works for int, enum, int32, int64, uint32 and uint64 field types. */
@@ -85,16 +84,103 @@ static int pb_encode_fixed32(pb_ostream_t *stream, const void *value);
 static int pb_encode_fixed64(pb_ostream_t *stream, const void *value);
 
 /* Eecode submessage in __messages protos */
-static int pb_encode_submessage(pb_ostream_t *stream, const json_t *gprotos, const json_t *protos, json_t *value);
+static int pb_encode_submessage(pb_ostream_t *stream, const pc_pb_message_t *protos, json_t *value);
 /* pb_ostream_t implementation */
 
 int pc_pb_encode(uint8_t *buf, size_t len, size_t *written, const json_t *gprotos, const json_t *protos, json_t *msg) {
-    pb_ostream_t stream = pb_ostream_from_buffer(buf, len);
-    if (!pb_encode(&stream, gprotos, protos, msg)) {
+    pc_pb_cache_t *cache;
+    const pc_pb_message_t *proto;
+    int res;
+
+    /* compiled once for the gprotos, see pc_pb_cache_get */
+    proto = pc_pb_cache_get(gprotos, protos, &cache);
+    if (proto == NULL) {
+        return 0;
+    }
+    res = pc_pb_encode_message(buf, len, written, proto, msg);
+    pc_pb_cache_release(cache);
+    return res;
+}
+
+int pc_pb_encode_message(uint8_t *buf, size_t len, size_t *written,
+                         const pc_pb_message_t *proto, json_t *msg) {
+    pc_pb_sizes_t sizes;
+    size_t size;
+    int res = 0;
+
+    pc_pb_sizes_init(&sizes);
+    if (pc_pb_message_size(proto, msg, &sizes, &size)) {
+        if (size <= len) {
+            res = pc_pb_encode_sized(buf, size, proto, msg, &sizes);
+            *written = size;
+        } else {
+            fprintf(stderr, "pb_encode buffer too small\n");
+        }
+    }
+    pc_pb_sizes_close(&sizes);
+    return res;
+}
+
+void pc_pb_sizes_init(pc_pb_sizes_t *sizes) {
+    sizes->items = sizes->inline_items;
+    sizes->len = 0;
+    sizes->cap = PC_PB_INLINE_SIZES;
+    sizes->next = 0;
+}
+
+void pc_pb_sizes_close(pc_pb_sizes_t *sizes) {
+    if (sizes->items != sizes->inline_items) {
+        pc__free(sizes->items, sizeof(size_t) * sizes->cap, PC_ALLOC_PROTOBUF);
+    }
+    pc_pb_sizes_init(sizes);
+}
+
+static int pb_sizes_reserve(pc_pb_sizes_t *sizes, size_t *slot) {
+    size_t *items;
+
+    if (sizes->len == sizes->cap) {
+        items = (size_t *)pc__malloc(sizeof(size_t) * sizes->cap * 2,
+                                      PC_ALLOC_PROTOBUF);
+        if (items == NULL) {
+            fprintf(stderr, "Fail to malloc for protobuf sizes.\n");
+            return 0;
+        }
+        memcpy(items, sizes->items, sizeof(size_t) * sizes->len);
+        if (sizes->items != sizes->inline_items) {
+            pc__free(sizes->items, sizeof(size_t) * sizes->cap,
+                     PC_ALLOC_PROTOBUF);
+        }
+        sizes->items = items;
+        sizes->cap *= 2;
+    }
+
+    *slot = sizes->len++;
+    return 1;
+}
+
+int pc_pb_message_size(const pc_pb_message_t *proto, json_t *msg,
+                       pc_pb_sizes_t *sizes, size_t *size) {
+    pb_ostream_t stream = { 0, 0, 0, 0, 0 };
+
+    stream.sizes = sizes;
+    if (!pb_encode(&stream, proto, msg)) {
+        fprintf(stderr, "pb_encode sizing error\n");
+        return 0;
+    }
+    *size = stream.bytes_written;
+    return 1;
+}
+
+int pc_pb_encode_sized(uint8_t *buf, size_t size, const pc_pb_message_t *proto,
+                       json_t *msg, pc_pb_sizes_t *sizes) {
+    pb_ostream_t stream = pb_ostream_from_buffer(buf, size);
+
+    stream.sizes = sizes;
+    sizes->next = 0;
+    if (!pb_encode(&stream, proto, msg) || stream.bytes_written != size) {
         fprintf(stderr, "pb_encode error\n");
         return 0;
     }
-    *written = stream.bytes_written;
     return 1;
 }
 
@@ -112,6 +198,7 @@ static pb_ostream_t pb_ostream_from_buffer(uint8_t *buf, size_t bufsize) {
     stream.state = buf;
     stream.max_size = bufsize;
     stream.bytes_written = 0;
+    stream.sizes = NULL;
     return stream;
 }
 
@@ -131,14 +218,12 @@ static int checkreturn pb_write(pb_ostream_t *stream, const uint8_t *buf,
 
 /* Main encoding stuff */
 
-static int checkreturn pb_encode_array(pb_ostream_t *stream, const json_t *gprotos, const json_t *protos,
-                                       const json_t *proto, json_t *array) {
-    json_t *type = json_object_get(proto, "type");
-    const char *type_text = json_string_value(type);
+static int checkreturn pb_encode_array(pb_ostream_t *stream, const pc_pb_field_t *proto,
+                                       json_t *array) {
     size_t len = json_array_size(array);
     size_t i;
     // simple msg
-    if (pb__get_type(type_text) && pb__get_type(type_text) != PB_string) {
+    if (proto->packed) {
         if (!pb_encode_tag_for_field(stream, proto)) {
             return 0;
         }
@@ -147,8 +232,7 @@ static int checkreturn pb_encode_array(pb_ostream_t *stream, const json_t *gprot
             return 0;
         }
         for (i = 0; i < len; i++) {
-            if (!pb_encode_proto(stream, gprotos, protos, proto,
-                                 json_array_get(array, i))) {
+            if (!pb_encode_proto(stream, proto, json_array_get(array, i))) {
                 return 0;
             }
         }
@@ -157,8 +241,7 @@ static int checkreturn pb_encode_array(pb_ostream_t *stream, const json_t *gprot
             if (!pb_encode_tag_for_field(stream, proto)) {
                 return 0;
             }
-            if (!pb_encode_proto(stream, gprotos, protos, proto,
-                                 json_array_get(array, i))) {
+            if (!pb_encode_proto(stream, proto, json_array_get(array, i))) {
                 return 0;
             }
         }
@@ -166,34 +249,32 @@ static int checkreturn pb_encode_array(pb_ostream_t *stream, const json_t *gprot
     return 1;
 }
 
-static int checkreturn pb_encode(pb_ostream_t *stream, const json_t *gprotos,
-                                 const json_t *protos, json_t *msg) {
-    json_t *root, *value, *option, *proto;
+static int checkreturn pb_encode(pb_ostream_t *stream, const pc_pb_message_t *protos,
+                                 json_t *msg) {
+    json_t *root, *value;
+    const pc_pb_field_t *proto;
     root = msg;
 
-    const char *option_text;
     const char *key;
     void *iter = json_object_iter(root);
     while (iter) {
         key = json_object_iter_key(iter);
         value = json_object_iter_value(iter);
 
-        proto = json_object_get(protos, key);
+        proto = pc_pb_field_by_name(protos, key);
         if (proto) {
-            option = json_object_get(proto, "option");
-            option_text = json_string_value(option);
-            if (strcmp(option_text, "required") == 0
-                    || strcmp(option_text, "optional") == 0) {
+            if (proto->option == PB_required
+                    || proto->option == PB_optional) {
                 if (!pb_encode_tag_for_field(stream, proto)) {
                     return 0;
                 }
 
-                if (!pb_encode_proto(stream, gprotos, protos, proto, value)) {
+                if (!pb_encode_proto(stream, proto, value)) {
                     return 0;
                 }
-            } else if (strcmp(option_text, "repeated") == 0) {
+            } else if (proto->option == PB_repeated) {
                 if (json_is_array(value)) {
-                    if (!pb_encode_array(stream, gprotos, protos, proto, value)) {
+                    if (!pb_encode_array(stream, proto, value)) {
                         return 0;
                     }
                 }
@@ -206,20 +287,15 @@ static int checkreturn pb_encode(pb_ostream_t *stream, const json_t *gprotos,
     return 1;
 }
 
-static int checkreturn pb_encode_proto(pb_ostream_t *stream, const json_t *gprotos, const json_t *protos,
-                                       const json_t *proto, json_t *value) {
-    json_t *_messages;
-    json_t *_type = json_object_get(proto, "type");
-    json_t *sub_msg;
-    const char *type = json_string_value(_type);
+static int checkreturn pb_encode_proto(pb_ostream_t *stream, const pc_pb_field_t *proto,
+                                       json_t *value) {
     const char *str;
     json_int_t int_val;
     float float_val;
     double double_val;
     int length;
 
-    _messages = json_object_get(protos, "__messages");
-    switch (pb__get_type(type)) {
+    switch (proto->type) {
     case PB_uInt32:
         int_val = json_number_value(value);
         if (!pb_encode_varint(stream, int_val)) {
@@ -253,28 +329,13 @@ static int checkreturn pb_encode_proto(pb_ostream_t *stream, const json_t *gprot
         }
         break;
     default:
-        if (_messages) {
-            sub_msg = json_object_get(_messages, type);
-            if (!sub_msg) {
-                // check root msg in gprotos
-                const char *head = "message ";
-                size_t len = strlen(head) + strlen(type) + 1;
-                char *head_text = (char *)malloc(len);
-                memset(head_text, 0, len);
-                strcpy(head_text, head);
-                strcat(head_text, type);
-                sub_msg = json_object_get(gprotos, head_text);
-                free(head_text);
-            }
-            if (sub_msg) {
-                if (!pb_encode_submessage(stream, gprotos, sub_msg, value)) {
-                    return 0;
-                }
-            } else {
-                return 0;
-            }
+        // sub message resolved at compile time
+        if (proto->message == NULL) {
+            return 0;
+        }
+        if (!pb_encode_submessage(stream, proto->message, value)) {
+            return 0;
         }
-
     }
     return 1;
 }
@@ -348,24 +409,11 @@ static int checkreturn pb_encode_fixed64(pb_ostream_t *stream, const void *value
 #endif
 }
 
-/* Encode field header by manually specifing wire type. You need to use this if
- * you want to write out packed arrays from a callback field. */
-static int checkreturn pb_encode_tag(pb_ostream_t *stream, int wiretype,
-                                     uint32_t field_number) {
-    uint64_t tag = wiretype | (field_number << 3);
-    return pb_encode_varint(stream, tag);
-}
-
 /* Encode field header based on LTYPE and field number defined in the field structure.
  * Call this from the callback before writing out field contents. */
-static int checkreturn pb_encode_tag_for_field(pb_ostream_t *stream, const json_t *field) { // type,tag
-    int wiretype;
-    json_t *type = json_object_get(field, "type");
-    json_t *tag = json_object_get(field, "tag");
-
-    wiretype = pb__get_constant_type(json_string_value(type));
-
-    return pb_encode_tag(stream, wiretype, json_number_value(tag));
+static int checkreturn pb_encode_tag_for_field(pb_ostream_t *stream, const pc_pb_field_t *field) {
+    /* the key has been encoded at compile time */
+    return pb_write(stream, field->key, field->key_len);
 }
 
 /* Encode a string or bytes type field. For strings, pass strlen(s) as size. */
@@ -378,17 +426,34 @@ static int checkreturn pb_encode_string(pb_ostream_t *stream, const uint8_t *buf
 }
 
 /* Eecode submessage in __messages protos */
-static int pb_encode_submessage(pb_ostream_t *stream, const json_t *gprotos, const json_t *protos, json_t *value) {
-    /* First calculate the message size using a non-writing substream. */
-    pb_ostream_t substream = { 0, 0, 0, 0 };
-    size_t size;
+static int pb_encode_submessage(pb_ostream_t *stream, const pc_pb_message_t *protos, json_t *value) {
+    pb_ostream_t substream = { 0, 0, 0, 0, 0 };
+    pc_pb_sizes_t *sizes = stream->sizes;
+    size_t size, slot = 0;
     int status;
 
-    if (!pb_encode(&substream, gprotos, protos, value)) {
-        return 0;
-    }
+    if (stream->callback != NULL && sizes != NULL) {
+        /* The sizing pass visited the sub messages in the same order. */
+        if (sizes->next >= sizes->len) {
+            return 0;
+        }
+        size = sizes->items[sizes->next++];
+    } else {
+        /* Calculate the message size using a non-writing substream, and
+         * record it for the encode pass if sizing. */
+        if (sizes != NULL && !pb_sizes_reserve(sizes, &slot)) {
+            return 0;
+        }
+        substream.sizes = sizes;
+        if (!pb_encode(&substream, protos, value)) {
+            return 0;
+        }
 
-    size = substream.bytes_written;
+        size = substream.bytes_written;
+        if (sizes != NULL) {
+            sizes->items[slot] = size;
+        }
+    }
 
     if (!pb_encode_varint(stream, (uint64_t) size)) {
         return 0;
@@ -406,8 +471,9 @@ static int pb_encode_submessage(pb_ostream_t *stream, const json_t *gprotos, con
     substream.state = stream->state;
     substream.max_size = size;
     substream.bytes_written = 0;
+    substream.sizes = sizes;
 
-    status = pb_encode(&substream, gprotos, protos, value);
+    status = pb_encode(&substream, protos, value);
 
     stream->bytes_written += substream.bytes_written;
     stream->state = substream.state;
@@ -0,0 +1,612 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "pomelo-protobuf/pb-schema.h"
+#include "pomelo-protobuf/pb-util.h"
+#include "pomelo-private/alloc.h"
+#include "uv.h"
+
+#define PC_PB_GLOBAL_PREFIX "message "
+
+/*! Json definition with its compiled message. */
+typedef struct {
+  json_t *def;
+  const pc_pb_message_t *message;
+} pc__pb_cached_t;
+
+struct pc_pb_cache_s {
+  /*! One for being the current cache, one for each message in use. */
+  long refs;
+  json_t *gprotos;
+  pc_pb_schema_t *schema;
+  pc__pb_cached_t *defs;
+  size_t ndefs;
+  size_t cap;
+};
+
+static uv_once_t pc__pb_cache_once = UV_ONCE_INIT;
+static uv_mutex_t pc__pb_cache_mutex;
+static pc_pb_cache_t *pc__pb_cache = NULL;
+
+static pc_pb_message_t *pc__pb_compile(pc_pb_schema_t *schema,
+                                       const json_t *def, const char *name,
+                                       pc_pb_message_t *parent);
+static void pc__pb_resolve(pc_pb_schema_t *schema);
+static void pc__pb_message_free(pc_pb_message_t *message);
+
+static void pc__pb_release_nothing(pc_map_t *map, const char *key,
+                                   void *value) {
+  // messages are released with the queue of schema
+}
+
+static uint32_t pc__pb_hash(const char *str) {
+  uint32_t hash = 2166136261u;
+
+  while(*str) {
+    hash ^= (uint8_t)*str++;
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+static char *pc__pb_strdup(const char *str) {
+  return pc__strdup(str, PC_ALLOC_PROTOBUF);
+}
+
+static void pc__pb_strfree(char *str) {
+  if(str) {
+    pc__free(str, strlen(str) + 1, PC_ALLOC_PROTOBUF);
+  }
+}
+
+static int pc__pb_field_cmp(const void *a, const void *b) {
+  uint32_t ta = ((const pc_pb_field_t *)a)->tag;
+  uint32_t tb = ((const pc_pb_field_t *)b)->tag;
+
+  return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
+
+static int pc__pb_get_option(const char *option) {
+  if(option == NULL) {
+    return 0;
+  }
+  if(strcmp(option, "required") == 0) {
+    return PB_required;
+  }
+  if(strcmp(option, "optional") == 0) {
+    return PB_optional;
+  }
+  if(strcmp(option, "repeated") == 0) {
+    return PB_repeated;
+  }
+  return 0;
+}
+
+pc_pb_schema_t *pc_pb_schema_new(const json_t *protos) {
+  pc_pb_schema_t *schema = NULL;
+  const char *key;
+  json_t *def;
+  size_t prefix_len = strlen(PC_PB_GLOBAL_PREFIX);
+  pc_pb_message_t *message;
+
+  schema = (pc_pb_schema_t *)pc__malloc(sizeof(pc_pb_schema_t),
+                                         PC_ALLOC_PROTOBUF);
+  if(schema == NULL) {
+    fprintf(stderr, "Fail to malloc for pc_pb_schema_t.\n");
+    return NULL;
+  }
+  memset(schema, 0, sizeof(pc_pb_schema_t));
+  ngx_queue_init(&schema->messages);
+
+  schema->routes = pc_map_new(json_object_size(protos),
+                              pc__pb_release_nothing);
+  schema->globals = pc_map_new(0, pc__pb_release_nothing);
+  if(schema->routes == NULL || schema->globals == NULL) {
+    fprintf(stderr, "Fail to create maps for pc_pb_schema_t.\n");
+    goto error;
+  }
+
+  json_object_foreach((json_t *)protos, key, def) {
+    if(!json_is_object(def)) {
+      continue;
+    }
+
+    if(strncmp(key, PC_PB_GLOBAL_PREFIX, prefix_len) == 0) {
+      message = pc__pb_compile(schema, def, key + prefix_len, NULL);
+      if(message == NULL || pc_map_set(schema->globals, message->name, message)) {
+        goto error;
+      }
+    } else {
+      message = pc__pb_compile(schema, def, key, NULL);
+      if(message == NULL || pc_map_set(schema->routes, key, message)) {
+        goto error;
+      }
+    }
+  }
+
+  pc__pb_resolve(schema);
+
+  return schema;
+
+error:
+  fprintf(stderr, "Fail to compile protobuf definitions.\n");
+  pc_pb_schema_destroy(schema);
+  return NULL;
+}
+
+void pc_pb_schema_destroy(pc_pb_schema_t *schema) {
+  ngx_queue_t *q;
+
+  if(schema->routes) {
+    pc_map_destroy(schema->routes);
+  }
+  if(schema->globals) {
+    pc_map_destroy(schema->globals);
+  }
+
+  while(!ngx_queue_empty(&schema->messages)) {
+    q = ngx_queue_head(&schema->messages);
+    ngx_queue_remove(q);
+    pc__pb_message_free(ngx_queue_data(q, pc_pb_message_t, queue));
+  }
+
+  pc__free(schema, sizeof(pc_pb_schema_t), PC_ALLOC_PROTOBUF);
+}
+
+const pc_pb_message_t *pc_pb_schema_add(pc_pb_schema_t *schema,
+                                        const json_t *def) {
+  pc_pb_message_t *message = pc__pb_compile(schema, def, "", NULL);
+
+  if(message) {
+    pc__pb_resolve(schema);
+  }
+
+  return message;
+}
+
+static void pc__pb_cache_init() {
+  if(uv_mutex_init(&pc__pb_cache_mutex)) {
+    fprintf(stderr, "Fail to init protobuf cache mutex.\n");
+    abort();
+  }
+}
+
+static int pc__pb_cache_set(pc_pb_cache_t *cache, const json_t *def,
+                            const pc_pb_message_t *message) {
+  pc__pb_cached_t *defs;
+  size_t cap;
+
+  if(cache->ndefs == cache->cap) {
+    cap = cache->cap ? cache->cap * 2 : 16;
+    defs = (pc__pb_cached_t *)pc__malloc(sizeof(pc__pb_cached_t) * cap,
+                                         PC_ALLOC_PROTOBUF);
+    if(defs == NULL) {
+      fprintf(stderr, "Fail to malloc for protobuf cache.\n");
+      return -1;
+    }
+    if(cache->defs) {
+      memcpy(defs, cache->defs, sizeof(pc__pb_cached_t) * cache->ndefs);
+      pc__free(cache->defs, sizeof(pc__pb_cached_t) * cache->cap,
+               PC_ALLOC_PROTOBUF);
+    }
+    cache->defs = defs;
+    cache->cap = cap;
+  }
+
+  cache->defs[cache->ndefs].def = json_incref((json_t *)def);
+  cache->defs[cache->ndefs].message = message;
+  cache->ndefs++;
+
+  return 0;
+}
+
+static void pc__pb_cache_unref(pc_pb_cache_t *cache) {
+  size_t i;
+
+  if(--cache->refs > 0) {
+    return;
+  }
+
+  for(i = 0; i < cache->ndefs; i++) {
+    json_decref(cache->defs[i].def);
+  }
+  if(cache->defs) {
+    pc__free(cache->defs, sizeof(pc__pb_cached_t) * cache->cap,
+             PC_ALLOC_PROTOBUF);
+  }
+  pc_pb_schema_destroy(cache->schema);
+  json_decref(cache->gprotos);
+  pc__free(cache, sizeof(pc_pb_cache_t), PC_ALLOC_PROTOBUF);
+}
+
+static pc_pb_cache_t *pc__pb_cache_new(const json_t *gprotos) {
+  pc_pb_cache_t *cache;
+  const char *key;
+  json_t *def;
+  const pc_pb_message_t *message;
+
+  cache = (pc_pb_cache_t *)pc__malloc(sizeof(pc_pb_cache_t),
+                                      PC_ALLOC_PROTOBUF);
+  if(cache == NULL) {
+    fprintf(stderr, "Fail to malloc for pc_pb_cache_t.\n");
+    return NULL;
+  }
+  memset(cache, 0, sizeof(pc_pb_cache_t));
+
+  cache->schema = pc_pb_schema_new(gprotos);
+  if(cache->schema == NULL) {
+    pc__free(cache, sizeof(pc_pb_cache_t), PC_ALLOC_PROTOBUF);
+    return NULL;
+  }
+  cache->gprotos = json_incref((json_t *)gprotos);
+  cache->refs = 1;
+
+  // the definitions of routes are compiled with the schema already
+  json_object_foreach((json_t *)gprotos, key, def) {
+    message = pc_pb_schema_get(cache->schema, key);
+    if(message && pc__pb_cache_set(cache, def, message)) {
+      pc__pb_cache_unref(cache);
+      return NULL;
+    }
+  }
+
+  return cache;
+}
+
+const pc_pb_message_t *pc_pb_cache_get(const json_t *gprotos,
+                                       const json_t *protos,
+                                       pc_pb_cache_t **cache) {
+  pc_pb_cache_t *current;
+  const pc_pb_message_t *message = NULL;
+  size_t i;
+
+  uv_once(&pc__pb_cache_once, pc__pb_cache_init);
+  uv_mutex_lock(&pc__pb_cache_mutex);
+
+  current = pc__pb_cache;
+  if(current == NULL || current->gprotos != gprotos) {
+    current = pc__pb_cache_new(gprotos);
+    if(current == NULL) {
+      goto finally;
+    }
+    if(pc__pb_cache) {
+      pc__pb_cache_unref(pc__pb_cache);
+    }
+    pc__pb_cache = current;
+  }
+
+  for(i = 0; i < current->ndefs; i++) {
+    if(current->defs[i].def == protos) {
+      message = current->defs[i].message;
+      break;
+    }
+  }
+
+  if(message == NULL) {
+    message = pc_pb_schema_add(current->schema, protos);
+    if(message && pc__pb_cache_set(current, protos, message)) {
+      message = NULL;
+    }
+  }
+
+  if(message) {
+    current->refs++;
+    *cache = current;
+  }
+
+finally:
+  uv_mutex_unlock(&pc__pb_cache_mutex);
+  return message;
+}
+
+void pc_pb_cache_release(pc_pb_cache_t *cache) {
+  uv_mutex_lock(&pc__pb_cache_mutex);
+  pc__pb_cache_unref(cache);
+  uv_mutex_unlock(&pc__pb_cache_mutex);
+}
+
+const pc_pb_message_t *pc_pb_schema_get(const pc_pb_schema_t *schema,
+                                        const char *route) {
+  if(schema == NULL) {
+    return NULL;
+  }
+
+  return (const pc_pb_message_t *)pc_map_get(schema->routes, route);
+}
+
+const pc_pb_field_t *pc_pb_field_by_tag(const pc_pb_message_t *message,
+                                        uint32_t tag) {
+  size_t lo = 0, hi = message->nfields, mid;
+
+  if(message->tags) {
+    return tag <= message->max_tag ? message->tags[tag] : NULL;
+  }
+
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    if(message->fields[mid].tag == tag) {
+      return &message->fields[mid];
+    }
+    if(message->fields[mid].tag < tag) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return NULL;
+}
+
+const pc_pb_field_t *pc_pb_field_by_name(const pc_pb_message_t *message,
+                                         const char *name) {
+  size_t i;
+  pc_pb_field_t *field;
+
+  if(message->names == NULL) {
+    return NULL;
+  }
+
+  i = pc__pb_hash(name) & message->names_mask;
+  while((field = message->names[i]) != NULL) {
+    if(strcmp(field->name, name) == 0) {
+      return field;
+    }
+    i = (i + 1) & message->names_mask;
+  }
+
+  return NULL;
+}
+
+/**
+ * Compile the fields of a definition, leave the message types unresolved.
+ */
+static int pc__pb_compile_field(pc_pb_field_t *field, const char *name,
+                                const json_t *def) {
+  const char *type = json_string_value(json_object_get(def, "type"));
+  uint32_t key;
+
+  if(type == NULL) {
+    fprintf(stderr, "Fail to get type of protobuf field: %s\n", name);
+    return -1;
+  }
+
+  field->name = pc__pb_strdup(name);
+  if(field->name == NULL) {
+    return -1;
+  }
+  field->name_len = strlen(name);
+  field->tag = (uint32_t)json_number_value(json_object_get(def, "tag"));
+  field->option = pc__pb_get_option(
+      json_string_value(json_object_get(def, "option")));
+  field->type = pb__get_type(type);
+  field->packed = field->option == PB_repeated && field->type &&
+                  field->type != PB_string;
+
+  if(field->type == 0) {
+    field->type_name = pc__pb_strdup(type);
+    if(field->type_name == NULL) {
+      return -1;
+    }
+  }
+
+  // the key is the same for each value of the field
+  key = (field->tag << 3) | pb__get_constant_type(type);
+  field->key_len = 0;
+  do {
+    field->key[field->key_len] = (uint8_t)(key & 0x7f);
+    key >>= 7;
+    if(key) {
+      field->key[field->key_len] |= 0x80;
+    }
+    field->key_len++;
+  } while(key);
+
+  return 0;
+}
+
+static int pc__pb_index(pc_pb_message_t *message) {
+  size_t i, j, size;
+  pc_pb_field_t *field;
+
+  qsort(message->fields, message->nfields, sizeof(pc_pb_field_t),
+        pc__pb_field_cmp);
+
+  if(message->nfields == 0) {
+    return 0;
+  }
+
+  message->max_tag = message->fields[message->nfields - 1].tag;
+  if(message->max_tag <= PC_PB_DENSE_TAGS) {
+    message->tags = (pc_pb_field_t **)pc__calloc(message->max_tag + 1,
+                                                 sizeof(pc_pb_field_t *),
+                                                 PC_ALLOC_PROTOBUF);
+    if(message->tags == NULL) {
+      return -1;
+    }
+    for(i = 0; i < message->nfields; i++) {
+      message->tags[message->fields[i].tag] = &message->fields[i];
+    }
+  }
+
+  // keep the load of names table no more than half
+  size = 4;
+  while(size < message->nfields * 2) {
+    size <<= 1;
+  }
+  message->names = (pc_pb_field_t **)pc__calloc(size, sizeof(pc_pb_field_t *),
+                                                 PC_ALLOC_PROTOBUF);
+  if(message->names == NULL) {
+    return -1;
+  }
+  message->names_mask = size - 1;
+  for(i = 0; i < message->nfields; i++) {
+    field = &message->fields[i];
+    j = pc__pb_hash(field->name) & message->names_mask;
+    while(message->names[j] != NULL) {
+      j = (j + 1) & message->names_mask;
+    }
+    message->names[j] = field;
+  }
+
+  return 0;
+}
+
+static pc_pb_message_t *pc__pb_compile(pc_pb_schema_t *schema,
+                                       const json_t *def, const char *name,
+                                       pc_pb_message_t *parent) {
+  pc_pb_message_t *message;
+  const char *key;
+  json_t *value;
+  json_t *nested = NULL;
+  size_t n = 0;
+
+  message = (pc_pb_message_t *)pc__malloc(sizeof(pc_pb_message_t),
+                                          PC_ALLOC_PROTOBUF);
+  if(message == NULL) {
+    fprintf(stderr, "Fail to malloc for pc_pb_message_t.\n");
+    return NULL;
+  }
+  memset(message, 0, sizeof(pc_pb_message_t));
+  message->parent = parent;
+  // owned by schema from now on
+  ngx_queue_insert_tail(&schema->messages, &message->queue);
+
+  message->name = pc__pb_strdup(name);
+  if(message->name == NULL) {
+    goto error;
+  }
+
+  json_object_foreach((json_t *)def, key, value) {
+    if(strncmp(key, "__", 2) != 0 && json_is_object(value)) {
+      n++;
+    }
+  }
+
+  if(n > 0) {
+    message->fields = (pc_pb_field_t *)pc__calloc(n, sizeof(pc_pb_field_t),
+                                                  PC_ALLOC_PROTOBUF);
+    if(message->fields == NULL) {
+      goto error;
+    }
+    // the fields not compiled for error are left empty
+    message->nfields = n;
+  }
+
+  n = 0;
+  json_object_foreach((json_t *)def, key, value) {
+    if(strncmp(key, "__", 2) != 0 && json_is_object(value)) {
+      if(pc__pb_compile_field(&message->fields[n++], key, value)) {
+        goto error;
+      }
+    }
+  }
+
+  if(pc__pb_index(message)) {
+    goto error;
+  }
+
+  nested = json_object_get(def, "__messages");
+  n = 0;
+  if(json_is_object(nested)) {
+    json_object_foreach(nested, key, value) {
+      if(json_is_object(value)) {
+        n++;
+      }
+    }
+  }
+  if(n > 0) {
+    message->nested = (pc_pb_message_t **)pc__calloc(n, sizeof(pc_pb_message_t *),
+                                                      PC_ALLOC_PROTOBUF);
+    if(message->nested == NULL) {
+      goto error;
+    }
+    // the messages not compiled for error are left NULL
+    message->nnested = n;
+    n = 0;
+    json_object_foreach(nested, key, value) {
+      if(!json_is_object(value)) {
+        continue;
+      }
+      message->nested[n] = pc__pb_compile(schema, value, key, message);
+      if(message->nested[n++] == NULL) {
+        return NULL;
+      }
+    }
+  }
+
+  return message;
+
+error:
+  fprintf(stderr, "Fail to compile protobuf message: %s\n", name);
+  return NULL;
+}
+
+static const pc_pb_message_t *pc__pb_lookup(pc_pb_schema_t *schema,
+                                            const pc_pb_message_t *scope,
+                                            const char *name) {
+  size_t i;
+
+  // nested messages of the enclosing scopes first, then the global ones
+  for(; scope; scope = scope->parent) {
+    for(i = 0; i < scope->nnested; i++) {
+      if(scope->nested[i] && strcmp(scope->nested[i]->name, name) == 0) {
+        return scope->nested[i];
+      }
+    }
+  }
+
+  return (const pc_pb_message_t *)pc_map_get(schema->globals, name);
+}
+
+static void pc__pb_resolve(pc_pb_schema_t *schema) {
+  ngx_queue_t *q;
+  pc_pb_message_t *message;
+  pc_pb_field_t *field;
+  const pc_pb_message_t *resolved;
+  size_t i;
+
+  ngx_queue_foreach(q, &schema->messages) {
+    message = ngx_queue_data(q, pc_pb_message_t, queue);
+    for(i = 0; i < message->nfields; i++) {
+      field = &message->fields[i];
+      if(field->type != 0 || field->message != NULL ||
+         field->type_name == NULL) {
+        continue;
+      }
+      // not written if unresolved, the messages may be in use by pc_pb_encode
+      // when resolved again for a message added to the cached schema
+      resolved = pc__pb_lookup(schema, message, field->type_name);
+      if(resolved == NULL) {
+        fprintf(stderr, "Fail to resolve protobuf message type: %s\n",
+                field->type_name);
+        continue;
+      }
+      field->message = resolved;
+    }
+  }
+}
+
+static void pc__pb_message_free(pc_pb_message_t *message) {
+  size_t i;
+
+  for(i = 0; i < message->nfields; i++) {
+    pc__pb_strfree(message->fields[i].name);
+    pc__pb_strfree(message->fields[i].type_name);
+  }
+  pc__free(message->fields, sizeof(pc_pb_field_t) * message->nfields,
+           PC_ALLOC_PROTOBUF);
+  if(message->tags) {
+    pc__free(message->tags, sizeof(pc_pb_field_t *) * (message->max_tag + 1),
+             PC_ALLOC_PROTOBUF);
+  }
+  if(message->names) {
+    pc__free(message->names,
+             sizeof(pc_pb_field_t *) * (message->names_mask + 1),
+             PC_ALLOC_PROTOBUF);
+  }
+  pc__free(message->nested, sizeof(pc_pb_message_t *) * message->nnested,
+           PC_ALLOC_PROTOBUF);
+  pc__pb_strfree(message->name);
+  pc__free(message, sizeof(pc_pb_message_t), PC_ALLOC_PROTOBUF);
+}
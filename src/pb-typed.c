@@ -0,0 +1,144 @@
+#include <string.h>
+#include <stdlib.h>
+#include "pomelo-protobuf/pb-typed.h"
+#include "pomelo-private/alloc.h"
+
+size_t pc_pb_varint_size(uint64_t value) {
+  size_t size = 1;
+
+  while(value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+
+  return size;
+}
+
+uint8_t *pc_pb_put_varint(uint8_t *p, uint64_t value) {
+  while(value >= 0x80) {
+    *p++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *p++ = (uint8_t)value;
+
+  return p;
+}
+
+static uint8_t *pc__pb_put_fixed(uint8_t *p, const void *value, size_t width) {
+#ifdef __BIG_ENDIAN__
+  size_t i;
+  for(i = 0; i < width; i++) {
+    p[i] = ((const uint8_t *)value)[width - 1 - i];
+  }
+#else
+  memcpy(p, value, width);
+#endif
+  return p + width;
+}
+
+uint8_t *pc_pb_put_float(uint8_t *p, float value) {
+  return pc__pb_put_fixed(p, &value, 4);
+}
+
+uint8_t *pc_pb_put_double(uint8_t *p, double value) {
+  return pc__pb_put_fixed(p, &value, 8);
+}
+
+uint8_t *pc_pb_put_bytes(uint8_t *p, const char *data, size_t len) {
+  p = pc_pb_put_varint(p, len);
+  if(len > 0) {
+    memcpy(p, data, len);
+  }
+  return p + len;
+}
+
+int pc_pb_get_varint(pc_pb_reader_t *r, uint64_t *value) {
+  const uint8_t *p = r->p;
+  uint64_t v = 0;
+  int shift = 0;
+
+  while(p < r->end && shift < 64) {
+    v |= (uint64_t)(*p & 0x7f) << shift;
+    if(!(*p++ & 0x80)) {
+      r->p = p;
+      *value = v;
+      return 0;
+    }
+    shift += 7;
+  }
+
+  return -1;
+}
+
+static int pc__pb_get_fixed(pc_pb_reader_t *r, void *value, size_t width) {
+#ifdef __BIG_ENDIAN__
+  size_t i;
+#endif
+
+  if((size_t)(r->end - r->p) < width) {
+    return -1;
+  }
+#ifdef __BIG_ENDIAN__
+  for(i = 0; i < width; i++) {
+    ((uint8_t *)value)[i] = r->p[width - 1 - i];
+  }
+#else
+  memcpy(value, r->p, width);
+#endif
+  r->p += width;
+  return 0;
+}
+
+int pc_pb_get_float(pc_pb_reader_t *r, float *value) {
+  return pc__pb_get_fixed(r, value, 4);
+}
+
+int pc_pb_get_double(pc_pb_reader_t *r, double *value) {
+  return pc__pb_get_fixed(r, value, 8);
+}
+
+int pc_pb_get_bytes(pc_pb_reader_t *r, const uint8_t **data, size_t *len) {
+  uint64_t size;
+
+  if(pc_pb_get_varint(r, &size) || size > (uint64_t)(r->end - r->p)) {
+    return -1;
+  }
+
+  *data = r->p;
+  *len = (size_t)size;
+  r->p += size;
+  return 0;
+}
+
+static size_t pc__pb_capacity(size_t count) {
+  size_t cap = 1;
+
+  while(cap < count) {
+    cap <<= 1;
+  }
+
+  return count ? cap : 0;
+}
+
+int pc_pb_reserve(void **items, size_t count, size_t n, size_t size) {
+  void *grown;
+  size_t cap = pc__pb_capacity(count + n);
+
+  // capacity is the next power of two of count
+  if(cap <= pc__pb_capacity(count)) {
+    return 0;
+  }
+
+  grown = pc__realloc(*items, pc__pb_capacity(count) * size, cap * size,
+                      PC_ALLOC_PROTOBUF);
+  if(grown == NULL) {
+    return -1;
+  }
+
+  *items = grown;
+  return 0;
+}
+
+void pc_pb_release(void *items, size_t count, size_t size) {
+  pc__free(items, pc__pb_capacity(count) * size, PC_ALLOC_PROTOBUF);
+}
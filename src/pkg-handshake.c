@@ -3,13 +3,17 @@
 #include "pomelo-protocol/package.h"
 #include "pomelo-private/jansson-memory.h"
 #include "pomelo-private/internal.h"
+#include "pomelo-private/alloc.h"
+#include "pomelo-private/transport.h"
 
 extern int pc__binary_write(pc_client_t *client, const char *data, size_t len,
-                     uv_write_cb cb);
+                            pc_frame_cb cb);
 
 static int pc__handshake_ack(pc_client_t *client);
-static void pc__handshake_req_cb(uv_write_t* req, int status);
-static void pc__handshake_ack_cb(uv_write_t* req, int status);
+static void pc__handshake_req_cb(pc_transport_t *transport, void *data,
+                                 int status);
+static void pc__handshake_ack_cb(pc_transport_t *transport, void *data,
+                                 int status);
 
 static void pc__load_file(pc_client_t *client, const char *name, json_t **dest);
 static void pc__dump_file(pc_client_t *client, const char *name, json_t *src);
@@ -17,7 +21,7 @@ static void pc__dump_file(pc_client_t *client, const char *name, json_t *src);
 static void pc__handshake_timeout_cb(uv_timer_t* handshake_timer, int status) {
   uv_timer_stop(handshake_timer);
   pc_client_t* client = handshake_timer->data;
-  pc_emit_event(client, PC_EVENT_TIMEOUT, NULL);
+  pc__emit_event(client, PC_EVENT_TIMEOUT, NULL);
   fprintf(stderr, "Pomelo client handshake timeout.\n");
   pc_client_stop(client);
 }
@@ -133,20 +137,8 @@ int pc__handshake_resp(pc_client_t *client,
 
     // setup route dictionary
     json_t *dict = json_object_get(sys, "dict");
-    if(dict) {
-      client->route_to_code = dict;
-      json_incref(dict);
-      client->code_to_route = json_object();
-      const char *key;
-      json_t *value;
-      char code_str[16];
-      json_object_foreach(dict, key, value) {
-        memset(code_str, 0, 16);
-        sprintf(code_str, "%u", ((int)json_integer_value(value) & 0xff));
-        json_t *json_key = json_string(key);
-        json_object_set(client->code_to_route, code_str, json_key);
-        json_decref(json_key);
-      }
+    if(dict && pc__routes_set_dict(client, dict)) {
+      goto error;
     }
 
     // setup protobuf data definition
@@ -194,6 +186,9 @@ int pc__handshake_resp(pc_client_t *client,
         client->proto_ver = NULL;
       }
     }
+
+    // compile once for all the messages of the session
+    pc__client_compile_protos(client);
   }
 
   json_t *user = json_object_get(res, "user");
@@ -233,19 +228,13 @@ static int pc__handshake_ack(pc_client_t *client) {
   return 0;
 
 error:
-  if(buf.len != -1) free(buf.base);
+  if(buf.len != -1) pc__free(buf.base, buf.len, PC_ALLOC_PACKAGE);
   return -1;
 }
 
-static void pc__handshake_req_cb(uv_write_t* req, int status) {
-  void **data = (void **)req->data;
-  pc_transport_t *transport = (pc_transport_t *)data[0];
+static void pc__handshake_req_cb(pc_transport_t *transport, void *data,
+                                 int status) {
   pc_client_t *client = transport->client;
-  char *base = (char *)data[1];
-
-  free(base);
-  free(data);
-  free(req);
 
   if(PC_TP_ST_WORKING != transport->state) {
     fprintf(stderr, "Invalid transport state for handshake req cb: %d.\n",
@@ -265,15 +254,9 @@ static void pc__handshake_req_cb(uv_write_t* req, int status) {
   }
 }
 
-static void pc__handshake_ack_cb(uv_write_t* req, int status) {
-  void **data = (void **)req->data;
-  pc_transport_t *transport = (pc_transport_t *)data[0];
+static void pc__handshake_ack_cb(pc_transport_t *transport, void *data,
+                                 int status) {
   pc_client_t *client = transport->client;
-  char *base = (char *)data[1];
-
-  free(base);
-  free(data);
-  free(req);
 
   if(PC_TP_ST_WORKING != transport->state) {
     fprintf(stderr, "Invalid transport state for handshake ack cb: %d.\n",
@@ -301,12 +284,13 @@ static void pc__load_file(pc_client_t *client, const char *name, json_t **dest)
   if(client->proto_event_cb) {
     client->proto_event_cb(client, PC_PROTO_OP_READ, name, (void*)dest);
   } else if(client->proto_read_dir) {
-    char *path = (char*)malloc(strlen(client->proto_read_dir) + 1 + strlen(name) + 1);
+    size_t path_len = strlen(client->proto_read_dir) + 1 + strlen(name) + 1;
+    char *path = (char*)pc__malloc(path_len, PC_ALLOC_OTHER);
     strcpy(path, client->proto_read_dir);
     strcat(path, "/"); 
     strcat(path, name);
     *dest = json_load_file(path, 0, &err);
-    free(path);
+    pc__free(path, path_len, PC_ALLOC_OTHER);
     path = NULL;
   } else {
     *dest = json_load_file(name, 0, &err);
@@ -317,12 +301,13 @@ static void pc__dump_file(pc_client_t *client, const char *name, json_t *src) {
   if(client->proto_event_cb) {
     client->proto_event_cb(client, PC_PROTO_OP_WRITE, name, (void*)src);
   } else if(client->proto_write_dir) {
-    char *path = (char*)malloc(strlen(client->proto_read_dir) + 1 + strlen(name) + 1);
+    size_t path_len = strlen(client->proto_read_dir) + 1 + strlen(name) + 1;
+    char *path = (char*)pc__malloc(path_len, PC_ALLOC_OTHER);
     strcpy(path, client->proto_read_dir);
     strcat(path, "/");
     strcat(path, name);
     json_dump_file(src, path, 0);
-    free(path);
+    pc__free(path, path_len, PC_ALLOC_OTHER);
     path = NULL;
   } else {
     json_dump_file(src, name, 0);
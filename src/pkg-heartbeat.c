@@ -1,14 +1,18 @@
 #include "pomelo.h"
 #include "pomelo-protocol/package.h"
+#include "pomelo-private/transport.h"
+#include "pomelo-private/internal.h"
+#include "pomelo-private/alloc.h"
 
 /**
  * Pomelo package heartbeat parsing and processing.
  */
 
 int pc__binary_write(pc_client_t *client, const char *data, size_t len,
-                            uv_write_cb cb);
+                     pc_frame_cb cb);
 
-static void pc__heartbeat_req_cb(uv_write_t* req, int status);
+static void pc__heartbeat_req_cb(pc_transport_t *transport, void *data,
+                                 int status);
 
 int pc__heartbeat(pc_client_t *client) {
   uv_timer_stop(client->timeout_timer);
@@ -36,7 +40,7 @@ int pc__heartbeat_req(pc_client_t *client) {
   return 0;
 
 error:
-  if(buf.len != -1) free(buf.base);
+  if(buf.len != -1) pc__free(buf.base, buf.len, PC_ALLOC_PACKAGE);
   return -1;
 }
 
@@ -65,22 +69,21 @@ void pc__timeout_cb(uv_timer_t* timeout_timer, int status) {
     fprintf(stderr, "Pomelo timeout timer error, %s\n",
             uv_err_name(uv_last_error(client->uv_loop)));
   } else {
-    pc_emit_event(client, PC_EVENT_TIMEOUT, NULL);
+    pc__emit_event(client, PC_EVENT_TIMEOUT, NULL);
     fprintf(stderr, "Pomelo client heartbeat timeout.\n");
   }
   pc_client_stop(client);
 }
 
-static void pc__heartbeat_req_cb(uv_write_t* req, int status) {
-  void **data = (void **)req->data;
-  pc_client_t *client = (pc_client_t *)data[0];
-  char *base = (char *)data[1];
+static void pc__heartbeat_req_cb(pc_transport_t *transport, void *data,
+                                 int status) {
+  pc_client_t *client = (pc_client_t *)data;
 
   pc_last_update_time = time(NULL);
 
-  free(base);
-  free(data);
-  free(req);
+  if(PC_TP_ST_WORKING != transport->state) {
+    return;
+  }
 
   if(status == -1) {
     fprintf(stderr, "Fail to write heartbeat async, %s.\n",
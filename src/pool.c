@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <string.h>
+#include "pomelo-private/pool.h"
+#include "pomelo-private/alloc.h"
+
+static void pc__pool_destroy(pc_pool_t *pool) {
+  uv_mutex_destroy(&pool->mutex);
+  pc__free(pool, sizeof(pc_pool_t), pool->tag);
+}
+
+pc_pool_t *pc_pool_new(size_t size, size_t max, pc_alloc_tag tag) {
+  pc_pool_t *pool = (pc_pool_t *)pc__malloc(sizeof(pc_pool_t), tag);
+  if(pool == NULL) {
+    fprintf(stderr, "Fail to malloc for pc_pool_t.\n");
+    return NULL;
+  }
+
+  memset(pool, 0, sizeof(pc_pool_t));
+  if(uv_mutex_init(&pool->mutex)) {
+    fprintf(stderr, "Fail to init mutex of pc_pool_t.\n");
+    pc__free(pool, sizeof(pc_pool_t), tag);
+    return NULL;
+  }
+
+  pool->size = size < sizeof(pc_pool_item_t) ? sizeof(pc_pool_item_t) : size;
+  pool->max = max ? max : PC_POOL_MAX_ITEMS;
+  pool->tag = tag;
+  pool->refs = 1;
+
+  return pool;
+}
+
+void *pc_pool_get(pc_pool_t *pool) {
+  pc_pool_item_t *item;
+
+  uv_mutex_lock(&pool->mutex);
+  item = pool->items;
+  if(item) {
+    pool->items = item->next;
+    pool->count--;
+  }
+  pool->refs++;
+  uv_mutex_unlock(&pool->mutex);
+
+  if(item == NULL) {
+    item = (pc_pool_item_t *)pc__malloc(pool->size, pool->tag);
+    if(item == NULL) {
+      pc_pool_put(pool, NULL);
+    }
+  }
+
+  return item;
+}
+
+void pc_pool_put(pc_pool_t *pool, void *ptr) {
+  pc_pool_item_t *item = (pc_pool_item_t *)ptr;
+  // the pool may be destroyed by other thread once the reference dropped
+  size_t size = pool->size;
+  pc_alloc_tag tag = pool->tag;
+  size_t refs;
+
+  uv_mutex_lock(&pool->mutex);
+  if(item && pool->count < pool->max) {
+    item->next = pool->items;
+    pool->items = item;
+    pool->count++;
+    item = NULL;
+  }
+  refs = --pool->refs;
+  uv_mutex_unlock(&pool->mutex);
+
+  pc__free(item, size, tag);
+  if(refs == 0) {
+    pc__pool_destroy(pool);
+  }
+}
+
+void pc_pool_release(pc_pool_t *pool) {
+  pc_pool_item_t *items, *next;
+  size_t size = pool->size;
+  pc_alloc_tag tag = pool->tag;
+  size_t refs;
+
+  uv_mutex_lock(&pool->mutex);
+  items = pool->items;
+  pool->items = NULL;
+  pool->count = 0;
+  // the objects still in use are freed when put back
+  pool->max = 0;
+  refs = --pool->refs;
+  uv_mutex_unlock(&pool->mutex);
+
+  for(; items; items = next) {
+    next = items->next;
+    pc__free(items, size, tag);
+  }
+
+  if(refs == 0) {
+    pc__pool_destroy(pool);
+  }
+}
@@ -2,42 +2,397 @@
 #include "pomelo.h"
 #include "pomelo-private/internal.h"
 #include "pomelo-protocol/message.h"
+#include "pomelo-protocol/frame.h"
 #include "pomelo-private/jansson-memory.h"
+#include "pomelo-private/arena.h"
+#include "pomelo-private/alloc.h"
+#include "pomelo-private/completion.h"
 
 /**
  * Default implementation of Pomelo protocol encode and decode.
  */
 
-static void pc__process_response(pc_client_t *client, pc_msg_t *msg) {
-  char req_id_str[64];
-  memset(req_id_str, 0, 64);
-  sprintf(req_id_str, "%u", msg->id);
+/**
+ * Package waiting for dispatch, see pc_client_set_decode_offload. The copy
+ * of package follows the struct, the message is a view into it.
+ */
+typedef struct pc__decode_job_s {
+  uv_work_t work;
+  pc_client_t *client;
+  struct pc__decode_job_s *next;
+  pc_msg_t *msg;
+  size_t len;
+  unsigned int gen;
+  /*! Json of message is decoded on the threadpool. */
+  int offload;
+  /*! Ready for dispatch. */
+  int done;
+} pc__decode_job_t;
+
+#define PC__DECODE_JOB_DATA(job) ((char *)(job) + sizeof(pc__decode_job_t))
+
+static pc_msg_t *pc__msg_parse(pc_client_t *client, const char *data,
+                               size_t len, pc_arena_t *arena, int *offload);
+static char *pc__msg_copy_route(pc_arena_t *arena, const char *route);
+
+void *pc__typed_alloc(const pc_typed_codec_t *codec, void *stack, size_t size) {
+  void *obj = stack;
+
+  if(codec->struct_size > size) {
+    obj = pc__malloc(codec->struct_size, PC_ALLOC_PROTOBUF);
+    if(obj == NULL) {
+      return NULL;
+    }
+  }
 
-  pc_request_t *req = (pc_request_t *)pc_map_get(client->requests, req_id_str);
-  if(req == NULL) {
-    fprintf(stderr, "Fail to get pc_request_t for request id: %u.\n", msg->id);
+  memset(obj, 0, codec->struct_size);
+  return obj;
+}
+
+static void pc__process_typed_response(pc_client_t *client, pc_msg_t *msg,
+                                       pc_request_t *req) {
+  uint64_t stack[PC__TYPED_STACK_WORDS];
+  // the request may be released in callback
+  const pc_typed_codec_t *codec = req->resp_codec;
+  void *resp;
+
+  // only the default parser keeps the body for the typed response
+  if(msg->body.base == NULL) {
+    fprintf(stderr, "Fail to decode typed response without body: %s\n",
+            req->route);
+    req->cb(req, -1, NULL);
     return;
   }
 
-  // clean request for the reqId
-  pc_map_del(client->requests, req_id_str);
+  resp = pc__typed_alloc(codec, stack, sizeof(stack));
+  if(resp == NULL) {
+    fprintf(stderr, "Fail to malloc for typed response: %s\n", req->route);
+    req->cb(req, -1, NULL);
+    return;
+  }
+
+  if(codec->decode(resp, (const uint8_t *)msg->body.base, msg->body.len)) {
+    fprintf(stderr, "Fail to decode typed response: %s\n", req->route);
+    req->cb(req, -1, NULL);
+  } else {
+    req->typed_cb(req, 0, resp);
+    codec->release(resp);
+  }
+
+  if(resp != stack) pc__free(resp, codec->struct_size, PC_ALLOC_PROTOBUF);
+}
+
+static void pc__deliver_response(pc_client_t *client, pc_msg_t *msg,
+                                 pc_request_t *req) {
+  if(req->cb == pc__request_complete_cb) {
+    // polled from the completion queue
+    req->cb = req->user_cb;
+  }
+
+  if(req->resp_codec) {
+    pc__process_typed_response(client, msg, req);
+    return;
+  }
+
+  if(req->raw_cb) {
+    req->raw_cb(req, 0, msg);
+    return;
+  }
 
   req->cb(req, 0, msg->msg);
 }
 
-static int pc__data(pc_client_t *client, const char *data, size_t len) {
-  pc_msg_t *msg = client->parse_msg(client, data, len);
+static void pc__process_response(pc_client_t *client, pc_msg_t *msg) {
+  pc_request_t *req = NULL;
 
-  if(msg == NULL) {
-    return -1;
+  // the default parser has taken the request out already, while a custom
+  // parser knows nothing about the private field
+  if(client->parse_msg == pc__default_msg_parse_cb) {
+    req = msg->req;
+    msg->req = NULL;
+  } else {
+    req = pc_req_table_del(client->requests, msg->id);
   }
 
+  if(req == NULL) {
+    fprintf(stderr, "Fail to get pc_request_t for request id: %u.\n", msg->id);
+    return;
+  }
+
+  pc__request_timer_stop(client, req);
+  pc__deliver_response(client, msg, req);
+}
+
+static void pc__dispatch_push(pc_client_t *client, pc_msg_t *msg) {
+  // an untyped listener may have been added since the message was parsed
+  if(msg->lazy_client && pc__event_need_json(client, msg->route)) {
+    pc_msg_json(msg);
+  }
+  pc_emit_event(client, msg->route, msg->msg);
+  if(msg->body.base) {
+    pc__emit_msg_event(client, msg);
+  }
+}
+
+static void pc__dispatch(pc_client_t *client, pc_msg_t *msg) {
   if(msg->id > 0) {
     pc__process_response(client, msg);
   } else {
     // server push message
-    pc_emit_event(client, msg->route, msg->msg);
+    pc__dispatch_push(client, msg);
   }
+}
+
+void pc__msg_deliver(pc_client_t *client, pc_msg_t *msg) {
+  pc_request_t *req = msg->req;
+
+  if(msg->id == 0) {
+    pc__dispatch_push(client, msg);
+  } else if(req) {
+    msg->req = NULL;
+    pc__deliver_response(client, msg, req);
+  } else {
+    fprintf(stderr, "Fail to get pc_request_t for request id: %u.\n", msg->id);
+  }
+}
+
+/**
+ * Copy the route interned by the dictionary, for the message which outlives
+ * the package. The dictionary is released when the client reconnects, which
+ * may happen before the message is polled or decoded.
+ */
+static int pc__msg_own_route(pc_msg_t *msg) {
+  char *route;
+
+  if(!msg->route_interned) {
+    return 0;
+  }
+
+  route = pc__msg_copy_route(NULL, msg->route);
+  if(route == NULL) {
+    return -1;
+  }
+  msg->route = route;
+  msg->route_interned = 0;
+
+  return 0;
+}
+
+/**
+ * Hand a message parsed over to the completion queue. The body is a view
+ * into the package, which is copied only for the raw and typed callbacks.
+ */
+static int pc__complete_msg(pc_client_t *client, pc_msg_t *msg) {
+  int keep = msg->lazy_client != NULL ||
+      (msg->id == 0 && pc__event_need_body(client, msg->route));
+  char *body;
+
+  if(msg->req) {
+    pc__request_timer_stop(client, msg->req);
+  }
+
+  if(pc__msg_own_route(msg)) {
+    pc_msg_destroy(msg);
+    return -1;
+  }
+
+  if(!keep) {
+    msg->body.base = NULL;
+    msg->body.len = 0;
+  } else if(msg->body.len == 0) {
+    msg->body.base = (char *)"";
+  } else {
+    body = (char *)pc__malloc(msg->body.len, PC_ALLOC_MESSAGE);
+    if(body == NULL) {
+      fprintf(stderr, "Fail to malloc for message body.\n");
+      if(msg->req) {
+        // queued as failure by the callback of completion mode
+        msg->req->cb(msg->req, -1, NULL);
+      }
+      pc_msg_destroy(msg);
+      return -1;
+    }
+    memcpy(body, msg->body.base, msg->body.len);
+    msg->body.base = body;
+    msg->own_body = 1;
+  }
+
+  pc__completion_push(client, &msg->completion, PC__COMPLETION_MSG, 0);
+  return 0;
+}
+
+/**
+ * Drop a message which would never be dispatched.
+ */
+static void pc__decode_job_fail(pc__decode_job_t *job) {
+  pc_request_t *req = job->msg->req;
+
+  if(req) {
+    job->msg->req = NULL;
+    req->cb(req, -1, NULL);
+  }
+}
+
+/**
+ * Dispatch the jobs done from the head of queue, so the messages are
+ * delivered in the order of arrival.
+ */
+static void pc__decode_drain(pc_client_t *client) {
+  pc__decode_job_t *job;
+  int status;
+
+  while((job = client->decode_head) != NULL && job->done) {
+    client->decode_head = job->next;
+    if(client->decode_head == NULL) {
+      client->decode_tail = NULL;
+    }
+
+    status = 0;
+    if(job->gen != client->decode_gen) {
+      // arrived before the client stopped or reconnected
+      pc__decode_job_fail(job);
+    } else if(job->offload && job->msg->msg == NULL) {
+      fprintf(stderr, "Fail to decode message: %s\n",
+              job->msg->route ? job->msg->route : "response");
+      pc__decode_job_fail(job);
+      status = -1;
+    } else if(client->completion_mode) {
+      // the package is released below
+      if(pc__complete_msg(client, job->msg)) {
+        status = -1;
+      }
+      job->msg = NULL;
+    } else {
+      pc__dispatch(client, job->msg);
+    }
+
+    pc_msg_destroy(job->msg);
+    pc__free(job, sizeof(pc__decode_job_t) + job->len, PC_ALLOC_MESSAGE);
+
+    if(status == -1) {
+      pc_client_stop(client);
+    }
+  }
+}
+
+static void pc__decode_work(uv_work_t *work) {
+  pc__decode_job_t *job = (pc__decode_job_t *)work->data;
+  pc_client_t *client = job->client;
+  pc_msg_t *msg = job->msg;
+  const char *route = msg->route ? msg->route : msg->req->route;
+  const pc_pb_message_t *pb_def;
+
+  // the protos are not compiled again until the decode finished
+  uv_rwlock_rdlock(&client->encode_rwlock);
+  pb_def = pc_pb_schema_get(client->server_schema, route);
+  if(pb_def) {
+    msg->msg = pc__pb_decode(msg->body.base, 0, msg->body.len, pb_def);
+  } else {
+    msg->msg = pc__json_decode(msg->body.base, 0, msg->body.len);
+  }
+  uv_rwlock_rdunlock(&client->encode_rwlock);
+}
+
+static void pc__decode_after_work(uv_work_t *work, int status) {
+  pc__decode_job_t *job = (pc__decode_job_t *)work->data;
+  pc_client_t *client = job->client;
+
+  job->done = 1;
+  client->decode_jobs--;
+  pc__decode_drain(client);
+  pc__client_check_closed(client);
+}
+
+/**
+ * Queue a package behind the ones decoding, the large one is decoded on the
+ * threadpool. The header is parsed here, as the request table and the route
+ * dictionary belong to loop thread.
+ */
+static int pc__decode_enqueue(pc_client_t *client, const char *data,
+                              size_t len) {
+  pc__decode_job_t *job;
+  int offload = len >= client->decode_min_size;
+
+  job = (pc__decode_job_t *)pc__malloc(sizeof(pc__decode_job_t) + len,
+                                       PC_ALLOC_MESSAGE);
+  if(job == NULL) {
+    fprintf(stderr, "Fail to malloc for pc__decode_job_t.\n");
+    return -1;
+  }
+  memset(job, 0, sizeof(pc__decode_job_t));
+  memcpy(PC__DECODE_JOB_DATA(job), data, len);
+  job->client = client;
+  job->len = len;
+  job->gen = client->decode_gen;
+  job->work.data = job;
+
+  job->msg = pc__msg_parse(client, PC__DECODE_JOB_DATA(job), len, NULL,
+                           &offload);
+  if(job->msg == NULL) {
+    pc__free(job, sizeof(pc__decode_job_t) + len, PC_ALLOC_MESSAGE);
+    return -1;
+  }
+
+  // decoded on the threadpool and dispatched later
+  if(pc__msg_own_route(job->msg)) {
+    pc__decode_job_fail(job);
+    pc_msg_destroy(job->msg);
+    pc__free(job, sizeof(pc__decode_job_t) + len, PC_ALLOC_MESSAGE);
+    return -1;
+  }
+
+  if(job->msg->req) {
+    // out of the request table already, must not time out while waiting
+    pc__request_timer_stop(client, job->msg->req);
+  }
+
+  if(client->decode_tail) {
+    client->decode_tail->next = job;
+  } else {
+    client->decode_head = job;
+  }
+  client->decode_tail = job;
+
+  job->offload = offload;
+  if(offload && uv_queue_work(client->uv_loop, &job->work, pc__decode_work,
+                              pc__decode_after_work) == 0) {
+    client->decode_jobs++;
+    return 0;
+  }
+
+  if(offload) {
+    // decode on loop rather than fail the message
+    pc__decode_work(&job->work);
+  }
+  job->done = 1;
+  pc__decode_drain(client);
+
+  return 0;
+}
+
+static int pc__data(pc_client_t *client, const char *data, size_t len) {
+  pc_msg_t *msg;
+
+  // the messages behind a large one wait for it to keep the order
+  if(client->decode_min_size > 0 &&
+     client->parse_msg == pc__default_msg_parse_cb &&
+     (client->decode_head || len >= client->decode_min_size)) {
+    return pc__decode_enqueue(client, data, len);
+  }
+
+  if(client->completion_mode &&
+     client->parse_msg == pc__default_msg_parse_cb) {
+    // not in arena, the message outlives the package
+    msg = pc__msg_parse(client, data, len, NULL, NULL);
+    return msg ? pc__complete_msg(client, msg) : -1;
+  }
+
+  msg = client->parse_msg(client, data, len);
+  if(msg == NULL) {
+    return -1;
+  }
+
+  pc__dispatch(client, msg);
 
   client->parse_msg_done(client, msg);
 
@@ -66,7 +421,7 @@ void pc__pkg_cb(pc_pkg_type type, const char *data, size_t len, void *attach) {
       status = pc__data(client, data, len);
     break;
     case PC_PKG_KICK:
-      pc_emit_event(client, PC_EVENT_KICK, NULL);
+      pc__emit_event(client, PC_EVENT_KICK, NULL);
     break;
     default:
       fprintf(stderr, "Unknown Pomelo package type: %d.\n", type);
@@ -79,76 +434,136 @@ void pc__pkg_cb(pc_pkg_type type, const char *data, size_t len, void *attach) {
   }
 }
 
-const char *pc__resolve_dictionary(pc_client_t *client,
-                                                 uint16_t code) {
-  char code_str[16];
-  memset(code_str, 0, 16);
-  sprintf(code_str, "%u", code & 0xff);
-  return json_string_value(json_object_get(client->code_to_route, code_str));
+static const pc_dict_route_t *pc__resolve_dictionary(pc_client_t *client,
+                                                     uint16_t code) {
+  if(code < client->code_to_route_count &&
+     client->code_to_route[code].route != NULL) {
+    return &client->code_to_route[code];
+  }
+  return NULL;
 }
 
-pc_msg_t *pc__default_msg_parse_cb(pc_client_t *client, const char *data,
-    size_t len) {
+static void *pc__msg_alloc(pc_arena_t *arena, size_t size) {
+  return arena ? pc_arena_alloc(arena, size)
+               : pc__malloc(size, PC_ALLOC_MESSAGE);
+}
+
+static char *pc__msg_copy_route(pc_arena_t *arena, const char *route) {
+  size_t len = strlen(route);
+  char *copy = (char *)pc__msg_alloc(arena, len + 1);
+
+  if(copy == NULL) {
+    fprintf(stderr, "Fail to malloc for message route.\n");
+    return NULL;
+  }
+  memcpy(copy, route, len + 1);
+
+  return copy;
+}
+
+/**
+ * Parse a message. With offload set, the json decode is left to caller and
+ * offload is kept 1, otherwise it is cleared.
+ */
+static pc_msg_t *pc__msg_parse(pc_client_t *client, const char *data,
+                               size_t len, pc_arena_t *arena, int *offload) {
   const char *route_str = NULL;
   pc_msg_t *msg = NULL;
+  pc__msg_raw_t raw;
+  pc__msg_raw_t *raw_msg = &raw;
+  int decode_later = offload ? *offload : 0;
 
-  pc__msg_raw_t *raw_msg = pc_msg_decode(data, len);
-  if(raw_msg == NULL) {
-    goto error;
+  if(offload) *offload = 0;
+
+  // route and body of raw message are views into the package
+  if(pc_msg_decode_raw(data, len, raw_msg)) {
+    return NULL;
   }
 
-  msg = (pc_msg_t *)malloc(sizeof(pc_msg_t));
+  msg = (pc_msg_t *)pc__msg_alloc(arena, sizeof(pc_msg_t));
   if(msg == NULL) {
     fprintf(stderr, "Fail to malloc for pc_msg_t while parsing raw message.\n");
     goto error;
   }
   memset(msg, 0, sizeof(pc_msg_t));
+  msg->arena = arena;
 
   msg->id = raw_msg->id;
 
   // route
-  if(PC_MSG_HAS_ROUTE(raw_msg->type)) {
-    const char *origin_route = NULL;
-    // uncompress route dictionary
-    if(raw_msg->compressRoute) {
-      origin_route = pc__resolve_dictionary(client, raw_msg->route.route_code);
-      if(origin_route == NULL) {
-        fprintf(stderr, "Fail to uncompress route dictionary: %d.\n",
-                raw_msg->route.route_code);
-        goto error;
-      }
-    } else {
-      origin_route = raw_msg->route.route_str;
+  if(PC_MSG_HAS_ROUTE(raw_msg->type) && raw_msg->compressRoute) {
+    // routes of dictionary are interned, no copy
+    const pc_dict_route_t *dict_route =
+        pc__resolve_dictionary(client, raw_msg->route.route_code);
+    if(dict_route == NULL) {
+      fprintf(stderr, "Fail to uncompress route dictionary: %d.\n",
+              raw_msg->route.route_code);
+      goto error;
     }
+    route_str = dict_route->route;
+    msg->route = route_str;
+    msg->route_interned = 1;
+  } else if(PC_MSG_HAS_ROUTE(raw_msg->type)) {
+    const char *origin_route;
+    size_t route_len = raw_msg->route_len;
 
-    route_str = (char *)malloc(strlen(origin_route) + 1);
+    origin_route = raw_msg->route.route_str ? raw_msg->route.route_str : "";
+    route_str = (char *)pc__msg_alloc(arena, route_len + 1);
     if(route_str == NULL) {
-      fprintf(stderr, "Fail to malloc for uncompress route dictionary.\n");
+      fprintf(stderr, "Fail to malloc for message route.\n");
       goto error;
     }
 
-    memcpy((void *)route_str, (void *)origin_route, strlen(origin_route) + 1);
+    memcpy((void *)route_str, (void *)origin_route, route_len);
+    ((char *)route_str)[route_len] = '\0';
     msg->route = route_str;
   } else {
-    // must be response, then get the route from requests map
-    char id_str[64];
-    memset(id_str, 0, 64);
-    sprintf(id_str, "%u", msg->id);
-    pc_request_t *req = (pc_request_t *)pc_map_get(client->requests, id_str);
-    if(req == NULL) {
-      fprintf(stderr, "Fail to get correlative request for the response: %u\n",
-              msg->id);
-      goto error;
+    // must be response, then take the request out for the route
+    msg->req = pc_req_table_del(client->requests, msg->id);
+    if(msg->req == NULL) {
+      // the request may have been timeout, discard the response body
+      return msg;
+    }
+    route_str = msg->req->route;
+    if(msg->req->route_handle) {
+      pc__route_update(client, msg->req->route_handle);
     }
-    route_str = req->route;
   }
 
   pc_buf_t body = raw_msg->body;
+  // keep a view for the typed listeners even if the body is empty
+  msg->body.base = body.base ? body.base : (char *)data;
+  msg->body.len = body.len;
+
+  if(msg->req ? msg->req->resp_codec != NULL || msg->req->raw_cb != NULL
+              : !pc__event_need_json(client, route_str)) {
+    // typed message is decoded without json later, and the raw one is
+    // decoded only if asked, see pc_msg_json
+    msg->lazy_client = client;
+    if(msg->req && msg->req->raw_cb && body.len > 0) {
+      // the definition is looked up by route when decoded, the request may
+      // be released by then
+      msg->route = pc__msg_copy_route(arena, route_str);
+      if(msg->route == NULL) {
+        goto error;
+      }
+    }
+    return msg;
+  }
+
+  if(body.len > 0 && decode_later) {
+    *offload = 1;
+    return msg;
+  }
+
   if(body.len > 0) {
-    json_t *pb_def = json_object_get(client->server_protos, route_str);
+    // responses of route handles skip the lookup of definition
+    const pc_pb_message_t *pb_def = msg->req && msg->req->route_handle
+        ? msg->req->route_handle->server_def
+        : pc_pb_schema_get(client->server_schema, route_str);
     if(pb_def) {
       // protobuf decode
-      msg->msg = pc__pb_decode(body.base, 0, body.len, client->server_protos, pb_def);
+      msg->msg = pc__pb_decode(body.base, 0, body.len, pb_def);
     } else {
       // json decode
       msg->msg = pc__json_decode(body.base, 0, body.len);
@@ -159,21 +574,92 @@ pc_msg_t *pc__default_msg_parse_cb(pc_client_t *client, const char *data,
     }
   }
 
-  // release resources nolong used
-  pc__raw_msg_destroy(raw_msg);
-
   return msg;
 
 error:
-  if(msg == NULL && route_str) free((void *)route_str);
-  if(raw_msg) pc__raw_msg_destroy(raw_msg);
+  // nothing of callback should go to arena
+  if(arena) pc__arena_stop_alloc();
+  if(msg && msg->req) {
+    // the request would never be responded
+    pc__request_timer_stop(client, msg->req);
+    msg->req->cb(msg->req, -1, NULL);
+  }
   if(msg) pc_msg_destroy(msg);
   return NULL;
 }
 
+pc_buf_t pc_msg_body(const pc_msg_t *msg) {
+  return msg->body;
+}
+
+json_t *pc_msg_json(pc_msg_t *msg) {
+  pc_client_t *client = msg->lazy_client;
+  const pc_pb_message_t *pb_def;
+
+  if(client == NULL || msg->body.len == 0) {
+    return msg->msg;
+  }
+  msg->lazy_client = NULL;
+
+  // polled completions are decoded out of loop thread
+  uv_rwlock_rdlock(&client->encode_rwlock);
+  pb_def = msg->route ? pc_pb_schema_get(client->server_schema, msg->route)
+                      : NULL;
+
+  // decode into the arena of message, which is still current in callback
+  if(msg->arena) pc__arena_enter(msg->arena);
+  if(pb_def) {
+    msg->msg = pc__pb_decode(msg->body.base, 0, msg->body.len, pb_def);
+  } else {
+    msg->msg = pc__json_decode(msg->body.base, 0, msg->body.len);
+  }
+  if(msg->arena) pc__arena_stop_alloc();
+  uv_rwlock_rdunlock(&client->encode_rwlock);
+
+  if(msg->msg == NULL) {
+    fprintf(stderr, "Fail to decode message: %s\n",
+            msg->route ? msg->route : "response");
+  }
+
+  return msg->msg;
+}
+
+pc_msg_t *pc__default_msg_parse_cb(pc_client_t *client, const char *data,
+    size_t len) {
+  pc_arena_t *arena = NULL;
+  pc_msg_t *msg;
+
+  if(client->msg_arena_size > 0) {
+    // fall back to heap if no arena
+    arena = pc__client_take_arena(client);
+    if(arena) pc__arena_enter(arena);
+  }
+
+  msg = pc__msg_parse(client, data, len, arena, NULL);
+
+  if(arena) {
+    // the arena stays current until the message is done, for the frees of
+    // its json in callbacks
+    pc__arena_stop_alloc();
+    if(msg == NULL) {
+      pc__arena_leave();
+      pc__client_put_arena(client, arena);
+    }
+  }
+
+  return msg;
+}
+
 void pc__default_msg_parse_done_cb(pc_client_t *client, pc_msg_t *msg) {
+  pc_arena_t *arena;
+
   if(msg != NULL) {
+    arena = msg->arena;
     pc_msg_destroy(msg);
+    if(arena) {
+      pc__arena_leave();
+      pc__client_put_arena(client, arena);
+    }
   }
 }
 
@@ -191,15 +677,15 @@ pc_buf_t pc__default_msg_encode_cb(pc_client_t *client, uint32_t reqId,
   // route encode
   int route_code = 0;
   json_t *code = json_object_get(client->route_to_code, route);
-  if(code) {
+  if(code && json_integer_value(code) <= PC_MSG_ROUTE_CODE_MAX) {
     // dictionary compress
     route_code = json_integer_value(code);
   }
 
   // encode body
-  json_t *pb_def = json_object_get(client->client_protos, route);
+  const pc_pb_message_t *pb_def = pc_pb_schema_get(client->client_schema, route);
   if(pb_def) {
-    body_buf = pc__pb_encode(msg, client->client_protos, pb_def);
+    body_buf = pc__pb_encode(msg, pb_def);
     if(body_buf.len == -1) {
       fprintf(stderr, "Fail to encode message with protobuf: %s\n", route);
       goto error;
@@ -242,16 +728,112 @@ pc_buf_t pc__default_msg_encode_cb(pc_client_t *client, uint32_t reqId,
   return msg_buf;
 
 error:
-  if(msg_buf.len != -1) free(msg_buf.base);
+  if(msg_buf.len != -1) pc__free(msg_buf.base, msg_buf.len, PC_ALLOC_MESSAGE);
   if(body_buf.len != -1) pc_jsonp_free(body_buf.base);
   msg_buf.len = -1;
   msg_buf.base = NULL;
   return msg_buf;
 }
 
+static int pc__frame_begin_route(pc_frame_builder_t *fb, uint32_t reqId,
+                                 const pc_route_t *route, size_t body_hint) {
+  pc_msg_type type = reqId == 0 ? PC_MSG_NOTIFY : PC_MSG_REQUEST;
+
+  // route is compressed by dictionary if it has a code
+  return pc_frame_begin(fb, reqId, type, route->route, route->len,
+                        route->code, body_hint);
+}
+
+pc_buf_t pc__default_frame_encode(pc_client_t *client, uint32_t reqId,
+                                  const pc_route_t *route, json_t *msg,
+                                  size_t *size) {
+  pc_frame_builder_t fb;
+  pc_buf_t buf;
+  int res;
+
+  if(pc__frame_begin_route(&fb, reqId, route, 0)) {
+    goto error;
+  }
+
+  // encode body right after the headroom
+  if(route->client_def) {
+    res = pc__pb_encode_frame(&fb, msg, route->client_def);
+    if(res) {
+      fprintf(stderr, "Fail to encode message with protobuf: %s\n",
+              route->route);
+    }
+  } else {
+    res = pc__json_encode_frame(&fb, msg);
+    if(res) {
+      fprintf(stderr, "Fail to encode message with json: %s\n", route->route);
+    }
+  }
+
+  if(res) {
+    pc_frame_abort(&fb);
+    goto error;
+  }
+
+  return pc_frame_finish(&fb, size);
+
+error:
+  buf.base = NULL;
+  buf.len = -1;
+  return buf;
+}
+
+pc_buf_t pc__body_frame_encode(pc_client_t *client, uint32_t reqId,
+                               const pc_route_t *route, pc_buf_t body,
+                               size_t *size) {
+  pc_frame_builder_t fb;
+  pc_buf_t buf;
+
+  // the body goes right after the route prefix, the frame never grows
+  if(pc__frame_begin_route(&fb, reqId, route, body.len) ||
+     (body.len > 0 && pc_frame_append(&fb, body.base, body.len))) {
+    fprintf(stderr, "Fail to encode message body: %s\n", route->route);
+    pc_frame_abort(&fb);
+    buf.base = NULL;
+    buf.len = -1;
+    return buf;
+  }
+
+  return pc_frame_finish(&fb, size);
+}
+
+pc_buf_t pc__typed_frame_encode(pc_client_t *client, uint32_t reqId,
+                                const pc_route_t *route,
+                                const pc_typed_codec_t *codec,
+                                const void *msg, size_t *size) {
+  pc_frame_builder_t fb;
+  pc_buf_t buf;
+  size_t body_len = codec->size(msg);
+  char *base;
+
+  // exact size of body is known, so the frame never grows
+  if(pc__frame_begin_route(&fb, reqId, route, body_len)) {
+    goto error;
+  }
+
+  base = pc_frame_reserve(&fb, body_len);
+  if(base == NULL || codec->encode(msg, (uint8_t *)base, body_len)) {
+    fprintf(stderr, "Fail to encode typed message: %s\n", route->route);
+    pc_frame_abort(&fb);
+    goto error;
+  }
+  fb.len += body_len;
+
+  return pc_frame_finish(&fb, size);
+
+error:
+  buf.base = NULL;
+  buf.len = -1;
+  return buf;
+}
+
 void pc__default_msg_encode_done_cb(pc_client_t *client, pc_buf_t buf) {
   if(buf.len > 0) {
-    free(buf.base);
+    pc__free(buf.base, buf.len, PC_ALLOC_MESSAGE);
   }
 }
 
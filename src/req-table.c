@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <string.h>
+#include "pomelo-private/req-table.h"
+#include "pomelo-private/alloc.h"
+
+static int pc__req_table_grow(pc_req_table_t *table);
+
+pc_req_table_t *pc_req_table_new(uint32_t capacity,
+                                 pc_req_table_release release_req) {
+  pc_req_table_t *table = NULL;
+  uint32_t cap = PC__REQ_TABLE_DEFAULT_CAPACITY;
+
+  while(cap < capacity) {
+    cap <<= 1;
+  }
+
+  table = (pc_req_table_t *)pc__malloc(sizeof(pc_req_table_t), PC_ALLOC_MAP);
+  if(table == NULL) {
+    fprintf(stderr, "Fail to malloc for pc_req_table_t.\n");
+    return NULL;
+  }
+  memset(table, 0, sizeof(pc_req_table_t));
+
+  table->slots = (pc__req_slot_t *)pc__malloc(sizeof(pc__req_slot_t) * cap,
+                                              PC_ALLOC_MAP);
+  if(table->slots == NULL) {
+    fprintf(stderr, "Fail to malloc for request table slots.\n");
+    pc__free(table, sizeof(pc_req_table_t), PC_ALLOC_MAP);
+    return NULL;
+  }
+  memset(table->slots, 0, sizeof(pc__req_slot_t) * cap);
+
+  table->capacity = cap;
+  table->release_req = release_req;
+
+  return table;
+}
+
+void pc_req_table_destroy(pc_req_table_t *table) {
+  pc_req_table_clear(table);
+  pc__free(table->slots, sizeof(pc__req_slot_t) * table->capacity,
+           PC_ALLOC_MAP);
+  pc__free(table, sizeof(pc_req_table_t), PC_ALLOC_MAP);
+}
+
+int pc_req_table_set(pc_req_table_t *table, uint32_t id,
+                     struct pc_request_s *req) {
+  uint32_t mask, i;
+
+  if((table->count + 1) * 2 > table->capacity && pc__req_table_grow(table)) {
+    return -1;
+  }
+
+  mask = table->capacity - 1;
+  for(i = id & mask; table->slots[i].req; i = (i + 1) & mask) {
+    if(table->slots[i].id == id) {
+      break;
+    }
+  }
+
+  if(table->slots[i].req == NULL) {
+    table->count++;
+  }
+  table->slots[i].id = id;
+  table->slots[i].req = req;
+
+  return 0;
+}
+
+struct pc_request_s *pc_req_table_get(pc_req_table_t *table, uint32_t id) {
+  uint32_t mask = table->capacity - 1;
+  uint32_t i;
+
+  for(i = id & mask; table->slots[i].req; i = (i + 1) & mask) {
+    if(table->slots[i].id == id) {
+      return table->slots[i].req;
+    }
+  }
+
+  return NULL;
+}
+
+struct pc_request_s *pc_req_table_del(pc_req_table_t *table, uint32_t id) {
+  uint32_t mask = table->capacity - 1;
+  uint32_t i, j, home;
+  struct pc_request_s *req;
+
+  for(i = id & mask; table->slots[i].req; i = (i + 1) & mask) {
+    if(table->slots[i].id == id) {
+      break;
+    }
+  }
+
+  req = table->slots[i].req;
+  if(req == NULL) {
+    return NULL;
+  }
+
+  // shift the following slots back to keep the probe chains unbroken
+  for(j = (i + 1) & mask; table->slots[j].req; j = (j + 1) & mask) {
+    home = table->slots[j].id & mask;
+    if(((j - home) & mask) >= ((j - i) & mask)) {
+      table->slots[i] = table->slots[j];
+      i = j;
+    }
+  }
+
+  table->slots[i].req = NULL;
+  table->count--;
+
+  return req;
+}
+
+void pc_req_table_clear(pc_req_table_t *table) {
+  struct pc_request_s *req;
+  uint32_t i;
+
+  for(i = 0; i < table->capacity && table->count > 0; i++) {
+    req = table->slots[i].req;
+    if(req == NULL) {
+      continue;
+    }
+
+    // detach before release, the callback may touch the table
+    table->slots[i].req = NULL;
+    table->count--;
+    if(table->release_req) {
+      table->release_req(table, req);
+    }
+  }
+}
+
+static int pc__req_table_grow(pc_req_table_t *table) {
+  pc__req_slot_t *old_slots = table->slots;
+  uint32_t old_cap = table->capacity;
+  uint32_t cap = old_cap << 1;
+  uint32_t mask = cap - 1;
+  uint32_t i, j;
+
+  pc__req_slot_t *slots = (pc__req_slot_t *)pc__malloc(
+      sizeof(pc__req_slot_t) * cap, PC_ALLOC_MAP);
+  if(slots == NULL) {
+    fprintf(stderr, "Fail to malloc for request table slots.\n");
+    return -1;
+  }
+  memset(slots, 0, sizeof(pc__req_slot_t) * cap);
+
+  for(i = 0; i < old_cap; i++) {
+    if(old_slots[i].req == NULL) {
+      continue;
+    }
+    for(j = old_slots[i].id & mask; slots[j].req; j = (j + 1) & mask);
+    slots[j] = old_slots[i];
+  }
+
+  table->slots = slots;
+  table->capacity = cap;
+  pc__free(old_slots, sizeof(pc__req_slot_t) * old_cap, PC_ALLOC_MAP);
+
+  return 0;
+}
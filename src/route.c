@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <string.h>
+#include "pomelo.h"
+#include "pomelo-protocol/message.h"
+#include "pomelo-private/internal.h"
+#include "pomelo-private/map.h"
+#include "pomelo-private/alloc.h"
+#include "pomelo-private/atomic.h"
+
+#define PC__ROUTE_SIZE(len) (sizeof(pc_route_t) + (len) + 1)
+
+static void pc__route_release(pc_map_t *map, const char *key, void *value) {
+  pc_route_t *route = (pc_route_t *)value;
+  pc__free(route, PC__ROUTE_SIZE(route->len), PC_ALLOC_CLIENT);
+}
+
+int pc__routes_init(pc_client_t *client) {
+  client->routes = pc_map_new(256, pc__route_release);
+  if(client->routes == NULL) {
+    return -1;
+  }
+
+  uv_mutex_init(&client->route_mutex);
+  uv_rwlock_init(&client->encode_rwlock);
+  // handles start with generation 0, so they are filled on first use
+  client->route_gen = 1;
+  return 0;
+}
+
+void pc__routes_clear(pc_client_t *client) {
+  if(client->routes) {
+    pc_map_destroy(client->routes);
+    client->routes = NULL;
+    uv_mutex_destroy(&client->route_mutex);
+    uv_rwlock_destroy(&client->encode_rwlock);
+  }
+}
+
+void pc__routes_invalidate(pc_client_t *client) {
+  unsigned int gen = client->route_gen + 1;
+
+  pc__atomic_store_int(&client->route_gen, gen ? gen : 1);
+}
+
+pc_route_t *pc_route_resolve(pc_client_t *client, const char *route) {
+  pc_route_t *handle;
+  size_t len;
+
+  if(client == NULL || route == NULL) {
+    fprintf(stderr, "Invalid route to resolve.\n");
+    return NULL;
+  }
+
+  uv_mutex_lock(&client->route_mutex);
+  handle = (pc_route_t *)pc_map_get(client->routes, route);
+  if(handle) {
+    uv_mutex_unlock(&client->route_mutex);
+    return handle;
+  }
+
+  len = strlen(route);
+  handle = (pc_route_t *)pc__malloc(PC__ROUTE_SIZE(len), PC_ALLOC_CLIENT);
+  if(handle == NULL) {
+    fprintf(stderr, "Fail to malloc for pc_route_t.\n");
+    goto error;
+  }
+
+  memset(handle, 0, sizeof(pc_route_t));
+  // route string lives right after the handle
+  memcpy((char *)(handle + 1), route, len + 1);
+  handle->route = (const char *)(handle + 1);
+  handle->len = len;
+  handle->client = client;
+
+  if(pc_map_set(client->routes, route, handle)) {
+    fprintf(stderr, "Fail to add route handle: %s\n", route);
+    pc__free(handle, PC__ROUTE_SIZE(len), PC_ALLOC_CLIENT);
+    handle = NULL;
+    goto error;
+  }
+
+error:
+  uv_mutex_unlock(&client->route_mutex);
+  return handle;
+}
+
+/**
+ * Look up what the encode of route needs. Only called in loop thread, where
+ * the dictionary and the protos are changed.
+ */
+static void pc__route_fill_encode(pc_client_t *client, pc_route_t *route) {
+  json_t *code = json_object_get(client->route_to_code, route->route);
+  json_int_t value = code ? json_integer_value(code) : 0;
+
+  // the codes out of 16 bits are never compressed
+  route->code = value > 0 && value <= PC_MSG_ROUTE_CODE_MAX ? (int)value : 0;
+  route->client_def = pc_pb_schema_get(client->client_schema, route->route);
+}
+
+void pc__route_update(pc_client_t *client, pc_route_t *route) {
+  unsigned int gen = pc__atomic_load_int(&client->route_gen);
+
+  // filled already, the cache is published by the store of its generation
+  if(pc__atomic_load_int(&route->gen) == gen) {
+    return;
+  }
+
+  // handles may be shared by the threads encoding on their own
+  uv_mutex_lock(&client->route_mutex);
+  gen = client->route_gen;
+  if(route->gen != gen) {
+    pc__route_fill_encode(client, route);
+    route->server_def = pc_pb_schema_get(client->server_schema, route->route);
+    pc__atomic_store_int(&route->gen, gen);
+  }
+  uv_mutex_unlock(&client->route_mutex);
+}
+
+void pc__route_lookup(pc_client_t *client, const char *route,
+                      pc_route_t *out) {
+  memset(out, 0, sizeof(pc_route_t));
+  out->route = route;
+  out->len = strlen(route);
+  out->client = client;
+  // the response definition is looked up by pc__msg_parse if needed
+  pc__route_fill_encode(client, out);
+}
+
+static void pc__routes_release_dict(pc_client_t *client) {
+  if(client->code_to_route) {
+    pc__free(client->code_to_route,
+             client->code_to_route_count * sizeof(pc_dict_route_t),
+             PC_ALLOC_CLIENT);
+    client->code_to_route = NULL;
+    client->code_to_route_count = 0;
+  }
+  if(client->route_to_code) {
+    json_decref(client->route_to_code);
+    client->route_to_code = NULL;
+  }
+}
+
+void pc__routes_clear_dict(pc_client_t *client) {
+  uv_rwlock_wrlock(&client->encode_rwlock);
+  pc__routes_release_dict(client);
+  uv_rwlock_wrunlock(&client->encode_rwlock);
+}
+
+int pc__routes_set_dict(pc_client_t *client, json_t *dict) {
+  const char *key;
+  json_t *value;
+  json_int_t code;
+  size_t count = 0;
+  pc_dict_route_t *routes = NULL;
+
+  json_object_foreach(dict, key, value) {
+    code = json_integer_value(value);
+    if(code <= 0 || code > PC_MSG_ROUTE_CODE_MAX) {
+      fprintf(stderr, "Invalid route code of dictionary: %s, %ld\n", key,
+              (long)code);
+      continue;
+    }
+    if((size_t)code >= count) {
+      count = (size_t)code + 1;
+    }
+  }
+
+  if(count > 0) {
+    routes = (pc_dict_route_t *)pc__calloc(count, sizeof(pc_dict_route_t),
+                                           PC_ALLOC_CLIENT);
+    if(routes == NULL) {
+      fprintf(stderr, "Fail to malloc for route dictionary.\n");
+      return -1;
+    }
+
+    // keys of dict stay as long as the dict is referenced by client
+    json_object_foreach(dict, key, value) {
+      code = json_integer_value(value);
+      if(code > 0 && code <= PC_MSG_ROUTE_CODE_MAX) {
+        routes[code].route = key;
+        routes[code].len = strlen(key);
+      }
+    }
+  }
+
+  uv_rwlock_wrlock(&client->encode_rwlock);
+  pc__routes_release_dict(client);
+  client->code_to_route = routes;
+  client->code_to_route_count = count;
+  json_incref(dict);
+  client->route_to_code = dict;
+  uv_rwlock_wrunlock(&client->encode_rwlock);
+  return 0;
+}
@@ -37,7 +37,7 @@ void pc__worker(void *arg) {
   // make sure the state
   client->state = PC_ST_CLOSED;
 
-  pc_emit_event(client, PC_EVENT_DISCONNECT, NULL);
+  pc__emit_event(client, PC_EVENT_DISCONNECT, NULL);
   // The cleanup in worker thread leads to race
   //! pc__client_clear(client);
   pc__cond_broadcast(client);
@@ -0,0 +1,71 @@
+#include <stddef.h>
+#include "pomelo-private/timing-wheel.h"
+
+void pc_wheel_init(pc_timing_wheel_t *wheel, uint64_t now) {
+  int i;
+  for(i = 0; i < PC_WHEEL_SLOTS; i++) {
+    ngx_queue_init(&wheel->slots[i]);
+  }
+  wheel->tick = now / PC_WHEEL_TICK_MS;
+  wheel->count = 0;
+}
+
+void pc_wheel_add(pc_timing_wheel_t *wheel, pc_wheel_node_t *node,
+                  uint64_t deadline) {
+  // round up, so the node is due once the wheel reaches its tick
+  uint64_t tick = (deadline + PC_WHEEL_TICK_MS - 1) / PC_WHEEL_TICK_MS;
+
+  // a deadline in the passed ticks expires on the next tick
+  if(tick <= wheel->tick) {
+    tick = wheel->tick + 1;
+  }
+
+  node->deadline = deadline ? deadline : 1;
+  ngx_queue_insert_tail(&wheel->slots[tick % PC_WHEEL_SLOTS], &node->queue);
+  wheel->count++;
+}
+
+void pc_wheel_remove(pc_timing_wheel_t *wheel, pc_wheel_node_t *node) {
+  if(node->deadline == 0) {
+    return;
+  }
+
+  ngx_queue_remove(&node->queue);
+  node->deadline = 0;
+  wheel->count--;
+}
+
+void pc_wheel_expire(pc_timing_wheel_t *wheel, uint64_t now,
+                     ngx_queue_t *expired) {
+  uint64_t target = now / PC_WHEEL_TICK_MS;
+  uint64_t ticks = target - wheel->tick;
+  ngx_queue_t *q, *next, *slot;
+  pc_wheel_node_t *node;
+
+  if(target <= wheel->tick) {
+    return;
+  }
+
+  // every slot is visited at most once
+  if(ticks > PC_WHEEL_SLOTS) {
+    ticks = PC_WHEEL_SLOTS;
+  }
+
+  while(ticks-- > 0 && wheel->count > 0) {
+    slot = &wheel->slots[(target - ticks) % PC_WHEEL_SLOTS];
+    q = ngx_queue_head(slot);
+    while(q != ngx_queue_sentinel(slot)) {
+      next = ngx_queue_next(q);
+      node = ngx_queue_data(q, pc_wheel_node_t, queue);
+      if(node->deadline <= now) {
+        ngx_queue_remove(q);
+        node->deadline = 0;
+        wheel->count--;
+        ngx_queue_insert_tail(expired, q);
+      }
+      q = next;
+    }
+  }
+
+  wheel->tick = target;
+}
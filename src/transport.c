@@ -1,18 +1,34 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include "pomelo.h"
 #include "pomelo-private/transport.h"
+#include "pomelo-private/internal.h"
+#include "pomelo-private/common.h"
+#include "pomelo-private/alloc.h"
+#include "pomelo-private/pool.h"
 #include "pomelo-protocol/package.h"
 
+static void pc__transport_fail_frames(pc_transport_t *transport,
+                                      ngx_queue_t *frames);
+static void pc__transport_write_cb(uv_write_t *req, int status);
+static void pc__flush_idle_cb(uv_idle_t *handle, int status);
+
 void pc__tcp_close_cb(uv_handle_t *handler) {
   pc_transport_t *transport = (pc_transport_t *)handler->data;
-  free(handler);
-  free(transport);
+  pc_client_t *client = transport->client;
+  pc__free(handler, sizeof(uv_tcp_t), PC_ALLOC_HANDLE);
+  pc__free(transport->read_buf, transport->read_buf_size, PC_ALLOC_TRANSPORT);
+  pc__free(transport, sizeof(pc_transport_t), PC_ALLOC_TRANSPORT);
+  pc__client_handle_closed(client);
 }
 
 pc_transport_t *pc_transport_new(pc_client_t *client) {
-  pc_transport_t *transport = (pc_transport_t *)malloc(sizeof(pc_transport_t));
+  pc_transport_t *transport;
+
+  transport = (pc_transport_t *)pc__malloc(sizeof(pc_transport_t),
+                                           PC_ALLOC_TRANSPORT);
 
   if(transport == NULL) {
     fprintf(stderr, "Fail to malloc for pc_transport_t.\n");
@@ -22,7 +38,7 @@ pc_transport_t *pc_transport_new(pc_client_t *client) {
   memset(transport, 0, sizeof(pc_transport_t));
 
   transport->client = client;
-  transport->socket = (uv_tcp_t *)malloc(sizeof(uv_tcp_t));
+  transport->socket = (uv_tcp_t *)pc__malloc(sizeof(uv_tcp_t), PC_ALLOC_HANDLE);
   if(transport->socket == NULL) {
     fprintf(stderr, "Fail to malloc for uv_tcp_t.\n");
     goto error;
@@ -35,12 +51,15 @@ pc_transport_t *pc_transport_new(pc_client_t *client) {
 
   transport->socket->data = transport;
   transport->state = PC_TP_ST_INITED;
+  ngx_queue_init(&transport->frames);
 
   return transport;
 
 error:
-  if(transport->socket) free(transport->socket);
-  if(transport) free(transport);
+  if(transport) {
+    pc__free(transport->socket, sizeof(uv_tcp_t), PC_ALLOC_HANDLE);
+    pc__free(transport, sizeof(pc_transport_t), PC_ALLOC_TRANSPORT);
+  }
 
   return NULL;
 }
@@ -50,14 +69,184 @@ void pc_transport_destroy(pc_transport_t *transport) {
     return;
   }
   if(PC_TP_ST_INITED == transport->state) {
-    free(transport);
+    pc__free(transport, sizeof(pc_transport_t), PC_ALLOC_TRANSPORT);
     return;
   }
 
   transport->state = PC_TP_ST_CLOSED;
+  pc__transport_fail_frames(transport, &transport->frames);
+  transport->nframes = 0;
+  transport->frame_bytes = 0;
+
+  // the writes in flight would be canceled by close
+  transport->client->closing_handles++;
   uv_close((uv_handle_t *)transport->socket, pc__tcp_close_cb);
 }
 
+int pc_transport_write(pc_transport_t *transport, char *base, size_t len,
+                       size_t size, pc_frame_cb cb, void *data) {
+  pc_client_t *client = transport->client;
+  pc__frame_t *frame = NULL;
+
+  if(PC_TP_ST_CONNECTING != transport->state &&
+     PC_TP_ST_WORKING != transport->state) {
+    fprintf(stderr, "Fail to write frame for invalid transport state: %d.\n",
+            transport->state);
+    return -1;
+  }
+
+  frame = (pc__frame_t *)pc_pool_get(client->frame_pool);
+  if(frame == NULL) {
+    fprintf(stderr, "Fail to malloc for pc__frame_t.\n");
+    return -1;
+  }
+
+  frame->base = base;
+  frame->len = len;
+  frame->size = size;
+  frame->cb = cb;
+  frame->data = data;
+  ngx_queue_insert_tail(&transport->frames, &frame->queue);
+  transport->nframes++;
+  transport->frame_bytes += len;
+
+  if(transport->nframes >= client->write_batch_frames ||
+     transport->frame_bytes >= client->write_batch_bytes) {
+    pc_transport_flush(transport);
+    return 0;
+  }
+
+  if(!uv_is_active((uv_handle_t *)client->flush_check)) {
+    uv_check_start(client->flush_check, pc__flush_check_cb);
+    uv_idle_start(client->flush_idle, pc__flush_idle_cb);
+  }
+
+  return 0;
+}
+
+void pc_transport_flush(pc_transport_t *transport) {
+  pc_client_t *client = transport->client;
+  pc__write_batch_t *batch = NULL;
+  // the default batch needs no allocation for the buffer array
+  uv_buf_t bufs_sml[PC_WRITE_BATCH_FRAMES];
+  uv_buf_t *bufs = bufs_sml;
+  ngx_queue_t *q;
+  pc__frame_t *frame;
+  int i, n, res;
+
+  while(!ngx_queue_empty(&transport->frames)) {
+    batch = (pc__write_batch_t *)pc_pool_get(client->batch_pool);
+    if(batch == NULL) {
+      fprintf(stderr, "Fail to malloc for pc__write_batch_t.\n");
+      goto error;
+    }
+    memset(batch, 0, sizeof(pc__write_batch_t));
+    batch->transport = transport;
+    batch->req.data = batch;
+    ngx_queue_init(&batch->frames);
+
+    n = MIN(transport->nframes, client->write_batch_frames);
+    if(n > PC_WRITE_BATCH_FRAMES) {
+      bufs = (uv_buf_t *)pc__malloc(sizeof(uv_buf_t) * n, PC_ALLOC_TRANSPORT);
+      if(bufs == NULL) {
+        fprintf(stderr, "Fail to malloc for write buffers.\n");
+        pc_pool_put(client->batch_pool, batch);
+        goto error;
+      }
+    }
+
+    for(i = 0; i < n; i++) {
+      q = ngx_queue_head(&transport->frames);
+      ngx_queue_remove(q);
+      frame = ngx_queue_data(q, pc__frame_t, queue);
+      ngx_queue_insert_tail(&batch->frames, q);
+      bufs[i] = uv_buf_init(frame->base, frame->len);
+      transport->nframes--;
+      transport->frame_bytes -= frame->len;
+    }
+
+    // uv_write copies the buffer array
+    res = uv_write(&batch->req, (uv_stream_t *)transport->socket,
+                   bufs, n, pc__transport_write_cb);
+    if(bufs != bufs_sml) {
+      pc__free(bufs, sizeof(uv_buf_t) * n, PC_ALLOC_TRANSPORT);
+      bufs = bufs_sml;
+    }
+
+    if(res) {
+      fprintf(stderr, "Send message error %s\n",
+              uv_err_name(uv_last_error(client->uv_loop)));
+      pc__transport_fail_frames(transport, &batch->frames);
+      pc_pool_put(client->batch_pool, batch);
+      goto error;
+    }
+  }
+
+  return;
+
+error:
+  pc__transport_fail_frames(transport, &transport->frames);
+  transport->nframes = 0;
+  transport->frame_bytes = 0;
+}
+
+void pc__flush_check_cb(uv_check_t *handle, int status) {
+  pc_client_t *client = (pc_client_t *)handle->data;
+
+  uv_check_stop(client->flush_check);
+  uv_idle_stop(client->flush_idle);
+
+  if(client->transport) {
+    pc_transport_flush(client->transport);
+  }
+}
+
+static void pc__flush_idle_cb(uv_idle_t *handle, int status) {
+  // nothing to do, an active idle handle makes the poll non-blocking
+}
+
+static void pc__transport_fail_frames(pc_transport_t *transport,
+                                      ngx_queue_t *frames) {
+  pc_client_t *client = transport->client;
+  ngx_queue_t *q;
+  pc__frame_t *frame;
+
+  while(!ngx_queue_empty(frames)) {
+    q = ngx_queue_head(frames);
+    ngx_queue_remove(q);
+    frame = ngx_queue_data(q, pc__frame_t, queue);
+    pc__free(frame->base, frame->size, PC_ALLOC_PACKAGE);
+    frame->cb(transport, frame->data, -1);
+    pc_pool_put(client->frame_pool, frame);
+  }
+}
+
+static void pc__transport_write_cb(uv_write_t *req, int status) {
+  pc__write_batch_t *batch = (pc__write_batch_t *)req->data;
+  pc_transport_t *transport = batch->transport;
+  pc_client_t *client = transport->client;
+  ngx_queue_t *q;
+  pc__frame_t *frame;
+
+  pc_last_update_time = time(NULL);
+
+  if(status == -1) {
+    fprintf(stderr, "Write error %s\n",
+            uv_err_name(uv_last_error(client->uv_loop)));
+  }
+
+  while(!ngx_queue_empty(&batch->frames)) {
+    q = ngx_queue_head(&batch->frames);
+    ngx_queue_remove(q);
+    frame = ngx_queue_data(q, pc__frame_t, queue);
+    pc__free(frame->base, frame->size, PC_ALLOC_PACKAGE);
+    frame->cb(transport, frame->data, status);
+    pc_pool_put(client->frame_pool, frame);
+  }
+
+  pc_pool_put(client->batch_pool, batch);
+}
+
 int pc_transport_start(pc_transport_t *transport) {
   if(PC_TP_ST_CONNECTING != transport->state) {
     fprintf(stderr, "Fail to start transport for invalid state: %d.\n",
@@ -77,6 +266,56 @@ void pc_client_on_tcp_read(pc_client_t *client, const char *data, size_t len) {
   }
 }
 
+uv_buf_t pc_tp_alloc_buffer(uv_handle_t *handle, size_t suggested_size) {
+  pc_transport_t *transport = (pc_transport_t *)handle->data;
+  size_t size = transport->read_buf_size;
+
+  if(size == 0) {
+    size = MIN(PC_READ_BUF_MIN, suggested_size);
+  } else if(transport->read_full) {
+    // last read filled the buffer, more data is likely pending
+    size = MIN(size * 2, suggested_size);
+  } else if(transport->read_small >= PC_READ_SHRINK_READS) {
+    // the burst is over, give the buffer back by halves
+    size = MAX(size / 2, PC_READ_BUF_MIN);
+    transport->read_small = 0;
+  }
+  transport->read_full = 0;
+
+  if(size != transport->read_buf_size) {
+    pc__free(transport->read_buf, transport->read_buf_size,
+            PC_ALLOC_TRANSPORT);
+    transport->read_buf = (char *)pc__malloc(size, PC_ALLOC_TRANSPORT);
+    if(transport->read_buf == NULL) {
+      fprintf(stderr, "Fail to malloc for receive buffer, size: %lu.\n",
+              (unsigned long)size);
+      transport->read_buf_size = 0;
+      return uv_buf_init(NULL, 0);
+    }
+    transport->read_buf_size = size;
+  }
+
+  return uv_buf_init(transport->read_buf, size);
+}
+
+/**
+ * Track the reads against the receive buffer. The buffer grown by a burst
+ * is halved once PC_READ_SHRINK_READS reads in a row left it mostly empty,
+ * so a single small read between bursts keeps it, while a connection gone
+ * quiet falls back to PC_READ_BUF_MIN.
+ */
+static void pc__tp_read_adapt(pc_transport_t *transport, size_t nread) {
+  if(nread == transport->read_buf_size) {
+    transport->read_full = 1;
+    transport->read_small = 0;
+  } else if(transport->read_buf_size > PC_READ_BUF_MIN &&
+            nread < transport->read_buf_size / 4) {
+    transport->read_small++;
+  } else {
+    transport->read_small = 0;
+  }
+}
+
 /**
  * Tcp data reached callback.
  */
@@ -86,7 +325,7 @@ void pc_tp_on_tcp_read(uv_stream_t *socket, ssize_t nread, uv_buf_t buf) {
   if(PC_TP_ST_WORKING != transport->state) {
     fprintf(stderr, "Discard read data for transport has stop work: %d\n",
             transport->state);
-    goto error;
+    return;
   }
 
   if (nread == -1) {
@@ -95,19 +334,19 @@ void pc_tp_on_tcp_read(uv_stream_t *socket, ssize_t nread, uv_buf_t buf) {
               uv_err_name(uv_last_error(transport->client->uv_loop)));
     transport->client->reconnecting = 0;
     pc_client_stop(transport->client);
-    goto error;
+    return;
   }
 
   if(nread == 0) {
     // read noting
-    free(buf.base);
     return;
   }
 
+  // the data is consumed by package parser before the buffer reused
   pc_client_on_tcp_read(transport->client, buf.base, nread);
 
-error:
-  if(buf.len != -1) {
-    free(buf.base);
+  // the transport is released after closed, the buffer with it
+  if(PC_TP_ST_WORKING == transport->state) {
+    pc__tp_read_adapt(transport, nread);
   }
 }
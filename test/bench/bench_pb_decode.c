@@ -0,0 +1,112 @@
+/**
+ * Benchmark for protobuf decoding of a position sync push with long repeated
+ * fields.
+ *
+ *   stream: every byte read through the callback of the input stream, the
+ *           way the decoder works for any stream.
+ *   buffer: varints decoded right from the memory of the buffer and packed
+ *           numbers decoded in one loop, used by pc_pb_decode_message.
+ *
+ * Usage: bench_pb_decode [path length] [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "uv.h"
+#include "pomelo-protobuf/pb.h"
+
+static const char *protos_json =
+  "{\"onMove\": {"
+  "  \"entityId\": {\"option\": \"required\", \"type\": \"uInt32\", \"tag\": 1},"
+  "  \"path\": {\"option\": \"repeated\", \"type\": \"Path\", \"tag\": 2},"
+  "  \"ids\": {\"option\": \"repeated\", \"type\": \"uInt32\", \"tag\": 3},"
+  "  \"deltas\": {\"option\": \"repeated\", \"type\": \"sInt32\", \"tag\": 4},"
+  "  \"speeds\": {\"option\": \"repeated\", \"type\": \"float\", \"tag\": 5},"
+  "  \"__messages\": {\"Path\": {"
+  "    \"x\": {\"option\": \"required\", \"type\": \"uInt32\", \"tag\": 1},"
+  "    \"y\": {\"option\": \"required\", \"type\": \"uInt32\", \"tag\": 2}"
+  "  }}"
+  "}}";
+
+static json_t *bench_msg(int len) {
+  json_t *msg = json_object();
+  json_t *path = json_array();
+  json_t *ids = json_array();
+  json_t *deltas = json_array();
+  json_t *speeds = json_array();
+  int i;
+
+  for(i = 0; i < len; i++) {
+    json_array_append_new(path, json_pack("{s:i,s:i}", "x", 1000 + i * 37,
+                                          "y", 70000 + i * 131));
+    json_array_append_new(ids, json_integer(i * 4099));
+    json_array_append_new(deltas, json_integer(i % 2 ? -i * 3 : i * 5));
+    json_array_append_new(speeds, json_real(i * 0.5));
+  }
+
+  json_object_set_new(msg, "entityId", json_integer(14));
+  json_object_set_new(msg, "path", path);
+  json_object_set_new(msg, "ids", ids);
+  json_object_set_new(msg, "deltas", deltas);
+  json_object_set_new(msg, "speeds", speeds);
+  return msg;
+}
+
+static json_t *decode(uint8_t *buf, size_t len, const pc_pb_message_t *proto,
+                      int fast) {
+  json_t *result = json_object();
+  int res = fast ? pc_pb_decode_message(buf, len, proto, result)
+                 : pc_pb_decode_message_stream(buf, len, proto, result);
+
+  if(!res) {
+    exit(1);
+  }
+  return result;
+}
+
+int main(int argc, char **argv) {
+  int len = argc > 1 ? atoi(argv[1]) : 200;
+  int rounds = argc > 2 ? atoi(argv[2]) : 2000;
+  json_t *protos = json_loads(protos_json, 0, NULL);
+  pc_pb_schema_t *schema = pc_pb_schema_new(protos);
+  const pc_pb_message_t *proto = pc_pb_schema_get(schema, "onMove");
+  json_t *msg = bench_msg(len);
+  json_t *result[2];
+  uint8_t *buf;
+  size_t size;
+  uint64_t start, cost[2];
+  int fast, i;
+
+  buf = (uint8_t *)malloc(len * 64 + 64);
+  if(!pc_pb_encode_message(buf, len * 64 + 64, &size, proto, msg)) {
+    fprintf(stderr, "encode error\n");
+    return 1;
+  }
+
+  for(fast = 0; fast < 2; fast++) {
+    result[fast] = decode(buf, size, proto, fast);
+    start = uv_hrtime();
+    for(i = 0; i < rounds; i++) {
+      json_decref(decode(buf, size, proto, fast));
+    }
+    cost[fast] = uv_hrtime() - start;
+  }
+
+  if(!json_equal(result[0], result[1]) || !json_equal(result[1], msg)) {
+    fprintf(stderr, "decode results differ\n");
+    return 1;
+  }
+
+  printf("%d rounds of %lu bytes, path length %d\n", rounds,
+         (unsigned long)size, len);
+  printf("stream: %8.2f us/msg\n", cost[0] / 1e3 / rounds);
+  printf("buffer: %8.2f us/msg\n", cost[1] / 1e3 / rounds);
+
+  json_decref(result[0]);
+  json_decref(result[1]);
+  json_decref(msg);
+  json_decref(protos);
+  pc_pb_schema_destroy(schema);
+  free(buf);
+  return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * Benchmark for the submission of writes from other threads to a uv loop.
+ *
+ *   async: one uv_async_t per message, the way pc__async_write used to work,
+ *          every message costs a handle registration, a pipe write and a close.
+ *   mpsc:  messages are pushed to the lock-free queue of pomelo and one
+ *          persistent uv_async_t drains all of them on each wakeup.
+ *
+ * Each callback batch is at least one eventfd/pipe read, run it under `strace -c -f` to see
+ * the syscalls saved.
+ *
+ * Usage: bench_write [messages] [threads]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "uv.h"
+#include "pomelo-private/mpsc-queue.h"
+
+typedef struct {
+  pc_mpsc_node_t node;
+  int value;
+} bench_msg_t;
+
+static int messages = 20000;
+static int threads = 4;
+
+static uv_loop_t *loop;
+static pc_mpsc_queue_t queue;
+static uv_async_t write_async;
+static uv_async_t *handles;
+static bench_msg_t *msgs;
+static int received;
+static int wakeups;
+
+static void on_handle_close(uv_handle_t *handle) {
+  /* handles are released together */
+}
+
+static void async_cb(uv_async_t *handle, int status) {
+  wakeups++;
+  received++;
+  uv_close((uv_handle_t *)handle, on_handle_close);
+}
+
+static void async_producer(void *arg) {
+  int i;
+  for(i = (int)(size_t)arg; i < messages; i += threads) {
+    uv_async_send(&handles[i]);
+  }
+}
+
+static void mpsc_cb(uv_async_t *handle, int status) {
+  pc_mpsc_node_t *node;
+
+  wakeups++;
+  while((node = pc_mpsc_queue_pop(&queue)) != NULL) {
+    received++;
+  }
+
+  if(received == messages) {
+    uv_close((uv_handle_t *)handle, on_handle_close);
+  }
+}
+
+static void mpsc_producer(void *arg) {
+  int i;
+  for(i = (int)(size_t)arg; i < messages; i += threads) {
+    pc_mpsc_queue_push(&queue, &msgs[i].node);
+    uv_async_send(&write_async);
+  }
+}
+
+static void run(const char *name, void (*producer)(void *arg)) {
+  uv_thread_t *workers;
+  uint64_t start;
+  double ms;
+  int i;
+
+  workers = (uv_thread_t *)malloc(sizeof(uv_thread_t) * threads);
+  received = 0;
+  wakeups = 0;
+
+  start = uv_hrtime();
+  for(i = 0; i < threads; i++) {
+    uv_thread_create(&workers[i], producer, (void *)(size_t)i);
+  }
+  uv_run(loop, UV_RUN_DEFAULT);
+  for(i = 0; i < threads; i++) {
+    uv_thread_join(&workers[i]);
+  }
+  ms = (uv_hrtime() - start) / 1e6;
+
+  printf("%-6s messages: %d, callbacks: %d, time: %.2f ms, %.0f msg/s\n",
+         name, received, wakeups, ms, received / ms * 1000);
+  free(workers);
+}
+
+int main(int argc, char **argv) {
+  int i;
+
+  if(argc > 1) messages = atoi(argv[1]);
+  if(argc > 2) threads = atoi(argv[2]);
+  if(messages <= 0 || threads <= 0) {
+    fprintf(stderr, "Usage: %s [messages] [threads]\n", argv[0]);
+    return 1;
+  }
+
+  loop = uv_loop_new();
+
+  // the legacy handles must be registered in the loop thread beforehand
+  handles = (uv_async_t *)malloc(sizeof(uv_async_t) * messages);
+  for(i = 0; i < messages; i++) {
+    uv_async_init(loop, &handles[i], async_cb);
+  }
+  run("async", async_producer);
+  free(handles);
+
+  msgs = (bench_msg_t *)malloc(sizeof(bench_msg_t) * messages);
+  pc_mpsc_queue_init(&queue);
+  uv_async_init(loop, &write_async, mpsc_cb);
+  run("mpsc", mpsc_producer);
+  free(msgs);
+
+  uv_loop_delete(loop);
+  return 0;
+}
@@ -20,6 +20,15 @@ int main() {
   assert(!strcmp(route, raw_msg->route.route_str));
   assert(!memcmp(body_buf.base, raw_msg->body.base, body_buf.len));
 
+  // decode without copy
+  pc__msg_raw_t raw;
+  assert(!pc_msg_decode_raw(buf.base, buf.len, &raw));
+  assert(raw.id == id);
+  assert(raw.route_len == strlen(route));
+  assert(!memcmp(route, raw.route.route_str, raw.route_len));
+  assert(raw.body.base >= buf.base && raw.body.base < buf.base + buf.len);
+  assert(raw.body.len == body_buf.len);
+
   json_t *body = pc__json_decode(raw_msg->body.base, 0, raw_msg->body.len);
 
   assert(body);
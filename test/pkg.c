@@ -1,8 +1,11 @@
 #include <assert.h>
 #include <pomelo-protocol/package.h>
 
+static int pkg_count = 0;
+
 void on_pkg(pc_pkg_type type, const char *data,
               size_t len, void *attach) {
+  pkg_count++;
   char *msg = malloc(len + 1);
   memset(msg, 0, len + 1);
   memcpy(msg, data, len);
@@ -24,6 +27,14 @@ int main() {
   assert(buf.len > 0);
 
   pc_pkg_parser_feed(&parser, buf.base, buf.len);
+  assert(pkg_count == 1);
+
+  // package split across reads
+  size_t i;
+  for(i = 0; i < buf.len; i++) {
+    pc_pkg_parser_feed(&parser, buf.base + i, 1);
+  }
+  assert(pkg_count == 2);
 
   return 0;
 }
\ No newline at end of file
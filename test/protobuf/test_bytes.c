@@ -0,0 +1,83 @@
+#include <pomelo-protobuf/pb.h>
+#include <jansson.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * rootBytes.json has the bytes of rootMsg.json encoded by the json walker
+ * before the definitions were compiled, the compiled ones must not differ.
+ */
+static void check_bytes(const uint8_t *buf, size_t len, const char *hex) {
+    char out[3];
+    size_t i;
+
+    assert(strlen(hex) == len * 2);
+    for (i = 0; i < len; i++) {
+        sprintf(out, "%02x", buf[i]);
+        assert(memcmp(out, hex + i * 2, 2) == 0);
+    }
+}
+
+int main() {
+    json_t *msg, *protos, *bytes, *value, *proto, *result;
+    json_error_t error;
+    pc_pb_schema_t *schema;
+    const pc_pb_message_t *message;
+    const char *key, *hex;
+    uint8_t buffer[2000];
+    size_t written;
+    int i, count = 0;
+
+    msg = json_load_file("rootMsg.json", 0, &error);
+    protos = json_load_file("rootProtos.json", 0, &error);
+    bytes = json_load_file("rootBytes.json", 0, &error);
+    if (!msg || !protos || !bytes) {
+        printf("error load json\n");
+        return 1;
+    }
+
+    schema = pc_pb_schema_new(protos);
+    assert(schema);
+
+    json_object_foreach(bytes, key, value) {
+        hex = json_string_value(value);
+        proto = json_object_get(protos, key);
+        assert(hex && proto);
+
+        /* compiled on the first call and cached for the second one */
+        for (i = 0; i < 2; i++) {
+            written = 0;
+            assert(pc_pb_encode(buffer, sizeof(buffer), &written, protos, proto,
+                                json_object_get(msg, key)));
+            check_bytes(buffer, written, hex);
+        }
+
+        message = pc_pb_schema_get(schema, key);
+        assert(message);
+        written = 0;
+        assert(pc_pb_encode_message(buffer, sizeof(buffer), &written, message,
+                                    json_object_get(msg, key)));
+        check_bytes(buffer, written, hex);
+
+        /* decoded and encoded again, the fields follow the order of json */
+        result = json_object();
+        assert(pc_pb_decode(buffer, written, protos, proto, result));
+        written = 0;
+        assert(pc_pb_encode(buffer, sizeof(buffer), &written, protos, proto,
+                            result));
+        assert(written * 2 == strlen(hex));
+        json_decref(result);
+        count++;
+    }
+    assert(count == 2);
+
+    pc_pb_schema_destroy(schema);
+    json_decref(bytes);
+    json_decref(protos);
+    json_decref(msg);
+
+    printf("protobuf bytes ok\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <assert.h>
+#include <stdio.h>
+#include <pomelo-private/req-table.h>
+
+#define REQ(id) ((struct pc_request_s *)(uintptr_t)((id) * 16 + 8))
+
+static int released = 0;
+
+static void on_release(pc_req_table_t *table, struct pc_request_s *req) {
+  released++;
+}
+
+static void check(pc_req_table_t *table, const uint32_t *ids, int n,
+                  const int *alive) {
+  int i;
+  for(i = 0; i < n; i++) {
+    if(alive[i]) {
+      assert(pc_req_table_get(table, ids[i]) == REQ(ids[i]));
+    } else {
+      assert(pc_req_table_get(table, ids[i]) == NULL);
+    }
+  }
+}
+
+int main() {
+  pc_req_table_t *table = pc_req_table_new(0, on_release);
+  uint32_t mask;
+  int i;
+
+  assert(table);
+  assert(table->capacity == PC__REQ_TABLE_DEFAULT_CAPACITY);
+  mask = table->capacity - 1;
+
+  // a cluster homed at the last slots wraps around to the first ones, and
+  // is mixed with ids homed at slot 0
+  uint32_t ids[] = {
+    mask - 1, mask, 2 * mask + 1, 2 * mask + 2, mask + 1,
+    3 * mask + 2, 3 * mask + 3, 4 * (mask + 1), 3 * (mask + 1) + 1
+  };
+  int n = sizeof(ids) / sizeof(ids[0]);
+  int alive[sizeof(ids) / sizeof(ids[0])];
+
+  for(i = 0; i < n; i++) {
+    assert(!pc_req_table_set(table, ids[i], REQ(ids[i])));
+    alive[i] = 1;
+  }
+  assert(table->count == n);
+  assert(table->capacity == mask + 1);
+  check(table, ids, n, alive);
+
+  // the slots before the wrap point are occupied by the cluster
+  assert(table->slots[mask - 1].req && table->slots[mask].req);
+  assert(table->slots[0].req && table->slots[1].req);
+
+  // delete in the middle of the cluster, before and after the wrap point
+  int order[] = {1, 4, 0, 7, 3, 8, 2, 6, 5};
+  for(i = 0; i < n; i++) {
+    assert(pc_req_table_del(table, ids[order[i]]) == REQ(ids[order[i]]));
+    alive[order[i]] = 0;
+    assert(pc_req_table_del(table, ids[order[i]]) == NULL);
+    check(table, ids, n, alive);
+  }
+  assert(table->count == 0);
+
+  // reinsert after deletes reuses the slots
+  for(i = 0; i < n; i++) {
+    assert(!pc_req_table_set(table, ids[i], REQ(ids[i])));
+    alive[i] = 1;
+  }
+  assert(pc_req_table_set(table, ids[0], REQ(ids[0])) == 0);
+  assert(table->count == n);
+  check(table, ids, n, alive);
+  pc_req_table_clear(table);
+  assert(released == n);
+  assert(table->count == 0);
+
+  // growth rehashes the requests in flight, including the ids wrapped
+  // around the 32 bits
+  uint32_t base = 0xffffffff - 40;
+  for(i = 0; i < 200; i++) {
+    assert(!pc_req_table_set(table, base + i, REQ(base + i)));
+    assert(table->count * 2 <= table->capacity);
+  }
+  assert(table->capacity == 512);
+  for(i = 0; i < 200; i++) {
+    assert(pc_req_table_get(table, base + i) == REQ(base + i));
+  }
+  for(i = 0; i < 200; i += 2) {
+    assert(pc_req_table_del(table, base + i) == REQ(base + i));
+  }
+  for(i = 0; i < 200; i++) {
+    assert(pc_req_table_get(table, base + i) == (i % 2 ? REQ(base + i) : NULL));
+  }
+  assert(table->count == 100);
+
+  released = 0;
+  pc_req_table_destroy(table);
+  assert(released == 100);
+
+  printf("req table ok\n");
+  return 0;
+}
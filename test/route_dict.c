@@ -0,0 +1,87 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <pomelo.h>
+#include <pomelo-private/internal.h>
+#include <pomelo-private/alloc.h>
+#include <pomelo-protocol/message.h>
+#include <pomelo-protocol/package.h>
+
+static const char *routes[] = {
+  "onChat", "area.onMove", "area.onLeave", "area.onLast"
+};
+static const int codes[] = {1, 300, 0xfffe, PC_MSG_ROUTE_CODE_MAX};
+
+#define ROUTES (sizeof(routes) / sizeof(routes[0]))
+
+static int pushed[ROUTES];
+
+static void on_push(pc_client_t *client, const char *event, void *data) {
+  json_t *msg = (json_t *)data;
+  size_t i;
+
+  for(i = 0; i < ROUTES; i++) {
+    if(strcmp(event, routes[i]) == 0) {
+      assert(json_integer_value(json_object_get(msg, "code")) == codes[i]);
+      pushed[i]++;
+      return;
+    }
+  }
+  assert(0 && "push of unknown route");
+}
+
+static void push(pc_client_t *client, int code) {
+  char body[32];
+  pc_buf_t body_buf;
+
+  sprintf(body, "{\"code\":%d}", code);
+  body_buf.base = body;
+  body_buf.len = strlen(body);
+
+  pc_buf_t msg_buf = pc_msg_encode_code(0, PC_MSG_PUSH, code, body_buf);
+  pc_buf_t pkg_buf = pc_pkg_encode(PC_PKG_DATA, msg_buf.base, msg_buf.len);
+  assert(msg_buf.len != -1 && pkg_buf.len != -1);
+  assert(!pc_pkg_parser_feed(client->pkg_parser, pkg_buf.base, pkg_buf.len));
+
+  pc__free(msg_buf.base, msg_buf.len, PC_ALLOC_MESSAGE);
+  pc__free(pkg_buf.base, pkg_buf.len, PC_ALLOC_PACKAGE);
+}
+
+int main() {
+  pc_client_t *client = pc_client_new();
+  json_t *dict = json_object();
+  pc_route_t route;
+  size_t i;
+
+  for(i = 0; i < ROUTES; i++) {
+    json_object_set_new(dict, routes[i], json_integer(codes[i]));
+    assert(!pc_add_listener(client, routes[i], on_push));
+  }
+  // out of 16 bits, never compressed
+  json_object_set_new(dict, "area.onFar", json_integer(0x10000));
+
+  assert(!pc__routes_set_dict(client, dict));
+  json_decref(dict);
+  assert(client->code_to_route_count == PC_MSG_ROUTE_CODE_MAX + 1);
+
+  // the codes above one byte resolve to their routes in both ways
+  for(i = 0; i < ROUTES; i++) {
+    pc__route_lookup(client, routes[i], &route);
+    assert(route.code == codes[i]);
+    push(client, codes[i]);
+    assert(pushed[i] == 1);
+  }
+  pc__route_lookup(client, "area.onFar", &route);
+  assert(route.code == 0);
+
+  // the code is two bytes, not the low byte of it
+  push(client, 300);
+  push(client, 0xfffe);
+  assert(pushed[0] == 1 && pushed[1] == 2 && pushed[2] == 2 &&
+         pushed[3] == 1);
+
+  pc_client_destroy(client);
+
+  printf("route dict ok\n");
+  return 0;
+}
@@ -0,0 +1,209 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <pomelo.h>
+#include <pomelo-private/timing-wheel.h>
+#include <pomelo-private/internal.h>
+#include <pomelo-private/alloc.h>
+#include <pomelo-private/transport.h>
+#include <pomelo-protocol/message.h>
+#include <pomelo-protocol/package.h>
+
+#define T PC_WHEEL_TICK_MS
+
+static int expired_count(ngx_queue_t *expired) {
+  ngx_queue_t *q;
+  int n = 0;
+  ngx_queue_foreach(q, expired) {
+    n++;
+  }
+  return n;
+}
+
+static int has(ngx_queue_t *expired, pc_wheel_node_t *node) {
+  ngx_queue_t *q;
+  ngx_queue_foreach(q, expired) {
+    if(q == &node->queue) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void test_wheel() {
+  pc_timing_wheel_t wheel;
+  pc_wheel_node_t a, b, c, d, e;
+  ngx_queue_t expired;
+
+  memset(&a, 0, sizeof(a));
+  memset(&b, 0, sizeof(b));
+  memset(&c, 0, sizeof(c));
+  memset(&d, 0, sizeof(d));
+  memset(&e, 0, sizeof(e));
+  pc_wheel_init(&wheel, 0);
+
+  pc_wheel_add(&wheel, &a, 3 * T);
+  // more than a round out, hashed into the same slot as c
+  pc_wheel_add(&wheel, &b, (PC_WHEEL_SLOTS + 44) * T);
+  pc_wheel_add(&wheel, &c, 44 * T);
+  pc_wheel_add(&wheel, &d, 10 * T);
+  assert(wheel.count == 4);
+
+  ngx_queue_init(&expired);
+  pc_wheel_expire(&wheel, 2 * T, &expired);
+  assert(ngx_queue_empty(&expired));
+
+  pc_wheel_expire(&wheel, 3 * T, &expired);
+  assert(expired_count(&expired) == 1 && has(&expired, &a));
+  assert(a.deadline == 0);
+
+  // removed nodes never expire, and removing twice does nothing
+  pc_wheel_remove(&wheel, &d);
+  pc_wheel_remove(&wheel, &d);
+  assert(wheel.count == 2);
+
+  // the node of later round stays in the slot
+  ngx_queue_init(&expired);
+  pc_wheel_expire(&wheel, 44 * T, &expired);
+  assert(expired_count(&expired) == 1 && has(&expired, &c));
+  assert(wheel.count == 1 && b.deadline != 0);
+
+  // the loop stalled for more than a round, the ticks skipped are not lost
+  ngx_queue_init(&expired);
+  pc_wheel_expire(&wheel, (3 * PC_WHEEL_SLOTS + 7) * T, &expired);
+  assert(expired_count(&expired) == 1 && has(&expired, &b));
+  assert(wheel.count == 0);
+
+  // a deadline passed already is due on the next tick
+  pc_wheel_add(&wheel, &e, T);
+  ngx_queue_init(&expired);
+  pc_wheel_expire(&wheel, (3 * PC_WHEEL_SLOTS + 7) * T, &expired);
+  assert(ngx_queue_empty(&expired));
+  pc_wheel_expire(&wheel, (3 * PC_WHEEL_SLOTS + 8) * T, &expired);
+  assert(has(&expired, &e) && wheel.count == 0);
+}
+
+static int timeouts = 0;
+static int responses = 0;
+
+static void on_request(pc_request_t *req, int status, json_t *resp) {
+  if(status == PC_REQ_TIMEOUT) {
+    timeouts++;
+  } else {
+    responses++;
+  }
+  pc_request_destroy(req);
+}
+
+static void test_request_timeout() {
+  pc_client_t *client = pc_client_new();
+  pc_request_t *req = pc_client_request_new(client);
+  pc_request_t *pending = pc_client_request_new(client);
+  uint64_t now;
+
+  uv_update_time(client->uv_loop);
+  now = uv_now(client->uv_loop);
+
+  req->id = 7;
+  req->timeout = T;
+  req->client = client;
+  req->cb = on_request;
+  assert(!pc_req_table_set(client->requests, req->id, req));
+
+  pending->id = 8;
+  pending->timeout = 100 * T;
+  pending->client = client;
+  pending->cb = on_request;
+  assert(!pc_req_table_set(client->requests, pending->id, pending));
+
+  // the requests were sent a few ticks ago, only the first one is due
+  client->req_wheel = (pc_timing_wheel_t *)pc__malloc(
+      sizeof(pc_timing_wheel_t), PC_ALLOC_REQUEST);
+  pc_wheel_init(client->req_wheel, now - 4 * T);
+  pc_wheel_add(client->req_wheel, &req->timer, now - 4 * T + req->timeout);
+  pc_wheel_add(client->req_wheel, &pending->timer,
+               now - 4 * T + pending->timeout);
+
+  pc__request_timer_cb(client->req_timer, 0);
+  assert(timeouts == 1 && responses == 0);
+  assert(pc_req_table_get(client->requests, 7) == NULL);
+  assert(pc_req_table_get(client->requests, 8) == pending);
+
+  // the late response finds no request and is discarded
+  const char *body = "{\"code\":200}";
+  pc_buf_t body_buf;
+  body_buf.base = (char *)body;
+  body_buf.len = strlen(body);
+  pc_buf_t msg_buf = pc_msg_encode_route(7, PC_MSG_RESPONSE, NULL, body_buf);
+  pc_buf_t pkg_buf = pc_pkg_encode(PC_PKG_DATA, msg_buf.base, msg_buf.len);
+  assert(!pc_pkg_parser_feed(client->pkg_parser, pkg_buf.base, pkg_buf.len));
+  assert(timeouts == 1 && responses == 0);
+
+  pc__free(msg_buf.base, msg_buf.len, PC_ALLOC_MESSAGE);
+  pc__free(pkg_buf.base, pkg_buf.len, PC_ALLOC_PACKAGE);
+  pc_client_destroy(client);
+}
+
+static void test_timeout_before_write() {
+  pc_client_t *client = pc_client_new();
+  pc_transport_t *transport = pc_transport_new(client);
+  pc_request_t *req = pc_client_request_new(client);
+  pc_request_t *reused;
+  json_t *msg = json_object();
+  uint32_t id;
+
+  timeouts = 0;
+  responses = 0;
+
+  // a transport never connected, whose writes fail on flush
+  transport->state = PC_TP_ST_WORKING;
+  client->transport = transport;
+  client->state = PC_ST_WORKING;
+
+  assert(!pc_request_with_timeout(client, req, "area.playerHandler.move", msg,
+                                  T, on_request));
+  pc__client_flush_writes(client, 0);
+  id = req->id;
+  assert(pc_req_table_get(client->requests, id) == req);
+  assert(transport->nframes == 1);
+
+  // due while the frame is still queued
+  pc_wheel_remove(client->req_wheel, &req->timer);
+  client->req_wheel->tick -= 4;
+  pc_wheel_add(client->req_wheel, &req->timer,
+               (client->req_wheel->tick + 1) * T);
+  pc__request_timer_cb(client->req_timer, 0);
+  assert(timeouts == 1 && responses == 0);
+
+  // the request released by timeout is reused for another one
+  reused = pc_client_request_new(client);
+  assert(reused == req);
+  reused->id = id + 1;
+  reused->client = client;
+  reused->cb = on_request;
+  assert(!pc_req_table_set(client->requests, reused->id, reused));
+
+  // the failed write of the request timed out leaves the new one alone
+  pc_transport_flush(transport);
+  assert(transport->nframes == 0);
+  assert(timeouts == 1 && responses == 0);
+  assert(pc_req_table_get(client->requests, id + 1) == reused);
+
+  pc_req_table_del(client->requests, reused->id);
+  pc_request_destroy(reused);
+  json_decref(msg);
+  client->transport = NULL;
+  client->state = PC_ST_INITED;
+  pc_transport_destroy(transport);
+  uv_run(client->uv_loop, UV_RUN_NOWAIT);
+  pc_client_destroy(client);
+}
+
+int main() {
+  test_wheel();
+  test_request_timeout();
+  test_timeout_before_write();
+
+  printf("timing wheel ok\n");
+  return 0;
+}
@@ -0,0 +1,596 @@
+#!/usr/bin/env python
+"""Generate C structs and codecs for pomelo protobuf routes.
+
+Reads the serverProtos/clientProtos json, as the server sends them in
+handshake and libpomelo dumps them, and emits <out>.h and <out>.c with one
+struct per message and a pc_typed_codec_t per route for pc_request_typed,
+pc_notify_typed and pc_add_typed_listener. The wire format is the same as
+src/pb-encode.c and src/pb-decode.c.
+
+Usage: pc_protoc.py [-p prefix] [-s serverProtos] [-c clientProtos] -o out
+"""
+
+import json
+import optparse
+import os
+import re
+import sys
+
+SCALARS = {
+    # type: (c type, wire type)
+    'uInt32': ('uint32_t', 0),
+    'int32': ('int32_t', 0),
+    'sInt32': ('int32_t', 0),
+    'float': ('float', 5),
+    'double': ('double', 1),
+    'string': ('pc_pb_str_t', 2),
+}
+
+OPTIONS = ('required', 'optional', 'repeated')
+
+
+class ProtocError(Exception):
+    pass
+
+
+def ident(name):
+    return re.sub(r'[^0-9A-Za-z_]', '_', name)
+
+
+def varint(value):
+    out = []
+    while value >= 0x80:
+        out.append((value & 0x7f) | 0x80)
+        value >>= 7
+    out.append(value)
+    return out
+
+
+class Field(object):
+    def __init__(self, message, name, d):
+        self.message = message
+        self.name = name
+        self.cname = ident(name)
+        self.option = d.get('option')
+        self.type = d.get('type')
+        self.tag = int(d.get('tag', 0))
+        if self.option not in OPTIONS:
+            raise ProtocError('unknown option %s of %s.%s'
+                              % (self.option, message.name, name))
+        self.sub = None
+
+    @property
+    def scalar(self):
+        return self.type in SCALARS
+
+    @property
+    def packed(self):
+        return self.option == 'repeated' and self.scalar \
+            and self.type != 'string'
+
+    @property
+    def ctype(self):
+        if self.scalar:
+            return SCALARS[self.type][0]
+        return self.sub.ctype
+
+    @property
+    def key(self):
+        wire = SCALARS[self.type][1] if self.scalar else 2
+        return varint((self.tag << 3) | wire)
+
+
+class Message(object):
+    def __init__(self, name, cname, d, parent, public):
+        self.name = name
+        self.cname = cname
+        self.parent = parent
+        self.public = public
+        self.fields = []
+        self.nested = {}
+        for key in sorted(d.keys()):
+            if key.startswith('__') or not isinstance(d[key], dict):
+                continue
+            self.fields.append(Field(self, key, d[key]))
+        self.fields.sort(key=lambda f: f.tag)
+        for key, sub in sorted(d.get('__messages', {}).items()):
+            self.nested[key] = Message(key, cname + '_' + ident(key), sub,
+                                       self, False)
+
+    @property
+    def ctype(self):
+        return self.cname + '_t'
+
+    def walk(self):
+        yield self
+        for key in sorted(self.nested.keys()):
+            for m in self.nested[key].walk():
+                yield m
+
+
+class Side(object):
+    """Messages of server or client protos."""
+
+    def __init__(self, prefix, side, protos):
+        self.routes = []
+        self.globals = {}
+        base = '%s_%s_' % (prefix, side)
+        for key in sorted(protos.keys()):
+            d = protos[key]
+            if not isinstance(d, dict) or key.startswith('__'):
+                continue
+            if key.startswith('message '):
+                name = key[len('message '):]
+                self.globals[name] = Message(name, base + ident(name), d,
+                                             None, False)
+            else:
+                self.routes.append(Message(key, base + ident(key), d,
+                                           None, True))
+
+    def messages(self):
+        for m in self.routes:
+            for sub in m.walk():
+                yield sub
+        for key in sorted(self.globals.keys()):
+            for sub in self.globals[key].walk():
+                yield sub
+
+    def resolve(self):
+        for m in self.messages():
+            for f in m.fields:
+                if f.scalar:
+                    continue
+                scope = m
+                while scope and f.sub is None:
+                    f.sub = scope.nested.get(f.type)
+                    scope = scope.parent
+                if f.sub is None:
+                    f.sub = self.globals.get(f.type)
+                if f.sub is None:
+                    raise ProtocError('unknown type %s of %s.%s'
+                                      % (f.type, m.name, f.name))
+
+
+def sort_messages(messages):
+    """Structs embedding others by value come after them."""
+    done = set()
+    visiting = set()
+    out = []
+
+    def visit(m):
+        if m.cname in done:
+            return
+        if m.cname in visiting:
+            raise ProtocError('message %s contains itself, make the field '
+                              'repeated' % m.name)
+        visiting.add(m.cname)
+        for f in m.fields:
+            if f.sub is not None and f.option != 'repeated':
+                visit(f.sub)
+        visiting.discard(m.cname)
+        done.add(m.cname)
+        out.append(m)
+
+    for m in messages:
+        visit(m)
+    return out
+
+
+class Writer(object):
+    def __init__(self):
+        self.lines = []
+
+    def __call__(self, line='', *args):
+        self.lines.append((line % args) if args else line)
+
+    def text(self):
+        return '\n'.join(self.lines) + '\n'
+
+
+def value_size(f, v):
+    if f.type == 'uInt32':
+        return 'pc_pb_varint_size(%s)' % v
+    if f.type in ('int32', 'sInt32'):
+        return 'pc_pb_varint_size(PC_PB_ZIGZAG((int64_t)%s))' % v
+    if f.type == 'float':
+        return '4'
+    if f.type == 'double':
+        return '8'
+    if f.type == 'string':
+        return 'pc_pb_varint_size(%s.len) + %s.len' % (v, v)
+    return None
+
+
+def emit_size(w, m):
+    w('static size_t %s__size(const %s *msg) {', m.cname, m.ctype)
+    if any(not f.scalar for f in m.fields):
+        w('  size_t size = 0, sub;')
+    else:
+        w('  size_t size = 0;')
+    if any(f.option == 'repeated' for f in m.fields):
+        w('  size_t i;')
+    w()
+    for f in m.fields:
+        k = len(f.key)
+        if f.option == 'repeated':
+            items = 'msg->%s[i]' % f.cname
+            count = 'msg->%s_count' % f.cname
+            if f.packed:
+                w('  if(%s > 0) {', count)
+                w('    size += %d + pc_pb_varint_size(%s);', k, count)
+                w('    for(i = 0; i < %s; i++) {', count)
+                w('      size += %s;', value_size(f, items))
+                w('    }')
+                w('  }')
+            elif f.scalar:
+                w('  for(i = 0; i < %s; i++) {', count)
+                w('    size += %d + %s;', k, value_size(f, items))
+                w('  }')
+            else:
+                w('  for(i = 0; i < %s; i++) {', count)
+                w('    sub = %s__size(&%s);', f.sub.cname, items)
+                w('    size += %d + pc_pb_varint_size(sub) + sub;', k)
+                w('  }')
+            continue
+        indent = '  '
+        if f.option == 'optional':
+            w('  if(msg->has_%s) {', f.cname)
+            indent = '    '
+        v = 'msg->%s' % f.cname
+        if f.scalar:
+            w('%ssize += %d + %s;', indent, k, value_size(f, v))
+        else:
+            w('%ssub = %s__size(&%s);', indent, f.sub.cname, v)
+            w('%ssize += %d + pc_pb_varint_size(sub) + sub;', indent, k)
+        if f.option == 'optional':
+            w('  }')
+    w()
+    w('  return size;')
+    w('}')
+    w()
+
+
+def write_value(w, indent, f, v):
+    if f.type == 'uInt32':
+        w('%sp = pc_pb_put_varint(p, %s);', indent, v)
+    elif f.type in ('int32', 'sInt32'):
+        w('%sp = pc_pb_put_varint(p, PC_PB_ZIGZAG((int64_t)%s));', indent, v)
+    elif f.type == 'float':
+        w('%sp = pc_pb_put_float(p, %s);', indent, v)
+    elif f.type == 'double':
+        w('%sp = pc_pb_put_double(p, %s);', indent, v)
+    elif f.type == 'string':
+        w('%sp = pc_pb_put_bytes(p, %s.data, %s.len);', indent, v, v)
+    else:
+        w('%sp = pc_pb_put_varint(p, %s__size(&%s));', indent, f.sub.cname, v)
+        w('%sp = %s__write(&%s, p);', indent, f.sub.cname, v)
+
+
+def write_key(w, indent, f):
+    w('%s%s', indent, ' '.join('*p++ = 0x%02x;' % b for b in f.key))
+
+
+def emit_write(w, m):
+    w('static uint8_t *%s__write(const %s *msg, uint8_t *p) {',
+      m.cname, m.ctype)
+    if any(f.option == 'repeated' for f in m.fields):
+        w('  size_t i;')
+        w()
+    for f in m.fields:
+        v = 'msg->%s' % f.cname
+        if f.option == 'repeated':
+            items = 'msg->%s[i]' % f.cname
+            count = 'msg->%s_count' % f.cname
+            if f.packed:
+                # pomelo counts the items instead of the bytes
+                w('  if(%s > 0) {', count)
+                write_key(w, '    ', f)
+                w('    p = pc_pb_put_varint(p, %s);', count)
+                w('    for(i = 0; i < %s; i++) {', count)
+                write_value(w, '      ', f, items)
+                w('    }')
+                w('  }')
+            else:
+                w('  for(i = 0; i < %s; i++) {', count)
+                write_key(w, '    ', f)
+                write_value(w, '    ', f, items)
+                w('  }')
+            continue
+        indent = '  '
+        if f.option == 'optional':
+            w('  if(msg->has_%s) {', f.cname)
+            indent = '    '
+        write_key(w, indent, f)
+        write_value(w, indent, f, v)
+        if f.option == 'optional':
+            w('  }')
+    w()
+    w('  return p;')
+    w('}')
+    w()
+
+
+def read_value(w, indent, f, dest):
+    if f.type in ('uInt32', 'int32', 'sInt32'):
+        w('%sif(pc_pb_get_varint(&r, &v)) {', indent)
+        w('%s  return -1;', indent)
+        w('%s}', indent)
+        if f.type == 'uInt32':
+            w('%s%s = (uint32_t)v;', indent, dest)
+        else:
+            w('%s%s = (int32_t)PC_PB_UNZIGZAG(v);', indent, dest)
+    elif f.type == 'float':
+        w('%sif(pc_pb_get_float(&r, &%s)) {', indent, dest)
+        w('%s  return -1;', indent)
+        w('%s}', indent)
+    elif f.type == 'double':
+        w('%sif(pc_pb_get_double(&r, &%s)) {', indent, dest)
+        w('%s  return -1;', indent)
+        w('%s}', indent)
+    elif f.type == 'string':
+        w('%sif(pc_pb_get_bytes(&r, &data, &len)) {', indent)
+        w('%s  return -1;', indent)
+        w('%s}', indent)
+        w('%s%s.data = (const char *)data;', indent, dest)
+        w('%s%s.len = len;', indent, dest)
+    else:
+        w('%sif(pc_pb_get_bytes(&r, &data, &len) ||', indent)
+        w('%s   %s__read(&%s, data, len)) {', indent, f.sub.cname, dest)
+        w('%s  return -1;', indent)
+        w('%s}', indent)
+
+
+def emit_read(w, m):
+    w('static int %s__read(%s *msg, const uint8_t *buf, size_t size) {',
+      m.cname, m.ctype)
+    varints = [f for f in m.fields
+               if f.type in ('uInt32', 'int32', 'sInt32')]
+    w('  pc_pb_reader_t r;')
+    w('  uint64_t key%s%s;', ', v' if varints else '',
+      ', n' if any(f.packed for f in m.fields) else '')
+    if any(f.type == 'string' or not f.scalar for f in m.fields):
+        w('  const uint8_t *data;')
+        w('  size_t len;')
+    w()
+    w('  r.p = buf;')
+    w('  r.end = buf + size;')
+    w('  while(r.p < r.end) {')
+    w('    if(pc_pb_get_varint(&r, &key)) {')
+    w('      return -1;')
+    w('    }')
+    w('    if(key == 0) {')
+    w('      // 0-terminated message')
+    w('      break;')
+    w('    }')
+    w('    switch(key >> 3) {')
+    for f in m.fields:
+        w('      case %d:', f.tag)
+        items = 'msg->%s' % f.cname
+        count = 'msg->%s_count' % f.cname
+        if f.packed:
+            w('        if(pc_pb_get_varint(&r, &n) || n > (uint64_t)(r.end - r.p) ||')
+            w('           pc_pb_reserve((void **)&%s, %s, (size_t)n,', items, count)
+            w('                         sizeof(%s))) {', f.ctype)
+            w('          return -1;')
+            w('        }')
+            w('        for(; n > 0; n--) {')
+            read_value(w, '          ', f, '%s[%s]' % (items, count))
+            w('          %s++;', count)
+            w('        }')
+        elif f.option == 'repeated':
+            w('        if(pc_pb_reserve((void **)&%s, %s, 1, sizeof(%s))) {',
+              items, count, f.ctype)
+            w('          return -1;')
+            w('        }')
+            w('        memset(&%s[%s], 0, sizeof(%s));', items, count, f.ctype)
+            w('        %s++;', count)
+            read_value(w, '        ', f, '%s[%s - 1]' % (items, count))
+        else:
+            read_value(w, '        ', f, items)
+            if f.option == 'optional':
+                w('        msg->has_%s = 1;', f.cname)
+        w('        break;')
+    w('      default:')
+    w('        return -1;')
+    w('    }')
+    w('  }')
+    w()
+    w('  return 0;')
+    w('}')
+    w()
+
+
+def emit_release(w, m):
+    w('static void %s__release(%s *msg) {', m.cname, m.ctype)
+    if any(f.option == 'repeated' and not f.scalar for f in m.fields):
+        w('  size_t i;')
+        w()
+    for f in m.fields:
+        if f.option == 'repeated':
+            if not f.scalar:
+                w('  for(i = 0; i < msg->%s_count; i++) {', f.cname)
+                w('    %s__release(&msg->%s[i]);', f.sub.cname, f.cname)
+                w('  }')
+            w('  pc_pb_release(msg->%s, msg->%s_count, sizeof(*msg->%s));',
+              f.cname, f.cname, f.cname)
+            w('  msg->%s = NULL;', f.cname)
+            w('  msg->%s_count = 0;', f.cname)
+        elif not f.scalar:
+            w('  %s__release(&msg->%s);', f.sub.cname, f.cname)
+    w('}')
+    w()
+
+
+def emit_public(w, m):
+    c, t = m.cname, m.ctype
+    w('size_t %s_size(const %s *msg) {', c, t)
+    w('  return %s__size(msg);', c)
+    w('}')
+    w()
+    w('int %s_encode(const %s *msg, uint8_t *buf, size_t len) {', c, t)
+    w('  if(%s__size(msg) > len) {', c)
+    w('    return -1;')
+    w('  }')
+    w('  %s__write(msg, buf);', c)
+    w('  return 0;')
+    w('}')
+    w()
+    w('int %s_decode(%s *msg, const uint8_t *buf, size_t len) {', c, t)
+    w('  memset(msg, 0, sizeof(%s));', t)
+    w('  if(%s__read(msg, buf, len)) {', c)
+    w('    %s__release(msg);', c)
+    w('    return -1;')
+    w('  }')
+    w('  return 0;')
+    w('}')
+    w()
+    w('void %s_release(%s *msg) {', c, t)
+    w('  %s__release(msg);', c)
+    w('}')
+    w()
+    w('static size_t %s__codec_size(const void *msg) {', c)
+    w('  return %s__size((const %s *)msg);', c, t)
+    w('}')
+    w()
+    w('static int %s__codec_encode(const void *msg, uint8_t *buf, size_t len) {', c)
+    w('  return %s_encode((const %s *)msg, buf, len);', c, t)
+    w('}')
+    w()
+    w('static int %s__codec_decode(void *msg, const uint8_t *buf, size_t len) {', c)
+    w('  return %s_decode((%s *)msg, buf, len);', c, t)
+    w('}')
+    w()
+    w('static void %s__codec_release(void *msg) {', c)
+    w('  %s__release((%s *)msg);', c, t)
+    w('}')
+    w()
+    w('const pc_typed_codec_t %s_codec = {', c)
+    w('  "%s",', m.name)
+    w('  sizeof(%s),', t)
+    w('  %s__codec_size,', c)
+    w('  %s__codec_encode,', c)
+    w('  %s__codec_decode,', c)
+    w('  %s__codec_release', c)
+    w('};')
+    w()
+
+
+def emit_struct(w, m):
+    w('struct %s_s {', m.cname)
+    for f in m.fields:
+        if f.option == 'repeated':
+            w('  %s *%s;', f.ctype, f.cname)
+            w('  size_t %s_count;', f.cname)
+        else:
+            w('  %s %s;', f.ctype, f.cname)
+            if f.option == 'optional':
+                w('  int has_%s;', f.cname)
+    w('};')
+    w()
+
+
+def generate(sides, out):
+    guard = ident(os.path.basename(out)).upper() + '_H'
+    base = os.path.basename(out)
+    messages = []
+    for side in sides:
+        messages.extend(side.messages())
+    seen = set()
+    for m in messages:
+        if m.cname in seen:
+            raise ProtocError('duplicated struct name %s' % m.cname)
+        seen.add(m.cname)
+    messages = sort_messages(messages)
+
+    h = Writer()
+    h('/* Generated by tools/pc_protoc.py, do not edit. */')
+    h('#ifndef %s', guard)
+    h('#define %s', guard)
+    h()
+    h('#include "pomelo-protobuf/pb-typed.h"')
+    h()
+    h('#ifdef __cplusplus')
+    h('extern "C" {')
+    h('#endif')
+    h()
+    for m in messages:
+        h('typedef struct %s_s %s;', m.cname, m.ctype)
+    h()
+    for m in messages:
+        emit_struct(h, m)
+    for m in messages:
+        if not m.public:
+            continue
+        h('/* %s */', m.name)
+        h('size_t %s_size(const %s *msg);', m.cname, m.ctype)
+        h('int %s_encode(const %s *msg, uint8_t *buf, size_t len);',
+          m.cname, m.ctype)
+        h('int %s_decode(%s *msg, const uint8_t *buf, size_t len);',
+          m.cname, m.ctype)
+        h('void %s_release(%s *msg);', m.cname, m.ctype)
+        h('extern const pc_typed_codec_t %s_codec;', m.cname)
+        h()
+    h('#ifdef __cplusplus')
+    h('}')
+    h('#endif')
+    h()
+    h('#endif /* %s */', guard)
+
+    c = Writer()
+    c('/* Generated by tools/pc_protoc.py, do not edit. */')
+    c('#include <stdlib.h>')
+    c('#include <string.h>')
+    c('#include "%s.h"', base)
+    c()
+    for m in messages:
+        c('static size_t %s__size(const %s *msg);', m.cname, m.ctype)
+        c('static uint8_t *%s__write(const %s *msg, uint8_t *p);',
+          m.cname, m.ctype)
+        c('static int %s__read(%s *msg, const uint8_t *buf, size_t size);',
+          m.cname, m.ctype)
+        c('static void %s__release(%s *msg);', m.cname, m.ctype)
+    c()
+    for m in messages:
+        emit_size(c, m)
+        emit_write(c, m)
+        emit_read(c, m)
+        emit_release(c, m)
+    for m in messages:
+        if m.public:
+            emit_public(c, m)
+
+    with open(out + '.h', 'w') as f:
+        f.write(h.text())
+    with open(out + '.c', 'w') as f:
+        f.write(c.text().rstrip('\n') + '\n')
+
+
+def main():
+    parser = optparse.OptionParser(usage='%prog [options] -o out')
+    parser.add_option('-p', '--prefix', default='pc_proto',
+                      help='prefix of the generated names')
+    parser.add_option('-s', '--server', help='serverProtos json file')
+    parser.add_option('-c', '--client', help='clientProtos json file')
+    parser.add_option('-o', '--out', help='output path without extension')
+    opts, _ = parser.parse_args()
+    if not opts.out or not (opts.server or opts.client):
+        parser.error('need -o and at least one of -s and -c')
+
+    sides = []
+    try:
+        for side, path in (('server', opts.server), ('client', opts.client)):
+            if not path:
+                continue
+            with open(path) as f:
+                s = Side(ident(opts.prefix), side, json.load(f))
+            s.resolve()
+            sides.append(s)
+        generate(sides, opts.out)
+    except ProtocError as e:
+        sys.stderr.write('pc_protoc: %s\n' % e)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())